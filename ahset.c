@@ -0,0 +1,210 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "ahset.h"
+#include "hfn.h"
+
+#define AHS_BUCKET_SIZE 4
+#define AHS_MAX_LOAD 0.95
+#define AHS_MAX_KICKS 500
+
+typedef uint16_t ahs_fp_t; /* 0 is an empty slot */
+
+typedef struct {
+    ahs_fp_t fp[AHS_BUCKET_SIZE];
+} ahs_bucket_t;
+
+struct ahset {
+    ahs_bucket_t* table;
+    uint32_t size; /* number of buckets */
+    size_t n;
+    uint32_t rand_state;
+    /*
+     * The fingerprint that was left without a place when the
+     * filter got full
+     */
+    bool has_victim;
+    uint32_t victim_idx;
+    ahs_fp_t victim_fp;
+};
+
+/*
+ * Two different hash functions for the bucket and the fingerprint,
+ * so that the filter can have more than 2^16 buckets
+ */
+#define AHS_HFN fnv32_hash
+#define AHS_FP_HFN jen_hash
+
+#define ahs_fast_mod32(x,N) ((uint32_t) (((uint64_t) (x) * (uint64_t) (N)) >> 32))
+
+/*
+ * The other bucket of a fingerprint: (H(fp) - i) mod size, so that
+ * either bucket gives the other one
+ */
+static inline uint32_t _ahs_alt_index(ahset_t* h, uint32_t i, ahs_fp_t fp)
+{
+    uint32_t hfp = ahs_fast_mod32(fmix32(fp), h->size);
+    return hfp >= i ? hfp - i : hfp + h->size - i;
+}
+
+static inline void _ahs_hash(ahset_t* h, const char* key, uint32_t* i, ahs_fp_t* fp)
+{
+    size_t len = strlen(key);
+    *i = ahs_fast_mod32(fmix32(AHS_HFN(key, len)), h->size);
+    *fp = AHS_FP_HFN(key, len) & 0xffff;
+    if (*fp == 0)
+        *fp = 1;
+}
+
+ahset_t* ahs_create(uint32_t capacity)
+{
+    ahset_t* h = calloc(1U, sizeof *h);
+    if (!h) {
+        perror("ahs_create");
+        return NULL;
+    }
+    h->size = capacity / (AHS_BUCKET_SIZE * AHS_MAX_LOAD) + 1;
+    h->table = calloc(h->size, sizeof *h->table);
+    if (!h->table) {
+        perror("ahs_create");
+        free(h);
+        return NULL;
+    }
+    h->rand_state = 2463534242U;
+    return h;
+}
+
+void ahs_destroy(ahset_t* h)
+{
+    free(h->table);
+    free(h);
+}
+
+size_t ahs_size(ahset_t* h)
+{
+    return h->n;
+}
+
+size_t ahs_memory(ahset_t* h)
+{
+    return sizeof *h + h->size * sizeof *h->table;
+}
+
+static bool _ahs_bucket_add(ahs_bucket_t* b, ahs_fp_t fp)
+{
+    for (int k = 0; k < AHS_BUCKET_SIZE; ++k) {
+        if (b->fp[k] == 0) {
+            b->fp[k] = fp;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool _ahs_bucket_has(ahs_bucket_t* b, ahs_fp_t fp)
+{
+    /* No early exit, so that the compiler can do the 4 in one go */
+    bool found = false;
+    for (int k = 0; k < AHS_BUCKET_SIZE; ++k)
+        found |= b->fp[k] == fp;
+    return found;
+}
+
+static bool _ahs_bucket_remove(ahs_bucket_t* b, ahs_fp_t fp)
+{
+    for (int k = 0; k < AHS_BUCKET_SIZE; ++k) {
+        if (b->fp[k] == fp) {
+            b->fp[k] = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t _ahs_rand(ahset_t* h)
+{
+    /* xorshift32 */
+    uint32_t x = h->rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return h->rand_state = x;
+}
+
+bool ahs_add(ahset_t* h, const char* key)
+{
+    uint32_t i1, i2;
+    ahs_fp_t fp;
+
+    if (h->has_victim)
+        return false;
+    _ahs_hash(h, key, &i1, &fp);
+    i2 = _ahs_alt_index(h, i1, fp);
+    if (_ahs_bucket_add(h->table + i1, fp) || _ahs_bucket_add(h->table + i2, fp)) {
+        h->n++;
+        return true;
+    }
+
+    /* Both are full: kick fingerprints to their other bucket */
+    uint32_t i = _ahs_rand(h) & 1 ? i1 : i2;
+    for (int kick = 0; kick < AHS_MAX_KICKS; ++kick) {
+        int k = _ahs_rand(h) % AHS_BUCKET_SIZE;
+        ahs_fp_t t = h->table[i].fp[k];
+        h->table[i].fp[k] = fp;
+        fp = t;
+        i = _ahs_alt_index(h, i, fp);
+        if (_ahs_bucket_add(h->table + i, fp)) {
+            h->n++;
+            return true;
+        }
+    }
+    /*
+     * Keep the last one kicked out aside, so that nothing that was
+     * added is lost, but refuse any more keys
+     */
+    h->has_victim = true;
+    h->victim_idx = i;
+    h->victim_fp = fp;
+    h->n++;
+    return true;
+}
+
+bool ahs_contains(ahset_t* h, const char* key)
+{
+    uint32_t i1, i2;
+    ahs_fp_t fp;
+
+    _ahs_hash(h, key, &i1, &fp);
+    i2 = _ahs_alt_index(h, i1, fp);
+    if (_ahs_bucket_has(h->table + i1, fp) || _ahs_bucket_has(h->table + i2, fp))
+        return true;
+    return h->has_victim && h->victim_fp == fp
+        && (h->victim_idx == i1 || h->victim_idx == i2);
+}
+
+bool ahs_remove(ahset_t* h, const char* key)
+{
+    uint32_t i1, i2;
+    ahs_fp_t fp;
+
+    _ahs_hash(h, key, &i1, &fp);
+    i2 = _ahs_alt_index(h, i1, fp);
+    if (h->has_victim && h->victim_fp == fp
+            && (h->victim_idx == i1 || h->victim_idx == i2)) {
+        h->has_victim = false;
+        h->n--;
+        return true;
+    }
+    if (_ahs_bucket_remove(h->table + i1, fp) || _ahs_bucket_remove(h->table + i2, fp)) {
+        h->n--;
+        /* There's room now for the one left aside */
+        if (h->has_victim && (_ahs_bucket_add(h->table + h->victim_idx, h->victim_fp)
+                    || _ahs_bucket_add(h->table + _ahs_alt_index(h, h->victim_idx, h->victim_fp),
+                        h->victim_fp)))
+            h->has_victim = false;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+    /*
+     * An approximate set of C strings: a cuckoo filter, see
+     * "Cuckoo Filter: Practically Better Than Bloom", Fan et al. 2014
+     *
+     * Only a 16 bit fingerprint of each key is kept, in buckets of 4,
+     * i.e. about 2 bytes per key at the 95% load it can reach. In
+     * exchange ahs_contains may say yes for a key that was never added,
+     * with a probability of about 0.012%. It never says no for a key
+     * that was added.
+     */
+    typedef struct ahset ahset_t;
+
+    /*
+     * Creates a filter for up to `capacity` keys. Adding more keys than
+     * that may fail
+     */
+    ahset_t* ahs_create(uint32_t capacity);
+
+    /*
+     * Adds the key in the filter, returning false if the filter is full.
+     * A key can be added more than once (and then has to be removed as
+     * many times)
+     */
+    bool ahs_add(ahset_t* h, const char* key);
+    bool ahs_contains(ahset_t* h, const char* key);
+
+    /*
+     * Removes a key that has been added: removing a key that was never
+     * added may remove another key instead
+     */
+    bool ahs_remove(ahset_t* h, const char* key);
+
+    size_t ahs_size(ahset_t* h);
+
+    /*
+     * Returns the number of bytes allocated for the filter
+     */
+    size_t ahs_memory(ahset_t* h);
+    void ahs_destroy(ahset_t* h);
+
+#ifdef __cplusplus
+}
+#endif
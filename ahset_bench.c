@@ -0,0 +1,68 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "hset.h"
+#include "ahset.h"
+
+/*
+ * Memory and lookup throughput of the cuckoo filter against the exact
+ * hset, for URL-like keys
+ */
+
+#define elapsed_secs(start) ((double) (clock() - (start)) / CLOCKS_PER_SEC)
+
+static char* url(char* buf, size_t i)
+{
+    sprintf(buf, "https://www.example.com/articles/%zu/comments?page=%zu", i * 7919, i % 13);
+    return buf;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    char buf[128];
+    clock_t start;
+
+    hset_t* hs = hs_create(n);
+    ahset_t* ahs = ahs_create(n);
+    size_t failed = 0;
+    for (size_t i = 0; i < n; ++i) {
+        hs_add(hs, url(buf, i));
+        failed += !ahs_add(ahs, buf);
+    }
+    printf("%zu keys (%zu not fitting in the filter)\n", n, failed);
+    printf("hset:   %10zu bytes, %6.2f bytes per key\n",
+            hs_memory(hs), (double) hs_memory(hs) / n);
+    printf("ahset:  %10zu bytes, %6.2f bytes per key\n",
+            ahs_memory(ahs), (double) ahs_memory(ahs) / n);
+
+    /* Half of the lookups are for keys that were added */
+    size_t found = 0;
+    start = clock();
+    for (size_t i = 0; i < 2 * n; ++i)
+        found += hs_contains(hs, url(buf, i));
+    double t = elapsed_secs(start);
+    printf("hset:   %6.2f M lookups/s (%zu found)\n", 2 * n / t / 1e6, found);
+
+    found = 0;
+    start = clock();
+    for (size_t i = 0; i < 2 * n; ++i)
+        found += ahs_contains(ahs, url(buf, i));
+    t = elapsed_secs(start);
+    printf("ahset:  %6.2f M lookups/s (%zu found, false positive rate %.4f%%)\n",
+            2 * n / t / 1e6, found, 100.0 * (found - n) / n);
+
+    for (size_t i = 0; i < n; i += 2)
+        ahs_remove(ahs, url(buf, i));
+    found = 0;
+    for (size_t i = 0; i < n; ++i)
+        found += ahs_contains(ahs, url(buf, i));
+    printf("ahset:  %zu of the %zu remaining found after removing half\n", found, n - n / 2);
+
+    hs_destroy(hs);
+    ahs_destroy(ahs);
+}
@@ -0,0 +1,142 @@
+#define _POSIX_C_SOURCE 200809L /* nanosleep */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "ss_chmap.h"
+
+/*
+ * Lookup throughput of ss_chmap with 1, 2, 4.. reader threads, while a
+ * writer keeps inserting and deleting other keys (and the map keeps
+ * growing). The keys that are never deleted must always be found
+ */
+
+struct conn {
+    uint64_t id;
+    ss_chmap_entry_t link;
+    long bytes;
+};
+
+static int conn_cmp(void* a, void* b)
+{
+    return ((struct conn*) a)->id != ((struct conn*) b)->id;
+}
+
+static uint32_t conn_hash(uint64_t id)
+{
+    id ^= id >> 33;
+    id *= 0xff51afd7ed558ccdULL;
+    id ^= id >> 33;
+    return (uint32_t) id;
+}
+
+static void conn_init(struct conn* c, uint64_t id)
+{
+    c->id = id;
+    c->link.hashcode = conn_hash(id);
+    c->bytes = 0;
+}
+
+struct bench {
+    ss_chmap_t map;
+    size_t nstable;
+    struct conn* churn;
+    size_t nchurn;
+    int stop;
+};
+
+struct reader {
+    struct bench* b;
+    unsigned int seed;
+    size_t lookups;
+    size_t missed;
+};
+
+static void* reader_run(void* arg)
+{
+    struct reader* r = arg;
+    struct conn probe;
+    while (!__atomic_load_n(&r->b->stop, __ATOMIC_RELAXED)) {
+        for (int k = 0; k < 1024; ++k) {
+            r->seed = r->seed * 1103515245U + 12345U;
+            conn_init(&probe, r->seed % r->b->nstable);
+            if (!cht_get(&r->b->map, &probe.link))
+                r->missed++;
+        }
+        r->lookups += 1024;
+    }
+    return NULL;
+}
+
+/*
+ * Inserts the churn keys in rounds, deleting the ones of the previous
+ * round, so that the deleted objects are not reused right away
+ */
+static void* writer_run(void* arg)
+{
+    struct bench* b = arg;
+    size_t half = b->nchurn / 2;
+    for (unsigned int round = 0; !__atomic_load_n(&b->stop, __ATOMIC_RELAXED); ++round) {
+        struct conn* in = b->churn + (round & 1) * half;
+        struct conn* out = b->churn + !(round & 1) * half;
+        for (size_t i = 0; i < half; ++i) {
+            cht_put(&b->map, &in[i].link);
+            if (round > 0)
+                cht_delete(&b->map, &out[i].link);
+        }
+    }
+    return NULL;
+}
+
+#define MAX_READERS 8
+
+int main(int argc, char* argv[])
+{
+    struct bench b;
+    b.nstable = argc > 1 ? strtoul(argv[1], NULL, 10) : 500000;
+    b.nchurn = b.nstable; /* enough for the map to grow once more */
+    struct conn* stable = malloc(b.nstable * sizeof *stable);
+    b.churn = malloc(b.nchurn * sizeof *b.churn);
+    for (size_t i = 0; i < b.nchurn; ++i)
+        conn_init(b.churn + i, b.nstable + i);
+
+    for (int nreaders = 1; nreaders <= MAX_READERS; nreaders *= 2) {
+        /* Starting small: it grows while filled, and once more while the readers run */
+        cht_init(&b.map, 16, conn_cmp, offsetof(struct conn, link));
+        for (size_t i = 0; i < b.nstable; ++i) {
+            conn_init(stable + i, i);
+            cht_put(&b.map, &stable[i].link);
+        }
+        b.stop = 0;
+
+        pthread_t writer, readers[MAX_READERS];
+        struct reader r[MAX_READERS];
+        pthread_create(&writer, NULL, writer_run, &b);
+        for (int k = 0; k < nreaders; ++k) {
+            r[k] = (struct reader) {.b = &b, .seed = k + 1};
+            pthread_create(readers + k, NULL, reader_run, r + k);
+        }
+        struct timespec ts = {.tv_sec = 1};
+        nanosleep(&ts, NULL);
+        __atomic_store_n(&b.stop, 1, __ATOMIC_RELAXED);
+
+        size_t lookups = 0, missed = 0;
+        for (int k = 0; k < nreaders; ++k) {
+            pthread_join(readers[k], NULL);
+            lookups += r[k].lookups;
+            missed += r[k].missed;
+        }
+        pthread_join(writer, NULL);
+        printf("%d readers: %7.2f M lookups/s, %zu missed, %u keys\n",
+                nreaders, lookups / 1e6, missed, cht_size(&b.map));
+        cht_clear(&b.map);
+    }
+    free(stable);
+    free(b.churn);
+}
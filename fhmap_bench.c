@@ -0,0 +1,96 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "lch_hmap.h"
+#include "lch_fhmap.h"
+#include "hfn.h"
+
+/*
+ * Lookups in an lch_hmap against lookups in the frozen map built from
+ * it by ht_freeze, and a round trip of the frozen map through a file
+ */
+
+#define FHT_FILE "/tmp/fhmap_bench.fht"
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    char (*keys)[32] = malloc(2 * n * sizeof *keys);
+    for (size_t i = 0; i < 2 * n; ++i)
+        sprintf(keys[i], "user:%zu:session", i * 7919);
+    /* The first n are added, the rest are for misses */
+    lch_hmap_t* ht = ht_create(701, fnv32_hash);
+    for (size_t i = 0; i < n; ++i)
+        ht_put(ht, keys[i])->l = i;
+
+    double start = now_ms();
+    lch_fhmap_t* fht = ht_freeze(ht);
+    if (!fht)
+        return 1;
+    lch_fhmap_stats_t st = fht_stats(fht);
+    printf("frozen %u keys in %.1f ms: %u buckets, %.2f bits/key for the index, %.1f bytes/key in total\n",
+            st.nbr_elems, now_ms() - start, st.nbr_buckets,
+            st.index_bits_per_key, (double) st.bytes_total / n);
+
+    size_t* order = malloc(n * sizeof *order);
+    for (size_t i = 0; i < n; ++i)
+        order[i] = i;
+    srand(42);
+    for (size_t i = n - 1; i > 0; --i) {
+        size_t j = ((size_t) rand() * RAND_MAX + rand()) % (i + 1);
+        size_t t = order[i]; order[i] = order[j]; order[j] = t;
+    }
+
+    for (int miss = 0; miss <= 1; ++miss) {
+        const char (*k)[32] = (const char (*)[32]) keys + miss * n;
+        long sum1 = 0, sum2 = 0;
+        start = now_ms();
+        for (size_t i = 0; i < n; ++i) {
+            lch_value_t* v = ht_get(ht, k[order[i]]);
+            sum1 += v ? v->l + 1 : 0;
+        }
+        double t1 = now_ms() - start;
+        start = now_ms();
+        for (size_t i = 0; i < n; ++i) {
+            lch_value_t* v = fht_get(fht, k[order[i]]);
+            sum2 += v ? v->l + 1 : 0;
+        }
+        double t2 = now_ms() - start;
+        printf("%-6s lch_hmap %6.1f ns, frozen %6.1f ns%s\n", miss ? "misses" : "hits",
+                t1 * 1e6 / n, t2 * 1e6 / n, sum1 == sum2 ? "" : " (wrong results!)");
+    }
+
+    start = now_ms();
+    if (fht_save(fht, FHT_FILE) != 0)
+        return 1;
+    lch_fhmap_t* loaded = fht_load(FHT_FILE);
+    if (!loaded)
+        return 1;
+    size_t bad = 0;
+    for (size_t i = 0; i < 2 * n; ++i) {
+        lch_value_t* v = fht_get(loaded, keys[i]);
+        bad += i < n ? !v || v->l != (long) i : v != NULL;
+    }
+    printf("saved and loaded in %.1f ms, %zu wrong lookups after loading\n",
+            now_ms() - start, bad);
+    remove(FHT_FILE);
+
+    fht_destroy(loaded, NULL);
+    fht_destroy(fht, NULL);
+    ht_destroy(ht, NULL);
+    free(order);
+    free(keys);
+}
@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L /* getline */
+
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -8,8 +10,10 @@
 
 #include "lch_hmap.h"
 #include "hfn.h"
+#include "hset.h"
 
 #include "vec.h"
+#include "hll.h"
 
 #include <sys/resource.h>
 struct max_freq {
@@ -70,7 +74,11 @@ char* trim_str(char* s)
     return s;
 }
 
-vec_entry* parseFile(const char* fn)
+/*
+ * Reads the whole file in *text and splits it in words in place, so
+ * the words returned point into *text, which must be freed after them
+ */
+vec_entry* parseFile(const char* fn, char** text)
 {
     FILE* fp = fopen(fn, "r");
     if (!fp) {
@@ -80,38 +88,76 @@ vec_entry* parseFile(const char* fn)
     int s = 1000;
     vec_entry* lines = vec_create(s);
     float startTime = (float)clock()/CLOCKS_PER_SEC;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+    char* buf = malloc(size + 1);
+    if (!buf || fread(buf, 1, size, fp) != (size_t) size) {
+        perror("parseFile");
+        exit(-1);
+    }
+    buf[size] = '\0';
+
+    /* const char* sep = " \t\n\x0B\f\r\"'.,();!-:?&|^&"; */
+    const char* sep = " \t\n\x0B\f\r";
+    for (char* str = strtok(buf, sep); str ; str = strtok(NULL, sep)) {
+        vec_entry e;
+        e.p = str;
+        vec_append(&lines, e);
+    }
+    *text = buf;
+
+    float endTime = (float)clock()/CLOCKS_PER_SEC;
+    printf("Read %zu words in %.3f ms..\n", vec_length(lines), 1000*(endTime - startTime));
+    fclose(fp);
+    return lines;
+}
+
+
+/*
+ * Streams the words of the file in a HyperLogLog sketch, to count
+ * the distinct ones in constant memory
+ */
+void countApproximately(const char* fn)
+{
+    FILE* fp = fopen(fn, "r");
+    if (!fp) {
+        perror("countApproximately");
+        exit(-1);
+    }
+    hll_t* hll = hll_create(14);
+    float startTime = (float)clock()/CLOCKS_PER_SEC;
     char *word = NULL; 
     size_t linecap = 0;
     ssize_t len;
+    size_t n = 0;
 
     while ((len = getline(&word, &linecap, fp)) != -1) {
-        word[len-1] = '\0';
-        /* const char* sep = " \t\n\x0B\f\r\"'.,();!-:?&|^&"; */
         const char* sep = " \t\n\x0B\f\r";
         for (char* str = strtok(word, sep); str ; str = strtok(NULL, sep)) {
-            vec_entry e;
-            e.p = strdup(str);
-            vec_append(&lines, e);
+            hll_add(hll, str, strlen(str));
+            ++n;
         }
     }
     free(word);
-
-    float endTime = (float)clock()/CLOCKS_PER_SEC;
-    printf("Read %zu words in %.3f ms..\n", vec_length(lines), 1000*(endTime - startTime));
     fclose(fp);
-    return lines;
-}
 
-
-void free_entry(vec_entry v)
-{
-    free(v.p);
+    double count = hll_count(hll);
+    float endTime = (float)clock()/CLOCKS_PER_SEC;
+    printf("About %.0f distinct words in %zu (sketch of %zu bytes) in %.3f ms..\n",
+            count, n, hll_memory(hll), 1000*(endTime - startTime));
+    hll_destroy(hll);
 }
 
-
 int main(int argc, char* argv[])
 {
+    if (argc > 1 && strcmp(argv[1], "-a") == 0) {
+        countApproximately("book.txt");
+        return 0;
+    }
+
     lch_hfn hfn = fnv32_hash;
+    bool auto_hfn = argc > 1 && strcmp(argv[1], "auto") == 0;
     if (argc>1) {
         switch (atoi(argv[1])) {
             case 1:
@@ -143,26 +189,54 @@ int main(int argc, char* argv[])
         }
     }
 
-    vec_entry* lines = parseFile("book.txt");
+    char* text;
+    vec_entry* lines = parseFile("book.txt", &text);
 
-    lch_hmap_t* ht = ht_create(701, hfn);
+    lch_hmap_t* ht;
+    if (auto_hfn) {
+        /*
+         * Choose the hash function based on the first distinct words of
+         * the book: repeated keys would only spoil the score of every
+         * function alike
+         */
+        const size_t max_sample = 10000;
+        const char** sample = malloc(max_sample * sizeof *sample);
+        hset_t* seen = hs_create(max_sample);
+        size_t sample_len = 0;
+        for (size_t i = 0; i < vec_length(lines) && sample_len < max_sample; ++i) {
+            if (hs_add(seen, lines[i].p))
+                sample[sample_len++] = lines[i].p;
+        }
+        hs_destroy(seen);
+        float startTime = (float)clock()/CLOCKS_PER_SEC;
+        ht = ht_create_auto(701, sample, sample_len);
+        float endTime = (float)clock()/CLOCKS_PER_SEC;
+        printf("Selected hash function in %.3f ms (from %zu distinct words)..\n",
+                1000*(endTime - startTime), sample_len);
+        free(sample);
+    }
+    else
+        ht = ht_create(701, hfn);
+    /* The words stay in text till the end, so there's no need to copy them */
+    bool borrowed = ht_set_borrowed_keys(ht, true);
     float startTime = (float)clock()/CLOCKS_PER_SEC;
     int k, n = vec_length(lines);
     for(k = 0; k<n; ++k) {
         char* word = lines[k].p;
-        lch_value_t* e = ht_put(ht, word);
-        e->l++;
+        ht_increment(ht, word, strlen(word), 1);
     }
     float endTime = (float)clock()/CLOCKS_PER_SEC;
-    printf("Hashed %d words in %.3f ms..\n", k, 1000*(endTime - startTime));
+    printf("Hashed %d words in %.3f ms%s..\n", k, 1000*(endTime - startTime),
+            borrowed ? " (borrowed keys)" : "");
 
-    vec_free(&lines, free_entry);
+    vec_free(&lines, NULL);
 
     struct rusage usage;
     getrusage(RUSAGE_SELF, &usage);
 
     lch_hmap_stats_t stats = ht_stats(ht);
-    printf("Gen. %llu Size: %u (total: %u) Load: %4.2f max bucket size=%d RSS=%.3lf MB\n", 
+    printf("Hash fn: %s Gen. %llu Size: %u (total: %u) Load: %4.2f max bucket size=%d RSS=%.3lf MB\n", 
+            stats.hfn_name ? stats.hfn_name : "?",
             stats.generation,
             stats.nbr_elems, stats.capacity,
             ht_load_factor(ht),
@@ -187,5 +261,5 @@ int main(int argc, char* argv[])
     */
 
     ht_destroy(ht, NULL);
-
+    free(text);
 }
@@ -1,5 +1,9 @@
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
 #include "hfn.h"
 
 /**********************************************************
@@ -134,6 +138,21 @@ uint32_t fnv32_hash(const char *str, size_t len)
     return h;
 }
 
+uint64_t fnv64_hash(const char *str, size_t len)
+{
+    unsigned char *s = (unsigned char *)str;
+
+    const uint64_t FNV_64_PRIME = 0x100000001b3ULL;
+
+    uint64_t h = 0xcbf29ce484222325ULL;
+    while (len--) {
+        h ^= *s++;
+        h *= FNV_64_PRIME;
+    }
+
+    return h;
+}
+
 
 /*
  * "This came from ejb's hsearch."
@@ -189,3 +208,259 @@ uint32_t berkeley_hash(const char *s, size_t len)
     return h;
 }
 
+
+/*
+ * MurmurHash3's fmix32 and fmix64, see
+ * https://github.com/aappleby/smhasher/blob/master/src/MurmurHash3.cpp
+ */
+uint32_t fmix32(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+const hfn_info_t hfn_all[] = {
+    {"fnv32", fnv32_hash},
+    {"h31", h31_hash},
+    {"djb33", djb33_hash},
+    {"ejb", ejb_hash},
+    {"oat", oat_hash},
+    {"jen", jen_hash},
+    {"elf", elf_hash},
+    {"berkeley", berkeley_hash},
+    {NULL, NULL}
+};
+
+const char* hfn_name(lch_hfn fn)
+{
+    for (const hfn_info_t* f = hfn_all; f->name; ++f) {
+        if (f->fn == fn)
+            return f->name;
+    }
+    return NULL;
+}
+
+/*
+ * The "ideal" hash function metric from the Dragon book: the sum of
+ * b(b+1)/2 over all buckets, b being the bucket length, divided by
+ * its expected value for a uniformly random hash function
+ */
+static double _hfn_score(lch_hfn fn, const char** keys, const size_t* lens,
+        size_t n, uint32_t nbuckets, unsigned int* counts)
+{
+    double sum = 0;
+
+    memset(counts, 0, nbuckets * sizeof *counts);
+    for (size_t i = 0; i < n; ++i)
+        counts[fn(keys[i], lens[i]) % nbuckets]++;
+    for (uint32_t j = 0; j < nbuckets; ++j)
+        sum += counts[j] * (counts[j] + 1.0) / 2;
+    return sum / ((n / (2.0 * nbuckets)) * (n + 2.0 * nbuckets - 1));
+}
+
+static double _hfn_time(lch_hfn fn, const char** keys, const size_t* lens,
+        size_t n, unsigned int rounds)
+{
+    volatile uint32_t sink = 0;
+    clock_t start = clock();
+    for (unsigned int r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < n; ++i)
+            sink ^= fn(keys[i], lens[i]);
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+lch_hfn hfn_select(const char** keys, size_t n,
+        uint32_t nbuckets, double max_score)
+{
+    lch_hfn best = fnv32_hash, fastest = NULL;
+    double best_score = 0, fastest_time = 0;
+
+    if (n == 0 || nbuckets == 0)
+        return best;
+
+    size_t* lens = malloc(n * sizeof *lens);
+    unsigned int* counts = malloc(nbuckets * sizeof *counts);
+    if (!lens || !counts) {
+        perror("hfn_select");
+        free(lens);
+        free(counts);
+        return best;
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < n; ++i) {
+        lens[i] = strlen(keys[i]);
+        total += lens[i];
+    }
+    /* Hash a few MB in total so that clock() has something to measure */
+    unsigned int rounds = 1 + (4U << 20) / (total + n);
+
+    for (const hfn_info_t* f = hfn_all; f->name; ++f) {
+        double score = _hfn_score(f->fn, keys, lens, n, nbuckets, counts);
+        if (f == hfn_all || score < best_score) {
+            best = f->fn;
+            best_score = score;
+        }
+        if (score > max_score)
+            continue;
+        double t = _hfn_time(f->fn, keys, lens, n, rounds);
+        if (!fastest || t < fastest_time) {
+            fastest = f->fn;
+            fastest_time = t;
+        }
+    }
+    free(lens);
+    free(counts);
+    return fastest ? fastest : best;
+}
+
+
+/**********************************************************
+ *  Rolling hashes
+ *********************************************************/
+
+/*
+ * The random values for Buzhash and gear: a splitmix32 sequence from
+ * the seed 0x9e3779b9
+ */
+static const uint32_t _hfn_rand_table[256] = {
+    0x3cd6e3f3, 0x1b147dcc, 0x4c081dbf, 0x487981ab, 0xdb408c9d, 0x78bc1b8f,
+    0xd83072e5, 0x65cbdd54, 0x1f4b8cef, 0x91783bb0, 0x0231739b, 0x2aa96dd0,
+    0xb42bc0b0, 0x04e90bf5, 0xe2ad51ba, 0x79f70494, 0x010b6880, 0xa4523835,
+    0xceeb36b7, 0xd939ff68, 0xb18c6441, 0xdd507b42, 0x5db59265, 0x33469494,
+    0xa65d9b7a, 0x57dcb96b, 0x1b486183, 0xe411ddc1, 0x3e2cf241, 0x9e2ea24f,
+    0xb7fbe3e5, 0xa452933a, 0x1e712332, 0x52df2e19, 0x336bd315, 0x56d396d2,
+    0xf857a331, 0x4fe97da7, 0x9b972a46, 0x9d3e0d8a, 0xa6ece606, 0xc5c7990c,
+    0x17d886bf, 0x62ce7c21, 0x827e3843, 0xb9d7427c, 0x17891ea1, 0xd0f0e17a,
+    0x5139a741, 0xa3d32f02, 0xdb12a15c, 0x13b3abcf, 0x730c5f25, 0x1db71420,
+    0xf9435a88, 0x51ee6af8, 0xaf1ea67f, 0x71d9cb92, 0x3e2c1c4e, 0x1d6722cf,
+    0xf9d656f3, 0x2f16c17e, 0xf8262992, 0x8e0ce9df, 0xae71f440, 0x578ec0a1,
+    0xff95d72e, 0x09b28281, 0xaf7e56b5, 0x535a0944, 0xb7e2d8d3, 0xf5e7b311,
+    0x974b2094, 0xc73099c2, 0xb361d660, 0x171c8432, 0x7263cad3, 0xc661216e,
+    0xb1a0ebca, 0x6b48aa35, 0x6ed7a14a, 0xe1fef49f, 0x86a1c4e4, 0xf918b5f7,
+    0x8a927e91, 0xcb840f04, 0xeddfc8e4, 0xc6a57eea, 0x52fb3d10, 0xa57c5997,
+    0x2b1613bc, 0x8a6d276d, 0x0207f551, 0xe7a5e850, 0x13cea631, 0x1e8c037e,
+    0xf2ebe3a2, 0xee6e1ac7, 0x45516e65, 0xf23f1fc4, 0x40f455eb, 0xdc72791b,
+    0xfc0df56d, 0xb81049b8, 0x68f4a814, 0x7740174d, 0x8fd60c81, 0x59d7d340,
+    0xf20f0d94, 0xb28913b6, 0x5b53b292, 0x85f6b629, 0xf4e7d086, 0x8d4f664d,
+    0x5deac120, 0xe12de03b, 0x180e3ac5, 0x53b4b547, 0x95236d9e, 0xd640b398,
+    0x121a5de7, 0x00d4705e, 0xf3adade7, 0x394b58d3, 0x0846cd67, 0x263fc0dc,
+    0x7740d790, 0xea96dbee, 0xc9475489, 0xd59585de, 0x31a2aaed, 0x27ed7197,
+    0x5f277bb1, 0x99eb0bc5, 0xff2aae5c, 0xda5a360c, 0x0aa75661, 0x649cb1b3,
+    0x5efdad6b, 0xdd4f68d4, 0x86a72ca7, 0x4201f089, 0xc0cf4c58, 0x4111e2d2,
+    0x656db74e, 0x20c923ad, 0x0b1feae4, 0x11fc38af, 0x75c2de95, 0x46511ee8,
+    0x1051ab6b, 0x5124132d, 0xa2bcf41c, 0x780a25ca, 0xa77ab8ef, 0x7568dcf2,
+    0x0ae6d15b, 0xca78a349, 0xb44bd742, 0x7582df18, 0x5411a023, 0x5a24ec5c,
+    0x1b86acb9, 0xe3045cf5, 0xc3fce93e, 0x68e0e9d5, 0xb134a60d, 0x473ec5b6,
+    0xc7d4310f, 0x499ce9f2, 0xe4f07dfe, 0x78c0030c, 0xd80e4856, 0x679081d5,
+    0x294c18b2, 0xf46a4da8, 0x8d4bfdd5, 0x3ce18773, 0x164651b0, 0x50ecaf39,
+    0x7f54d75f, 0xe8fa74c9, 0x55f57765, 0xc1b3d479, 0xd78edfbb, 0xcee185e4,
+    0x8d3308c3, 0xdc5e7b20, 0x6f8bb72c, 0x3ba5ecfc, 0xaa3810b3, 0x8fe02fe6,
+    0x59ea6896, 0x77a409b3, 0xe4560ba4, 0x1a1ccf8f, 0x113886bf, 0xc60f5761,
+    0x91b9b088, 0x953a8f2e, 0xa7322d19, 0xed6b269a, 0x81e8abd6, 0x48ed2806,
+    0xfd3ccd9b, 0xbbb44b1f, 0x2c74ec81, 0x5e3a84fd, 0xb16f8d03, 0xdbb4ad77,
+    0xb8a3293b, 0x32128d44, 0x7e89cbbb, 0xe974d366, 0xeb40472b, 0x03896f70,
+    0x70194b8f, 0x1d26d9ca, 0x25ad6ab3, 0xfe6533b9, 0xd8791a20, 0x178c7126,
+    0xb6a76525, 0x70a25af9, 0xfc638b1d, 0xe09c6b34, 0x3ad8cc2f, 0xfebbf8f6,
+    0x1ba4ef3c, 0xa53929be, 0xfca7a6a6, 0x0b297e98, 0x1e85ea05, 0x87937090,
+    0x241a1419, 0xfc8e41d5, 0x7090c36b, 0xc6fc0abf, 0xecfa7355, 0xbcd89f9e,
+    0x41ccf740, 0x5b6ff5e4, 0xe6e7a8c8, 0xaea6365a, 0xc45b4b12, 0x0dc59e78,
+    0x46e44e4c, 0x2f04aeac, 0xa6f1d794, 0x8926bc2e, 0xff7450de, 0xed5bcf43,
+    0x4c7f81b9, 0x8987eb0e, 0x7970d887, 0xa63799a4,
+};
+
+#define _rotl32(x,r) (((x) << ((r) & 31)) | ((x) >> ((32 - ((r) & 31)) & 31)))
+
+int hfn_roll_init(hfn_roll_t* r, hfn_roll_kind kind, size_t window)
+{
+    r->kind = kind;
+    r->window = window ? window : 1;
+    r->buf = malloc(r->window);
+    if (!r->buf) {
+        perror("hfn_roll_init");
+        return -1;
+    }
+    if (kind == HFN_ROLL_RK) {
+        r->out_factor = 1;
+        for (size_t i = 1; i < r->window; ++i)
+            r->out_factor *= 31;
+    }
+    else {
+        r->out_factor = r->window % 32;
+    }
+    hfn_roll_reset(r);
+    return 0;
+}
+
+void hfn_roll_reset(hfn_roll_t* r)
+{
+    r->h = 0;
+    r->len = 0;
+    r->pos = 0;
+}
+
+void hfn_roll_free(hfn_roll_t* r)
+{
+    free(r->buf);
+    r->buf = NULL;
+}
+
+uint32_t hfn_roll_push(hfn_roll_t* r, char c)
+{
+    bool full = r->len >= r->window;
+    char out = r->buf[r->pos];
+
+    r->buf[r->pos] = c;
+    if (++r->pos == r->window)
+        r->pos = 0;
+    r->len++;
+    if (r->kind == HFN_ROLL_RK) {
+        /* Same arithmetic (and char promotion) as h31_hash */
+        if (full)
+            r->h -= r->out_factor * out;
+        r->h = 31 * r->h + c;
+    }
+    else {
+        r->h = _rotl32(r->h, 1) ^ _hfn_rand_table[(unsigned char) c];
+        if (full)
+            r->h ^= _rotl32(_hfn_rand_table[(unsigned char) out], r->out_factor);
+    }
+    return r->h;
+}
+
+size_t hfn_chunk(const char* buf, size_t len,
+        size_t min_size, size_t avg_size, size_t max_size)
+{
+    const uint32_t* gear = _hfn_rand_table;
+    const unsigned char* p = (const unsigned char*) buf;
+    /* The bits of the mask are the top ones, that depend on more bytes */
+    uint32_t mask = 0;
+    for (size_t a = avg_size; a > 1; a >>= 1)
+        mask = (mask >> 1) | 0x80000000U;
+    uint32_t h = 0;
+
+    if (len <= min_size)
+        return len;
+    if (len > max_size)
+        len = max_size;
+    for (size_t i = min_size; i < len; ++i) {
+        h = (h << 1) + gear[p[i]];
+        if ((h & mask) == 0)
+            return i + 1;
+    }
+    return len;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -36,6 +37,11 @@ extern "C"
 
 
 
+    /*
+     * The 64 bit FNV-1a hash
+     */
+    uint64_t fnv64_hash(const char *str, size_t len);
+
     /*
      * "This came from ejb's hsearch."
      */
@@ -53,6 +59,93 @@ extern "C"
 
     uint32_t berkeley_hash(const char *s, size_t len);
 
+    /*
+     * The finalizers of MurmurHash3 for 32 and 64 bit integers: bijections
+     * mixing every bit of the input into every bit of the output
+     */
+    uint32_t fmix32(uint32_t h);
+    uint64_t fmix64(uint64_t k);
+
+    /*
+     * All the hash functions above, by name, so that they can be
+     * chosen at runtime. The array is terminated by a {NULL, NULL} entry.
+     */
+    typedef struct {
+        const char* name;
+        lch_hfn fn;
+    } hfn_info_t;
+
+    extern const hfn_info_t hfn_all[];
+
+    /*
+     * Returns the name of the given hash function, or NULL if it
+     * is not one of hfn_all
+     */
+    const char* hfn_name(lch_hfn fn);
+
+    /*
+     * Picks a hash function for the given sample of (distinct) keys.
+     *
+     * Each of hfn_all is timed on the sample and the distribution of the
+     * sample into `nbuckets` buckets is scored, where 1.0 is what a truly
+     * random function would achieve and bigger is worse. The fastest
+     * function with a score up to `max_score` is returned, or the best
+     * distributing one if no function qualifies.
+     */
+    lch_hfn hfn_select(const char** keys, size_t n,
+            uint32_t nbuckets, double max_score);
+
+    /*
+     * Rolling hashes over a sliding window of the last `window` bytes,
+     * updated in O(1) per byte.
+     *
+     * HFN_ROLL_RK is the Rabin-Karp polynomial hash with base 31: once
+     * the window is full its value is equal to h31_hash() of the window,
+     * so it can be given to ht_get_hashed/ht_put_hashed of a map created
+     * with h31_hash.
+     * HFN_ROLL_BUZ is Buzhash (a cyclic polynomial over a table of random
+     * values), which mixes much better and suits fingerprinting.
+     */
+    typedef enum {
+        HFN_ROLL_RK,
+        HFN_ROLL_BUZ
+    } hfn_roll_kind;
+
+    typedef struct {
+        hfn_roll_kind kind;
+        uint32_t h;
+        uint32_t out_factor; /* 31^(window-1) for RK, window%32 for BUZ */
+        size_t window;
+        size_t len; /* bytes pushed so far */
+        size_t pos; /* where the next byte goes in buf */
+        char* buf; /* circular buffer with the bytes in the window */
+    } hfn_roll_t;
+
+    /* Returns 0 on success, -1 if the buffer cannot be allocated */
+    int hfn_roll_init(hfn_roll_t* r, hfn_roll_kind kind, size_t window);
+    void hfn_roll_reset(hfn_roll_t* r);
+    void hfn_roll_free(hfn_roll_t* r);
+
+    /*
+     * Appends a byte to the window, dropping the oldest one if the window
+     * is full, and returns the hash of the window
+     */
+    uint32_t hfn_roll_push(hfn_roll_t* r, char c);
+
+    #define hfn_roll_full(r) ((r)->len >= (r)->window)
+    #define hfn_roll_hash(r) ((r)->h)
+
+    /*
+     * Content defined chunking using the "gear" rolling hash: returns the
+     * length of the first chunk of buf, which is at least min_size and at
+     * most max_size bytes (or len, if smaller) and is avg_size (a power of
+     * two) bytes on average. Chunk boundaries depend only on the bytes
+     * around them, so an insertion in the input changes only the chunks
+     * near it.
+     */
+    size_t hfn_chunk(const char* buf, size_t len,
+            size_t min_size, size_t avg_size, size_t max_size);
+
 #ifdef __cplusplus
 }
 #endif
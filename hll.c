@@ -0,0 +1,240 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "hll.h"
+#include "hfn.h"
+
+/*
+ * While sparse, the registers that are set are kept as (index << 8 | rank)
+ * entries: a sorted part with unique indexes followed by the ones added
+ * since the last compaction.
+ */
+struct hll {
+    unsigned int p;
+    uint32_t m; /* number of registers, 2^p */
+    uint8_t* regs; /* the registers, NULL while sparse */
+    uint32_t* sparse;
+    uint32_t nsorted;
+    uint32_t nsparse;
+    uint32_t sparse_size;
+};
+
+#define hll_sparse_entry(idx,rank) (((idx) << 8) | (rank))
+#define hll_sparse_idx(e) ((e) >> 8)
+#define hll_sparse_rank(e) ((uint8_t) ((e) & 0xff))
+
+/*
+ * The first p bits of the hash give the register, and the rank is the
+ * position of the first 1 in the rest (the 1 put at bit p-1 stops the
+ * count in case they are all zeros)
+ */
+#define hll_index(h,x) ((uint32_t) ((x) >> (64 - (h)->p)))
+#define hll_rank(h,x) ((uint8_t) (__builtin_clzll(((x) << (h)->p) | (1ULL << ((h)->p - 1))) + 1))
+
+/* Going dense once the sparse entries would take half the registers' size */
+#define hll_sparse_max(h) ((h)->m / 8)
+
+hll_t* hll_create(unsigned int p)
+{
+    if (p < HLL_MIN_P || p > HLL_MAX_P)
+        return NULL;
+    hll_t* h = calloc(1U, sizeof *h);
+    if (!h) {
+        perror("hll_create");
+        return NULL;
+    }
+    h->p = p;
+    h->m = 1U << p;
+    return h;
+}
+
+void hll_destroy(hll_t* h)
+{
+    free(h->regs);
+    free(h->sparse);
+    free(h);
+}
+
+size_t hll_memory(hll_t* h)
+{
+    return sizeof *h + (h->regs ? h->m : h->sparse_size * sizeof *h->sparse);
+}
+
+static int _hll_cmp_entry(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Sorts the recently added sparse entries and merges them with the
+ * sorted ones, keeping the biggest rank of each register
+ */
+static void _hll_compact(hll_t* h)
+{
+    if (h->nsorted == h->nsparse)
+        return;
+    qsort(h->sparse, h->nsparse, sizeof *h->sparse, _hll_cmp_entry);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < h->nsparse; ++i) {
+        /* Equal indexes are sorted by rank, so the last one wins */
+        if (n > 0 && hll_sparse_idx(h->sparse[n-1]) == hll_sparse_idx(h->sparse[i]))
+            h->sparse[n-1] = h->sparse[i];
+        else
+            h->sparse[n++] = h->sparse[i];
+    }
+    h->nsorted = h->nsparse = n;
+}
+
+static int _hll_to_dense(hll_t* h)
+{
+    uint8_t* regs = calloc(h->m, 1);
+    if (!regs) {
+        perror("_hll_to_dense");
+        return -1;
+    }
+    for (uint32_t i = 0; i < h->nsparse; ++i) {
+        uint32_t idx = hll_sparse_idx(h->sparse[i]);
+        uint8_t rank = hll_sparse_rank(h->sparse[i]);
+        if (rank > regs[idx])
+            regs[idx] = rank;
+    }
+    free(h->sparse);
+    h->sparse = NULL;
+    h->nsorted = h->nsparse = h->sparse_size = 0;
+    h->regs = regs;
+    return 0;
+}
+
+static int _hll_sparse_add(hll_t* h, uint32_t idx, uint8_t rank)
+{
+    if (h->nsparse == h->sparse_size) {
+        _hll_compact(h);
+        if (h->nsparse >= hll_sparse_max(h))
+            return _hll_to_dense(h);
+        if (h->nsparse == h->sparse_size) {
+            uint32_t size = h->sparse_size ? 2 * h->sparse_size : 16;
+            uint32_t* sparse = realloc(h->sparse, size * sizeof *sparse);
+            if (!sparse) {
+                perror("_hll_sparse_add");
+                return -1;
+            }
+            h->sparse = sparse;
+            h->sparse_size = size;
+        }
+    }
+    h->sparse[h->nsparse++] = hll_sparse_entry(idx, rank);
+    return 0;
+}
+
+static inline void _hll_set(hll_t* h, uint32_t idx, uint8_t rank)
+{
+    if (h->regs) {
+        if (rank > h->regs[idx])
+            h->regs[idx] = rank;
+    }
+    else if (_hll_sparse_add(h, idx, rank) == 0 && h->regs) {
+        /* Just went dense */
+        if (rank > h->regs[idx])
+            h->regs[idx] = rank;
+    }
+}
+
+void hll_add_hash(hll_t* h, uint64_t hash)
+{
+    _hll_set(h, hll_index(h, hash), hll_rank(h, hash));
+}
+
+void hll_add(hll_t* h, const char* key, size_t len)
+{
+    hll_add_hash(h, fmix64(fnv64_hash(key, len)));
+}
+
+#define HLL_BATCH 256
+
+void hll_add_hashes(hll_t* h, const uint64_t* hashes, size_t n)
+{
+    uint32_t idx[HLL_BATCH];
+    uint8_t rank[HLL_BATCH];
+
+    while (n > 0) {
+        size_t k = n < HLL_BATCH ? n : HLL_BATCH;
+        /* No branches and no memory dependencies: vectorizable */
+        for (size_t i = 0; i < k; ++i) {
+            idx[i] = hll_index(h, hashes[i]);
+            rank[i] = hll_rank(h, hashes[i]);
+        }
+        if (h->regs) {
+            uint8_t* regs = h->regs;
+            for (size_t i = 0; i < k; ++i) {
+                uint8_t r = regs[idx[i]];
+                regs[idx[i]] = rank[i] > r ? rank[i] : r;
+            }
+        }
+        else {
+            for (size_t i = 0; i < k; ++i)
+                _hll_set(h, idx[i], rank[i]);
+        }
+        hashes += k;
+        n -= k;
+    }
+}
+
+int hll_merge(hll_t* dst, hll_t* src)
+{
+    if (dst->p != src->p)
+        return -1;
+    if (!src->regs) {
+        for (uint32_t i = 0; i < src->nsparse; ++i)
+            _hll_set(dst, hll_sparse_idx(src->sparse[i]), hll_sparse_rank(src->sparse[i]));
+        return 0;
+    }
+    if (!dst->regs) {
+        _hll_compact(dst);
+        if (_hll_to_dense(dst) < 0)
+            return -1;
+    }
+    /* Byte-wise max of the two arrays, that compilers vectorize */
+    uint8_t* restrict d = dst->regs;
+    const uint8_t* restrict s = src->regs;
+    for (uint32_t i = 0; i < dst->m; ++i)
+        d[i] = s[i] > d[i] ? s[i] : d[i];
+    return 0;
+}
+
+double hll_count(hll_t* h)
+{
+    double m = h->m;
+    double sum = 0;
+    uint32_t zeros = 0;
+
+    if (h->regs) {
+        for (uint32_t i = 0; i < h->m; ++i) {
+            sum += ldexp(1.0, -h->regs[i]);
+            zeros += h->regs[i] == 0;
+        }
+    }
+    else {
+        _hll_compact(h);
+        zeros = h->m - h->nsparse;
+        sum = zeros;
+        for (uint32_t i = 0; i < h->nsparse; ++i)
+            sum += ldexp(1.0, -hll_sparse_rank(h->sparse[i]));
+    }
+
+    double alpha;
+    switch (h->m) {
+        case 16: alpha = 0.673; break;
+        case 32: alpha = 0.697; break;
+        case 64: alpha = 0.709; break;
+        default: alpha = 0.7213 / (1 + 1.079 / m); break;
+    }
+    double e = alpha * m * m / sum;
+    /* Small range correction: linear counting */
+    if (e <= 2.5 * m && zeros > 0)
+        e = m * log(m / zeros);
+    return e;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+    /*
+     * HyperLogLog: estimates the number of distinct keys seen, in
+     * constant memory, see
+     * "HyperLogLog: the analysis of a near-optimal cardinality estimation
+     * algorithm", Flajolet et al. 2007
+     *
+     * With 2^p registers the standard error is about 1.04/sqrt(2^p),
+     * e.g. 0.8% for p=14, which takes 16KB. Until enough distinct keys
+     * are seen only the registers that are set are kept ("sparse"), so
+     * small sketches take much less.
+     */
+    typedef struct hll hll_t;
+
+    #define HLL_MIN_P 4
+    #define HLL_MAX_P 18
+
+    hll_t* hll_create(unsigned int p);
+    void hll_destroy(hll_t* h);
+
+    /* Adds a key, hashed with fnv64_hash of hfn.h */
+    void hll_add(hll_t* h, const char* key, size_t len);
+
+    /*
+     * Adds a (well mixed) 64 bit hash. hll_add_hashes is faster for
+     * many hashes at once
+     */
+    void hll_add_hash(hll_t* h, uint64_t hash);
+    void hll_add_hashes(hll_t* h, const uint64_t* hashes, size_t n);
+
+    /*
+     * Adds the keys seen by src to dst, e.g. to combine the sketches of
+     * different threads. Both must have the same p. Returns -1 if they
+     * do not or if memory runs out.
+     */
+    int hll_merge(hll_t* dst, hll_t* src);
+
+    /* The estimated number of distinct keys */
+    double hll_count(hll_t* h);
+
+    /* Returns the number of bytes allocated for the sketch */
+    size_t hll_memory(hll_t* h);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,28 +1,434 @@
+#include <stdint.h>
 #include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
 #include "hset.h"
-#include "lch_hmap.h"
 #include "hfn.h"
 
+/*
+ * A slot of the table: the cached hash of the key and the offset of the
+ * key in the arena, plus one, so that a zeroed slot is an empty one
+ */
+typedef struct {
+    uint32_t hash;
+    uint32_t key;
+} hset_slot_t;
+
+#define HS_EMPTY 0U
+#define HS_DELETED UINT32_MAX
+#define hs_slot_used(s) ((s)->key != HS_EMPTY && (s)->key != HS_DELETED)
+
+struct hset {
+    hset_slot_t* table;
+    uint32_t size; /* number of slots, a power of two */
+    uint32_t n; /* number of members */
+    uint32_t deleted; /* number of HS_DELETED slots */
+    char* arena; /* the keys, NUL terminated */
+    size_t arena_len;
+    size_t arena_size;
+    size_t arena_dead; /* bytes of removed keys */
+};
+
+#define HS_HFN fnv32_hash
+#define HS_MIN_SIZE 8U
+#define hs_key(h,s) ((h)->arena + (s)->key - 1)
+
+/*
+ * The low bits of the hashes in hfn.h are not very random, so they
+ * are mixed before being used as a slot index
+ */
+#define hs_home_slot(h,hash) (fmix32(hash) & ((h)->size - 1))
+
+static uint32_t _hs_size_for(uint32_t n)
+{
+    uint32_t size = HS_MIN_SIZE;
+    while (size < n && size < (1U << 31))
+        size <<= 1;
+    return size;
+}
 
 hset_t* hs_create(uint32_t initialCapasity)
 {
-    return ht_create(initialCapasity, h31_hash);
+    hset_t* h = calloc(1U, sizeof *h);
+    if (!h) {
+        perror("hs_create");
+        return NULL;
+    }
+    h->size = _hs_size_for(initialCapasity);
+    h->table = calloc(h->size, sizeof *h->table);
+    if (!h->table) {
+        perror("hs_create");
+        free(h);
+        return NULL;
+    }
+    return h;
 }
 
-void hs_add(hset_t* h, const char* key)
+void hs_destroy(hset_t* h)
 {
-    ht_put(h, key);
+    free(h->table);
+    free(h->arena);
+    free(h);
 }
+
+size_t hs_size(hset_t* h)
+{
+    return h->n;
+}
+
+size_t hs_memory(hset_t* h)
+{
+    return sizeof *h + h->size * sizeof *h->table + h->arena_size;
+}
+
+static hset_slot_t* _hs_find(hset_t* h, const char* key, size_t len, uint32_t hash)
+{
+    uint32_t mask = h->size - 1;
+    for (uint32_t i = hs_home_slot(h, hash); ; i = (i + 1) & mask) {
+        hset_slot_t* s = h->table + i;
+        if (s->key == HS_EMPTY)
+            return NULL;
+        if (s->key != HS_DELETED && s->hash == hash
+                && strncmp(hs_key(h, s), key, len) == 0 && hs_key(h, s)[len] == '\0')
+            return s;
+    }
+}
+
+/*
+ * Rebuilds the table in a new one of `size` slots, dropping the deleted
+ * slots and the bytes of the removed keys from the arena
+ */
+static int _hs_rehash(hset_t* h, uint32_t size)
+{
+    hset_slot_t* table = calloc(size, sizeof *table);
+    char* arena = NULL;
+    size_t arena_size = h->arena_len - h->arena_dead;
+
+    if (!table || (arena_size > 0 && !(arena = malloc(arena_size)))) {
+        perror("_hs_rehash");
+        free(table);
+        return -1;
+    }
+    size_t arena_len = 0;
+    for (hset_slot_t* s = h->table; s != h->table + h->size; ++s) {
+        if (!hs_slot_used(s))
+            continue;
+        uint32_t i = fmix32(s->hash) & (size - 1);
+        while (table[i].key != HS_EMPTY)
+            i = (i + 1) & (size - 1);
+        size_t len = strlen(hs_key(h, s)) + 1;
+        memcpy(arena + arena_len, hs_key(h, s), len);
+        table[i].hash = s->hash;
+        table[i].key = arena_len + 1;
+        arena_len += len;
+    }
+    free(h->table);
+    free(h->arena);
+    h->table = table;
+    h->size = size;
+    h->deleted = 0;
+    h->arena = arena;
+    h->arena_len = h->arena_size = arena_len;
+    h->arena_dead = 0;
+    return 0;
+}
+
+/* Returns 1 if the key was added, 0 if it was there already and -1 on error */
+static int _hs_add(hset_t* h, const char* key, size_t len, uint32_t hash)
+{
+    if (_hs_find(h, key, len, hash))
+        return 0;
+
+    if (h->n + h->deleted + 1 > (3 * h->size >> 2)) { /* Use the 0.75 factor */
+        /* Grow, unless it's mostly the deleted slots that fill the table */
+        uint32_t size = h->n + 1 > (3 * h->size >> 3) ? 2 * h->size : h->size;
+        if (_hs_rehash(h, size) < 0)
+            return -1;
+    }
+    if (h->arena_len + len + 1 > h->arena_size) {
+        size_t arena_size = h->arena_size ? 2 * h->arena_size : 1024;
+        while (arena_size < h->arena_len + len + 1)
+            arena_size *= 2;
+        if (arena_size >= HS_DELETED) {
+            /* The offsets of the keys are 32 bits */
+            errno = ENOMEM;
+            return -1;
+        }
+        char* arena = realloc(h->arena, arena_size);
+        if (!arena) {
+            perror("hs_add");
+            return -1;
+        }
+        h->arena = arena;
+        h->arena_size = arena_size;
+    }
+
+    uint32_t mask = h->size - 1;
+    uint32_t i;
+    for (i = hs_home_slot(h, hash); hs_slot_used(h->table + i); i = (i + 1) & mask);
+    hset_slot_t* s = h->table + i;
+    if (s->key == HS_DELETED)
+        h->deleted--;
+    s->hash = hash;
+    s->key = h->arena_len + 1;
+    memcpy(h->arena + h->arena_len, key, len);
+    h->arena[h->arena_len + len] = '\0';
+    h->arena_len += len + 1;
+    h->n++;
+    return 1;
+}
+
+bool hs_add(hset_t* h, const char* key)
+{
+    size_t len = strlen(key);
+    return _hs_add(h, key, len, HS_HFN(key, len)) > 0;
+}
+
+bool hs_contains(hset_t* h, const char* key)
+{
+    size_t len = strlen(key);
+    return _hs_find(h, key, len, HS_HFN(key, len)) != NULL;
+}
+
 void hs_remove(hset_t* h, const char* key)
 {
-    ht_delete(h, key);
+    size_t len = strlen(key);
+    hset_slot_t* s = _hs_find(h, key, len, HS_HFN(key, len));
+    if (!s)
+        return;
+    s->key = HS_DELETED;
+    h->arena_dead += len + 1;
+    h->deleted++;
+    h->n--;
 }
-size_t hs_size(hset_t* h)
+
+void hs_traverse(hset_t* h, int (*action) (const char*, void*), void* arg)
 {
-    return ht_stats(h).nbr_elems;
+    for (hset_slot_t* s = h->table; s != h->table + h->size; ++s) {
+        if (hs_slot_used(s) && action(hs_key(h, s), arg) < 0)
+            return;
+    }
 }
-void hs_destroy(hset_t* h)
+
+
+/**********************************************************
+ *  Set algebra
+ *********************************************************/
+
+/* Finds a member of another set, by its key and cached hash */
+static hset_slot_t* _hs_find_member(hset_t* h, hset_t* other, hset_slot_t* s)
+{
+    const char* key = hs_key(other, s);
+    uint32_t mask = h->size - 1;
+    for (uint32_t i = hs_home_slot(h, s->hash); ; i = (i + 1) & mask) {
+        hset_slot_t* t = h->table + i;
+        if (t->key == HS_EMPTY)
+            return NULL;
+        if (t->key != HS_DELETED && t->hash == s->hash && strcmp(hs_key(h, t), key) == 0)
+            return t;
+    }
+}
+
+/* Makes room in h for `more` members without rehashing */
+static int _hs_reserve(hset_t* h, size_t more)
+{
+    size_t n = h->n + more;
+    if (n + h->deleted <= (3 * (size_t) h->size >> 2))
+        return 0;
+    if (n > (3U << 29)) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return _hs_rehash(h, _hs_size_for(4 * n / 3 + 1));
+}
+
+/*
+ * A scan of a range of the table of `x` for the members that are (or
+ * are not, according to `want`) also in `y`
+ */
+typedef struct {
+    hset_t* x;
+    hset_t* y;
+    bool want;
+    bool first_only; /* stop at the first one found */
+    int* stop; /* set when a scan with first_only finds one */
+    uint32_t from, to;
+    uint32_t* found; /* indexes of the slots of x */
+    size_t nfound;
+    int err;
+} hs_scan_t;
+
+static void* _hs_scan(void* arg)
 {
-    ht_destroy(h, NULL);
+    hs_scan_t* sc = arg;
+    size_t cap = 0;
+    for (uint32_t i = sc->from; i < sc->to; ++i) {
+        /* Another scan found one already */
+        if (sc->stop && (i & 1023) == 0 && __atomic_load_n(sc->stop, __ATOMIC_RELAXED))
+            break;
+        hset_slot_t* s = sc->x->table + i;
+        if (!hs_slot_used(s) || (_hs_find_member(sc->y, sc->x, s) != NULL) != sc->want)
+            continue;
+        if (sc->first_only) {
+            sc->nfound = 1;
+            __atomic_store_n(sc->stop, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        if (sc->nfound == cap) {
+            cap = cap ? 2 * cap : 1024;
+            uint32_t* found = realloc(sc->found, cap * sizeof *found);
+            if (!found) {
+                sc->err = -1;
+                break;
+            }
+            sc->found = found;
+        }
+        sc->found[sc->nfound++] = i;
+    }
+    return NULL;
 }
 
+#define HS_MAX_THREADS 64
+
+/*
+ * Runs the scan for the whole table of x, in nthreads threads, and
+ * calls `add` for each slot found. Returns the number of slots found
+ * (or whether one was found, if first_only), or -1 on error.
+ */
+static long _hs_filter(hset_t* x, hset_t* y, bool want, bool first_only, int nthreads,
+        int (*add)(hset_t* dst, hset_t* x, hset_slot_t* s), hset_t* dst)
+{
+    hs_scan_t scans[HS_MAX_THREADS];
+    pthread_t threads[HS_MAX_THREADS];
+    int stop = 0;
+    long total = 0;
+    int err = 0;
+
+    if (nthreads < 1)
+        nthreads = 1;
+    if (nthreads > HS_MAX_THREADS)
+        nthreads = HS_MAX_THREADS;
+    if (x->size < 1024U * nthreads)
+        nthreads = 1;
+
+    uint32_t chunk = x->size / nthreads;
+    for (int t = 0; t < nthreads; ++t) {
+        hs_scan_t* sc = scans + t;
+        memset(sc, 0, sizeof *sc);
+        sc->x = x;
+        sc->y = y;
+        sc->want = want;
+        sc->first_only = first_only;
+        sc->stop = first_only ? &stop : NULL;
+        sc->from = t * chunk;
+        sc->to = t == nthreads - 1 ? x->size : (t + 1) * chunk;
+    }
+    if (nthreads == 1)
+        _hs_scan(scans);
+    else {
+        int started;
+        for (started = 0; started < nthreads; ++started) {
+            if (pthread_create(threads + started, NULL, _hs_scan, scans + started) != 0) {
+                perror("_hs_filter");
+                break;
+            }
+        }
+        /* Whatever could not get a thread is done here */
+        for (int t = started; t < nthreads; ++t)
+            _hs_scan(scans + t);
+        for (int t = 0; t < started; ++t)
+            pthread_join(threads[t], NULL);
+    }
+
+    for (int t = 0; t < nthreads; ++t) {
+        hs_scan_t* sc = scans + t;
+        if (sc->err)
+            err = -1;
+        for (size_t i = 0; add && !err && i < sc->nfound; ++i) {
+            if (add(dst, x, x->table + sc->found[i]) < 0)
+                err = -1;
+        }
+        total += sc->nfound;
+        free(sc->found);
+    }
+    return err ? -1 : total;
+}
+
+static int _hs_add_member(hset_t* dst, hset_t* x, hset_slot_t* s)
+{
+    const char* key = hs_key(x, s);
+    return _hs_add(dst, key, strlen(key), s->hash) < 0 ? -1 : 0;
+}
+
+static int _hs_remove_member(hset_t* dst, hset_t* x, hset_slot_t* s)
+{
+    hset_slot_t* t = _hs_find_member(dst, x, s);
+    if (t) {
+        t->key = HS_DELETED;
+        dst->arena_dead += strlen(hs_key(x, s)) + 1;
+        dst->deleted++;
+        dst->n--;
+    }
+    return 0;
+}
+
+static int _hs_add_all(hset_t* dst, hset_t* x)
+{
+    for (hset_slot_t* s = x->table; s != x->table + x->size; ++s) {
+        if (hs_slot_used(s) && _hs_add_member(dst, x, s) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int hs_union(hset_t* dst, hset_t* a, hset_t* b, int nthreads)
+{
+    if (a->n < b->n) {
+        hset_t* t = a;
+        a = b;
+        b = t;
+    }
+    if (_hs_reserve(dst, a->n + b->n) < 0 || _hs_add_all(dst, a) < 0)
+        return -1;
+    return _hs_filter(b, a, false, false, nthreads, _hs_add_member, dst) < 0 ? -1 : 0;
+}
+
+int hs_intersect(hset_t* dst, hset_t* a, hset_t* b, int nthreads)
+{
+    if (a->n > b->n) {
+        hset_t* t = a;
+        a = b;
+        b = t;
+    }
+    if (_hs_reserve(dst, a->n) < 0)
+        return -1;
+    return _hs_filter(a, b, true, false, nthreads, _hs_add_member, dst) < 0 ? -1 : 0;
+}
+
+int hs_difference(hset_t* dst, hset_t* a, hset_t* b, int nthreads)
+{
+    if (_hs_reserve(dst, a->n) < 0)
+        return -1;
+    if (a->n <= b->n)
+        return _hs_filter(a, b, false, false, nthreads, _hs_add_member, dst) < 0 ? -1 : 0;
+    /*
+     * b is the smaller one: find which of its members are in a, and
+     * remove them from a copy of a (assuming dst had none of them)
+     */
+    if (dst->n == 0) {
+        if (_hs_add_all(dst, a) < 0)
+            return -1;
+        return _hs_filter(b, a, true, false, nthreads, _hs_remove_member, dst) < 0 ? -1 : 0;
+    }
+    return _hs_filter(a, b, false, false, nthreads, _hs_add_member, dst) < 0 ? -1 : 0;
+}
+
+bool hs_is_subset(hset_t* a, hset_t* b, int nthreads)
+{
+    if (a->n > b->n)
+        return false;
+    return _hs_filter(a, b, false, true, nthreads, NULL, NULL) == 0;
+}
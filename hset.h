@@ -5,16 +5,61 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdbool.h>
 
-    typedef struct lch_hmap hset_t;
+    /*
+     * A set of C strings.
+     *
+     * Members are kept in an open addressing table of (hash, key offset)
+     * pairs, with the keys themselves packed one after the other in a
+     * single string arena.
+     */
+    typedef struct hset hset_t;
 
     hset_t* hs_create(uint32_t initialCapasity);
-    void hs_add(hset_t* h, const char* key);
+
+    /*
+     * Adds the key in the set, returning true if it was not there
+     * already
+     */
+    bool hs_add(hset_t* h, const char* key);
+    bool hs_contains(hset_t* h, const char* key);
     void hs_remove(hset_t* h, const char* key);
     size_t hs_size(hset_t* h);
+
+    /*
+     * Returns the number of bytes allocated for the set
+     */
+    size_t hs_memory(hset_t* h);
+
+    /*
+     * Calls action for each member of the set, stopping if it
+     * returns a negative number. The set should not be modified
+     * by the action.
+     */
+    void hs_traverse(hset_t* h, int (*action) (const char*, void*), void* arg);
+
     void hs_destroy(hset_t* h);
 
+    /*
+     * Set algebra. The result is added to dst, which must be a different
+     * set than a and b and is grown in advance to fit the result. The
+     * cached hashes are used, so no key is hashed again.
+     *
+     * The membership tests are made for the members of the smaller set
+     * (if possible) and, if nthreads > 1, split in that many threads each
+     * scanning a range of the set's table.
+     *
+     * They return 0 on success and -1 if memory runs out.
+     */
+    int hs_union(hset_t* dst, hset_t* a, hset_t* b, int nthreads);
+    int hs_intersect(hset_t* dst, hset_t* a, hset_t* b, int nthreads);
+    /* a - b */
+    int hs_difference(hset_t* dst, hset_t* a, hset_t* b, int nthreads);
+    /* Is a a subset of b? */
+    bool hs_is_subset(hset_t* a, hset_t* b, int nthreads);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include "hset.h"
+
+static int failed = 0;
+
+static void check(const char* what, bool ok)
+{
+    printf("%-40s %s\n", what, ok ? "ok" : "wrong!");
+    if (!ok)
+        failed++;
+}
+
+/* The keys "k<i>" for i in [from, to) */
+static hset_t* range(int from, int to)
+{
+    char key[32];
+    hset_t* h = hs_create(16);
+    for (int i = from; i < to; ++i) {
+        sprintf(key, "k%d", i);
+        hs_add(h, key);
+    }
+    return h;
+}
+
+/* Are the members of h exactly the keys of [from, to)? */
+static bool is_range(hset_t* h, int from, int to)
+{
+    char key[32];
+    for (int i = from; i < to; ++i) {
+        sprintf(key, "k%d", i);
+        if (!hs_contains(h, key))
+            return false;
+    }
+    return hs_size(h) == (size_t) (to - from);
+}
+
+static void test(int n, int nthreads)
+{
+    /* a = [0, 2n), b = [n, 3n) */
+    hset_t* a = range(0, 2*n);
+    hset_t* b = range(n, 3*n);
+    hset_t* c = range(n, 2*n);
+
+    printf("%d keys, %d threads:\n", n, nthreads);
+    hset_t* u = hs_create(16);
+    check("  union", hs_union(u, a, b, nthreads) == 0 && is_range(u, 0, 3*n));
+    hset_t* i = hs_create(16);
+    check("  intersection", hs_intersect(i, a, b, nthreads) == 0 && is_range(i, n, 2*n));
+    hset_t* d = hs_create(16);
+    check("  difference", hs_difference(d, a, b, nthreads) == 0 && is_range(d, 0, n));
+    check("  subset", hs_is_subset(c, a, nthreads) && hs_is_subset(c, b, nthreads)
+            && hs_is_subset(i, u, nthreads));
+    check("  not subset", !hs_is_subset(a, b, nthreads) && !hs_is_subset(u, a, nthreads)
+            && !hs_is_subset(d, b, nthreads));
+
+    hs_destroy(a);
+    hs_destroy(b);
+    hs_destroy(c);
+    hs_destroy(u);
+    hs_destroy(i);
+    hs_destroy(d);
+}
+
+int main()
+{
+    test(10, 1);
+    test(100000, 1);
+    test(100000, 4);
+    return failed;
+}
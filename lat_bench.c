@@ -0,0 +1,86 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "lch_hmap.h"
+#include "hfn.h"
+
+/*
+ * The latency distribution of single lookups, hits and misses, for
+ * whichever implementation of lch_hmap.h it is linked with: the tail
+ * (p99.9 and the max) is what a latency critical service sees
+ */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char* what, uint32_t* lat, size_t n, double avg)
+{
+    qsort(lat, n, sizeof *lat, cmp_u32);
+    printf("%-6s avg %6.1f ns  p50 %5u  p99 %5u  p99.9 %6u  p99.99 %6u  max %7u ns\n",
+            what, avg, lat[n / 2], lat[n * 99 / 100], lat[n * 999 / 1000],
+            lat[n * 9999 / 10000], lat[n - 1]);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    char (*keys)[32] = malloc(2 * n * sizeof *keys);
+    for (size_t i = 0; i < 2 * n; ++i)
+        sprintf(keys[i], "user:%zu:session", i * 7919);
+    /* The first n are added, the rest are for misses */
+    lch_hmap_t* ht = ht_create(701, fnv32_hash);
+    for (size_t i = 0; i < n; ++i)
+        ht_put(ht, keys[i])->l = i;
+    lch_hmap_stats_t st = ht_stats(ht);
+    printf("%u keys, capacity %u, max bucket size %u\n",
+            st.nbr_elems, st.capacity, st.max_bucket_size);
+
+    /* A random order, so that the caches do not help */
+    size_t* order = malloc(n * sizeof *order);
+    for (size_t i = 0; i < n; ++i)
+        order[i] = i;
+    srand(42);
+    for (size_t i = n - 1; i > 0; --i) {
+        size_t j = ((size_t) rand() * RAND_MAX + rand()) % (i + 1);
+        size_t t = order[i]; order[i] = order[j]; order[j] = t;
+    }
+
+    uint32_t* lat = malloc(n * sizeof *lat);
+    for (int miss = 0; miss <= 1; ++miss) {
+        const char (*k)[32] = (const char (*)[32]) keys + miss * n;
+        long found = 0;
+        uint64_t start = now_ns();
+        for (size_t i = 0; i < n; ++i)
+            found += ht_get(ht, k[order[i]]) != NULL;
+        double avg = (double) (now_ns() - start) / n;
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t t0 = now_ns();
+            found += ht_get(ht, k[order[i]]) != NULL;
+            lat[i] = now_ns() - t0;
+        }
+        report(miss ? "misses" : "hits", lat, n, avg);
+        if (found != (miss ? 0 : 2 * (long) n))
+            printf("wrong results!\n");
+    }
+
+    ht_destroy(ht, NULL);
+    free(lat);
+    free(order);
+    free(keys);
+}
@@ -0,0 +1,467 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include "lch_fhmap.h"
+#include "hfn.h"
+
+#define FHT_MAGIC 0x46485431U /* "FHT1" */
+#define FHT_KEYS_PER_BUCKET 6
+#define FHT_MAX_PILOT 0xFFFFU
+#define FHT_MAX_SEEDS 16
+
+#define FHT_ALIGN(x) (((x) + 7) & ~(uint64_t) 7)
+
+/*
+ * The start of the map. The arrays follow it in the same block and are
+ * found by their offset from its start
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t n; /* number of keys */
+    uint32_t m; /* number of slots: n plus a few spare ones */
+    uint32_t nbuckets;
+    uint64_t seed;
+    uint64_t size; /* of the whole block, in bytes */
+    uint64_t pilots; /* uint16_t per bucket */
+    uint64_t remap; /* uint32_t per slot >= n: the free slot < n it stands for */
+    uint64_t vals; /* lch_value_t per slot < n */
+    uint64_t keys; /* uint32_t per slot < n: where its key is in the blob */
+    uint64_t blob; /* the keys, NUL terminated, one after the other */
+} fht_header_t;
+
+struct lch_fhmap {
+    fht_header_t* hdr;
+    const uint16_t* pilots;
+    const uint32_t* remap;
+    lch_value_t* vals;
+    const uint32_t* keys;
+    const char* blob;
+};
+
+#define fastrange32(x,n) ((uint32_t) (((uint64_t) (uint32_t) (x) * (n)) >> 32))
+
+/* A seeded FNV-1a, finalized so that all of its 64 bits are usable */
+static inline uint64_t _fht_hash(const char* s, size_t len, uint64_t seed)
+{
+    const unsigned char* p = (const unsigned char*) s;
+    uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+    while (len--) {
+        h ^= *p++;
+        h *= 0x100000001b3ULL;
+    }
+    return fmix64(h);
+}
+
+/*
+ * As in PTHash, 60% of the keys go to the first 30% of the buckets:
+ * the bigger buckets are placed first, while most slots are free
+ */
+static inline uint32_t _fht_bucket(uint64_t h, uint32_t nbuckets)
+{
+    uint32_t dense = nbuckets * 3ULL / 10;
+    if (dense == 0)
+        return fastrange32(h >> 32, nbuckets);
+    if ((uint32_t) h < 2576980378U) /* 0.6 * 2^32 */
+        return fastrange32(h >> 32, dense);
+    return dense + fastrange32(h >> 32, nbuckets - dense);
+}
+
+static inline uint32_t _fht_slot(uint64_t h, uint32_t pilot, uint32_t m)
+{
+    return fastrange32(fmix64(h ^ ((pilot + 1) * 0x9E3779B97F4A7C15ULL)) >> 32, m);
+}
+
+static void _fht_set_arrays(lch_fhmap_t* fht)
+{
+    char* base = (char*) fht->hdr;
+    fht->pilots = (const uint16_t*) (base + fht->hdr->pilots);
+    fht->remap = (const uint32_t*) (base + fht->hdr->remap);
+    fht->vals = (lch_value_t*) (base + fht->hdr->vals);
+    fht->keys = (const uint32_t*) (base + fht->hdr->keys);
+    fht->blob = base + fht->hdr->blob;
+}
+
+/**********************************************************
+ * Building
+ *********************************************************/
+
+typedef struct {
+    const char** keys;
+    lch_value_t* vals;
+    size_t n;
+    size_t max;
+    uint64_t blob_size;
+} fht_collect_t;
+
+static int _fht_collect(lch_key_t key, lch_value_t val, void* arg)
+{
+    fht_collect_t* c = arg;
+    if (c->n == c->max)
+        return -1;
+    c->keys[c->n] = key;
+    c->vals[c->n] = val;
+    c->n++;
+    c->blob_size += strlen(key) + 1;
+    return 0;
+}
+
+/*
+ * Finds a pilot for every bucket, biggest buckets first, and stores the
+ * slot of every key in `slot`. Returns false if some bucket has no
+ * pilot, and then another seed should be tried.
+ *
+ * `start` has nbuckets+1 entries, and `members` the keys sorted by
+ * bucket, so the keys of bucket b are members[start[b] .. start[b+1])
+ */
+static bool _fht_place(const uint64_t* h, uint32_t n, uint32_t m, uint32_t nbuckets,
+        uint32_t* start, uint32_t* members, uint32_t* by_size,
+        uint64_t* taken, uint16_t* pilots, uint32_t* slot)
+{
+    uint32_t* bucket = slot; /* slot is not needed until the buckets are sorted */
+    memset(start, 0, (nbuckets + 1) * sizeof *start);
+    for (uint32_t i = 0; i < n; ++i) {
+        bucket[i] = _fht_bucket(h[i], nbuckets);
+        start[bucket[i] + 1]++;
+    }
+    for (uint32_t b = 0; b < nbuckets; ++b)
+        start[b + 1] += start[b];
+    for (uint32_t i = 0; i < n; ++i)
+        members[start[bucket[i]]++] = i;
+    for (uint32_t b = nbuckets; b > 0; --b)
+        start[b] = start[b - 1];
+    start[0] = 0;
+
+    /* Counting sort of the buckets by size, biggest first */
+    uint32_t max_size = 0;
+    for (uint32_t b = 0; b < nbuckets; ++b)
+        if (start[b + 1] - start[b] > max_size)
+            max_size = start[b + 1] - start[b];
+    uint32_t* pos = calloc(max_size + 2, sizeof *pos);
+    if (!pos) {
+        perror("ht_freeze");
+        return false;
+    }
+    for (uint32_t b = 0; b < nbuckets; ++b)
+        pos[max_size - (start[b + 1] - start[b]) + 1]++;
+    for (uint32_t k = 0; k <= max_size; ++k)
+        pos[k + 1] += pos[k];
+    for (uint32_t b = 0; b < nbuckets; ++b)
+        by_size[pos[max_size - (start[b + 1] - start[b])]++] = b;
+    free(pos);
+
+    memset(taken, 0, (m + 63) / 64 * sizeof *taken);
+    for (uint32_t k = 0; k < nbuckets; ++k) {
+        uint32_t b = by_size[k];
+        uint32_t first = start[b], last = start[b + 1];
+        if (first == last)
+            break; /* the rest are empty too */
+        uint32_t p;
+        for (p = 0; p <= FHT_MAX_PILOT; ++p) {
+            uint32_t j;
+            for (j = first; j < last; ++j) {
+                uint32_t s = _fht_slot(h[members[j]], p, m);
+                if (taken[s / 64] & (1ULL << (s % 64)))
+                    break;
+                taken[s / 64] |= 1ULL << (s % 64);
+                slot[members[j]] = s;
+            }
+            if (j == last)
+                break;
+            /* Undo the slots taken by this pilot */
+            while (j-- > first) {
+                uint32_t s = slot[members[j]];
+                taken[s / 64] &= ~(1ULL << (s % 64));
+            }
+        }
+        if (p > FHT_MAX_PILOT)
+            return false;
+        pilots[b] = p;
+    }
+    return true;
+}
+
+lch_fhmap_t* ht_freeze(lch_hmap_t* ht)
+{
+    lch_hmap_stats_t st = ht_stats(ht);
+    /* The values of ht_create_sized would have to be copied too */
+    if (st.value_size != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    /* The keys are NUL terminated only if the map copied them */
+    if (st.borrowed) {
+        errno = EINVAL;
+        return NULL;
+    }
+    /*
+     * nbr_elems also counts the expired entries that are not removed
+     * yet, which ht_traverse skips: it is only a bound, the keys are
+     * counted as they are collected
+     */
+    fht_collect_t c = {0};
+    c.max = st.nbr_elems;
+    c.keys = malloc((c.max + 1) * sizeof *c.keys);
+    c.vals = malloc((c.max + 1) * sizeof *c.vals);
+    uint64_t* h = NULL;
+    uint32_t *slot = NULL, *members = NULL, *start = NULL, *by_size = NULL;
+    uint16_t* pilots = NULL;
+    uint64_t* taken = NULL;
+    lch_fhmap_t* fht = NULL;
+    if (!c.keys || !c.vals) {
+        perror("ht_freeze");
+        goto out;
+    }
+    ht_traverse(ht, _fht_collect, &c);
+    if (c.blob_size > UINT32_MAX) {
+        errno = EOVERFLOW;
+        goto out;
+    }
+    uint32_t n = c.n;
+    uint32_t m = n + n / 100 + 1;
+    uint32_t nbuckets = n / FHT_KEYS_PER_BUCKET + 1;
+
+    h = malloc((n + 1) * sizeof *h);
+    slot = malloc((n + 1) * sizeof *slot);
+    members = malloc((n + 1) * sizeof *members);
+    start = malloc((nbuckets + 1) * sizeof *start);
+    by_size = malloc(nbuckets * sizeof *by_size);
+    pilots = malloc(nbuckets * sizeof *pilots);
+    taken = malloc((m + 63) / 64 * sizeof *taken);
+    if (!h || !slot || !members || !start || !by_size || !pilots || !taken) {
+        perror("ht_freeze");
+        goto out;
+    }
+
+    uint64_t seed = 0;
+    bool placed = false;
+    for (int attempt = 0; attempt < FHT_MAX_SEEDS && !placed; ++attempt) {
+        seed = fmix64(0x5eed0000ULL + attempt);
+        for (uint32_t i = 0; i < n; ++i)
+            h[i] = _fht_hash(c.keys[i], strlen(c.keys[i]), seed);
+        placed = _fht_place(h, n, m, nbuckets, start, members, by_size, taken, pilots, slot);
+    }
+    if (!placed) {
+        errno = ERANGE;
+        goto out;
+    }
+
+    uint64_t size = FHT_ALIGN(sizeof(fht_header_t));
+    fht_header_t layout = {0};
+    layout.pilots = size;
+    size = FHT_ALIGN(size + (uint64_t) nbuckets * sizeof(uint16_t));
+    layout.remap = size;
+    size = FHT_ALIGN(size + (uint64_t) (m - n) * sizeof(uint32_t));
+    layout.vals = size;
+    size = FHT_ALIGN(size + (uint64_t) n * sizeof(lch_value_t));
+    layout.keys = size;
+    size = FHT_ALIGN(size + (uint64_t) n * sizeof(uint32_t));
+    layout.blob = size;
+    size += c.blob_size;
+
+    fht = malloc(sizeof *fht);
+    fht_header_t* hdr = fht ? calloc(1U, size) : NULL;
+    if (!hdr) {
+        perror("ht_freeze");
+        free(fht);
+        fht = NULL;
+        goto out;
+    }
+    *hdr = layout;
+    hdr->magic = FHT_MAGIC;
+    hdr->n = n;
+    hdr->m = m;
+    hdr->nbuckets = nbuckets;
+    hdr->seed = seed;
+    hdr->size = size;
+    fht->hdr = hdr;
+    _fht_set_arrays(fht);
+
+    char* base = (char*) hdr;
+    memcpy(base + hdr->pilots, pilots, nbuckets * sizeof *pilots);
+    /* The keys that went to the spare slots are moved to the free ones */
+    uint32_t* remap = (uint32_t*) (base + hdr->remap);
+    uint32_t free_slot = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        if (slot[i] < n)
+            continue;
+        while (taken[free_slot / 64] & (1ULL << (free_slot % 64)))
+            free_slot++;
+        taken[free_slot / 64] |= 1ULL << (free_slot % 64);
+        remap[slot[i] - n] = free_slot;
+        slot[i] = free_slot;
+    }
+    uint32_t* keys = (uint32_t*) (base + hdr->keys);
+    char* blob = base + hdr->blob;
+    uint32_t off = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        size_t len = strlen(c.keys[i]) + 1;
+        memcpy(blob + off, c.keys[i], len);
+        keys[slot[i]] = off;
+        fht->vals[slot[i]] = c.vals[i];
+        off += len;
+    }
+
+out:
+    free(c.keys);
+    free(c.vals);
+    free(h);
+    free(slot);
+    free(members);
+    free(start);
+    free(by_size);
+    free(pilots);
+    free(taken);
+    return fht;
+}
+
+/**********************************************************
+ * Lookups
+ *********************************************************/
+
+lch_value_t* fht_get(lch_fhmap_t* fht, const char* key)
+{
+    const fht_header_t* hdr = fht->hdr;
+    if (hdr->n == 0)
+        return NULL;
+    uint64_t h = _fht_hash(key, strlen(key), hdr->seed);
+    uint32_t s = _fht_slot(h, fht->pilots[_fht_bucket(h, hdr->nbuckets)], hdr->m);
+    if (s >= hdr->n)
+        s = fht->remap[s - hdr->n];
+    if (strcmp(fht->blob + fht->keys[s], key) != 0)
+        return NULL;
+    return &fht->vals[s];
+}
+
+bool fht_contains(lch_fhmap_t* fht, const char* key)
+{
+    return fht_get(fht, key) != NULL;
+}
+
+lch_fhmap_stats_t fht_stats(lch_fhmap_t* fht)
+{
+    const fht_header_t* hdr = fht->hdr;
+    lch_fhmap_stats_t st;
+    st.nbr_elems = hdr->n;
+    st.nbr_buckets = hdr->nbuckets;
+    st.table_size = hdr->m;
+    st.index_bits_per_key = hdr->n == 0 ? 0 :
+        8.0 * (hdr->nbuckets * sizeof(uint16_t) + (hdr->m - hdr->n) * sizeof(uint32_t)) / hdr->n;
+    st.bytes_total = hdr->size;
+    return st;
+}
+
+void fht_traverse(lch_fhmap_t* fht,
+        int (*action) (lch_key_t, lch_value_t, void*), void* arg)
+{
+    for (uint32_t i = 0; i < fht->hdr->n; ++i) {
+        int w = action((lch_key_t) fht->blob + fht->keys[i], fht->vals[i], arg);
+        if (w < 0)
+            return;
+    }
+}
+
+void fht_destroy(lch_fhmap_t* fht, void (*destroy_val_fn) (lch_value_t))
+{
+    if (destroy_val_fn)
+        for (uint32_t i = 0; i < fht->hdr->n; ++i)
+            destroy_val_fn(fht->vals[i]);
+    free(fht->hdr);
+    free(fht);
+}
+
+/**********************************************************
+ * Saving and loading
+ *********************************************************/
+
+int fht_save(lch_fhmap_t* fht, const char* path)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        perror("fht_save");
+        return -1;
+    }
+    size_t w = fwrite(fht->hdr, 1, fht->hdr->size, fp);
+    if (fclose(fp) != 0 || w != fht->hdr->size) {
+        perror("fht_save");
+        return -1;
+    }
+    return 0;
+}
+
+/* Checks that a block read from a file is a map that can be used safely */
+static bool _fht_valid(const fht_header_t* hdr, uint64_t size)
+{
+    if (size < sizeof *hdr || hdr->magic != FHT_MAGIC || hdr->size != size)
+        return false;
+    if (hdr->m <= hdr->n || hdr->nbuckets == 0)
+        return false;
+    if (hdr->pilots > size || (size - hdr->pilots) / sizeof(uint16_t) < hdr->nbuckets
+            || hdr->remap > size || (size - hdr->remap) / sizeof(uint32_t) < hdr->m - hdr->n
+            || hdr->vals > size || (size - hdr->vals) / sizeof(lch_value_t) < hdr->n
+            || hdr->keys > size || (size - hdr->keys) / sizeof(uint32_t) < hdr->n
+            || hdr->blob > size)
+        return false;
+    if ((hdr->pilots | hdr->remap | hdr->vals | hdr->keys) % 8 != 0)
+        return false;
+    if (hdr->n == 0)
+        return true;
+    const char* base = (const char*) hdr;
+    uint64_t blob_size = size - hdr->blob;
+    if (blob_size == 0 || base[size - 1] != '\0')
+        return false;
+    const uint32_t* remap = (const uint32_t*) (base + hdr->remap);
+    for (uint32_t i = 0; i < hdr->m - hdr->n; ++i)
+        if (remap[i] >= hdr->n)
+            return false;
+    const uint32_t* keys = (const uint32_t*) (base + hdr->keys);
+    for (uint32_t i = 0; i < hdr->n; ++i)
+        if (keys[i] >= blob_size)
+            return false;
+    return true;
+}
+
+lch_fhmap_t* fht_load(const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        perror("fht_load");
+        return NULL;
+    }
+    lch_fhmap_t* fht = NULL;
+    fht_header_t* hdr = NULL;
+    long size;
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+        perror("fht_load");
+        goto out;
+    }
+    /* At least a header, so that _fht_valid can read it */
+    hdr = calloc(1U, (size_t) size < sizeof *hdr ? sizeof *hdr : (size_t) size);
+    fht = malloc(sizeof *fht);
+    if (!hdr || !fht) {
+        perror("fht_load");
+        goto fail;
+    }
+    if (fread(hdr, 1, size, fp) != (size_t) size) {
+        perror("fht_load");
+        goto fail;
+    }
+    if (!_fht_valid(hdr, size)) {
+        errno = EINVAL;
+        goto fail;
+    }
+    fht->hdr = hdr;
+    _fht_set_arrays(fht);
+    goto out;
+
+fail:
+    free(hdr);
+    free(fht);
+    fht = NULL;
+out:
+    fclose(fp);
+    return fht;
+}
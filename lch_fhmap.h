@@ -0,0 +1,77 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "lch_hmap.h"
+
+    /*
+     * A read-only ("frozen") hashmap of C strings to lch_value_t, built
+     * once from an lch_hmap that will not change anymore.
+     *
+     * It is indexed by a minimal perfect hash function in the style of
+     * PTHash: the keys are split in buckets of about 6 and each bucket
+     * gets a 16 bit "pilot" that sends its keys to distinct slots, so a
+     * lookup is a hash of the key, a read of the pilot of its bucket and
+     * a comparison with the key in the slot it goes to. The index costs
+     * about 3 bits per key; the rest is the keys and the values.
+     *
+     * The whole map is a single block of memory without pointers, so it
+     * can be written to disk as it is and loaded back (by a machine of
+     * the same endianness). Values that are pointers make sense only in
+     * the process that stored them.
+     */
+    typedef struct lch_fhmap lch_fhmap_t;
+
+    typedef struct {
+        unsigned int nbr_elems;
+        unsigned int nbr_buckets;
+        unsigned int table_size; /* slots, a few more than nbr_elems */
+        double index_bits_per_key; /* the pilots and the remapped slots */
+        size_t bytes_total;
+    } lch_fhmap_stats_t;
+
+    /*
+     * Builds a frozen map with the keys and values currently in `ht`,
+     * which is not changed: the keys are copied, and the values are
+     * shared (so destroy either the map or the frozen map with a
+     * destroy_val_fn, not both). Returns NULL on failure, with errno set
+     * to ENOMEM if out of memory, to EINVAL if `ht` has values of its own
+     * size (see ht_create_sized) or borrowed keys (see
+     * ht_set_borrowed_keys), to EOVERFLOW if the keys do not fit in 4 GiB,
+     * or to ERANGE if no perfect hash function was found
+     */
+    lch_fhmap_t* ht_freeze(lch_hmap_t* ht);
+
+    /*
+     * Finds the value of the given key, or NULL if it is not in the map.
+     * Values can be changed in place, but keys cannot be added
+     */
+    lch_value_t* fht_get(lch_fhmap_t* fht, const char* key);
+    bool fht_contains(lch_fhmap_t* fht, const char* key);
+
+    lch_fhmap_stats_t fht_stats(lch_fhmap_t* fht);
+
+    void fht_traverse(lch_fhmap_t* fht,
+            int (*action) (lch_key_t, lch_value_t, void*), void* arg);
+
+    /*
+     * Writes the map to the file `path`, or loads a map written by
+     * fht_save. Return 0 and the map respectively on success, or -1 and
+     * NULL on failure, with errno set as by fopen, fread etc, or to
+     * EINVAL if the file is not a valid frozen map
+     */
+    int fht_save(lch_fhmap_t* fht, const char* path);
+    lch_fhmap_t* fht_load(const char* path);
+
+    void fht_destroy(lch_fhmap_t* fht,
+            void (*destroy_val_fn) (lch_value_t));
+
+#ifdef __cplusplus
+}
+#endif
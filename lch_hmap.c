@@ -4,16 +4,21 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <errno.h>
 
 #include "lch_hmap.h"
+#include "hfn.h"
+#include "ss_pairing_heap.h"
 
 typedef struct lch_hmap_entry {
     struct lch_hmap_entry* next;
     struct lch_hmap_entry* older; /* Entry inserted/accessed prior to this one */
     struct lch_hmap_entry* newer; /* Entry inserted/accessed after this one */
-    lch_value_t val;
     uint32_t hash; /* the hash of the key, cached */
-    char key[];
+    uint32_t key_len; /* of the key, not counting the NUL of a copied one */
+    uint32_t epoch; /* when it was created or copied, see ht_snapshot */
+    lch_value_t val; /* the first bytes of a bigger value, see ht_create_sized */
+    char key[]; /* the key, or the pointer to it if borrowed, after the value */
 } lch_hmap_entry_t;
 
 typedef struct {
@@ -21,33 +26,118 @@ typedef struct {
     struct lch_hmap_entry* e;
 } lch_hmap_bucket;
 
+/*
+ * The buckets are kept in pages of LCH_PAGE_BUCKETS, so that a snapshot
+ * can share them with the map and the map copies only the pages it
+ * changes afterwards
+ */
+#define LCH_PAGE_BITS 8
+#define LCH_PAGE_BUCKETS (1U << LCH_PAGE_BITS)
+
+/*
+ * The deadline of an entry, in the maps with expiry: it is kept in an
+ * entry between its value and its key, and in the heap of the map
+ * when it is set
+ */
+typedef struct {
+    ss_pairing_node node;
+    uint64_t deadline; /* 0 for none */
+} lch_ttl_t;
+
+/*
+ * A block of the Bloom filter: the bits of a key are all set in the
+ * same 64-byte block, i.e. (hopefully) in a single cache line
+ */
+typedef struct {
+    uint64_t w[8];
+} lch_bloom_block_t;
+
 typedef uint32_t (*hfn_t)(const char*, size_t);
 struct lch_hmap  {
     unsigned int n; /* current number of elements (entries) */
     uint32_t size; /* number of buckets */
     bool ordered;
+    bool borrowed; /* keys are the caller's, see ht_set_borrowed_keys */
+    size_t value_size; /* 0 for a plain lch_value_t */
+    size_t key_offset; /* of the key in an entry, after the value */
     unsigned int max_bucket_size;
     unsigned long long generation;
     hfn_t hfn;
-    lch_hmap_bucket* table;  /* buckets */
+    pg_policy_t policy; /* of the buckets */
+    lch_hmap_bucket** pages; /* of the buckets */
+    lch_hmap_bucket* table;  /* the block all the pages were allocated in */
     lch_hmap_entry_t* first; /* the 'head' for keeping the insertion/accession order */
+    /* The optional Bloom filter in front of the buckets */
+    lch_bloom_block_t* bloom;
+    void* bloom_mem; /* what was allocated for bloom, unaligned */
+    uint32_t bloom_blocks;
+    unsigned int bloom_deleted; /* entries deleted since it was built */
+    /* The optional expiry of the entries, see ht_enable_expiry */
+    bool expiry;
+    size_t ttl_offset; /* of the lch_ttl_t in an entry */
+    uint64_t now; /* the latest time given to ht_expire */
+    ss_pairing_heap deadlines;
+    void (*expired_val_fn) (lch_value_t);
+    /*
+     * Copy on write, see ht_snapshot: the pages and the entries stamped
+     * with an older epoch than the map's are shared with the snapshot
+     */
+    struct lch_hmap_snapshot* snap;
+    uint32_t epoch;
+    uint32_t pages_epoch; /* of the array of the pages */
+    uint32_t* page_epochs;
 };
 
+/* A value to pass to its destroy function once the snapshot is released */
+typedef struct {
+    void (*fn) (lch_value_t);
+    lch_value_t val;
+} lch_dead_val_t;
+
+struct lch_hmap_snapshot {
+    lch_hmap_t view; /* the map as it was, with its pages */
+    int released;
+    /* What the map stopped using while the snapshot still did */
+    void** garbage;
+    size_t ngarbage;
+    size_t garbage_cap;
+    /* and the values it removed, which the snapshot may still return */
+    lch_dead_val_t* dead;
+    size_t ndead;
+    size_t dead_cap;
+};
+
+/* The bytes of a value, rounded up so that the key after it is aligned */
+#define _ht_value_room(value_size) \
+    ((value_size) > sizeof(lch_value_t) \
+     ? ((value_size) + sizeof(lch_value_t) - 1) / sizeof(lch_value_t) * sizeof(lch_value_t) \
+     : sizeof(lch_value_t))
+#define _ht_key_mem(ht,e) ((char*) (e) + (ht)->key_offset)
+#define _ht_ttl(ht,e) ((lch_ttl_t*) ((char*) (e) + (ht)->ttl_offset))
+#define _ht_expired(ht,e) ((ht)->expiry && _ht_ttl((ht), (e))->deadline != 0 \
+        && _ht_ttl((ht), (e))->deadline <= (ht)->now)
+
 lch_hmap_stats_t ht_stats(lch_hmap_t* h)
 {
     lch_hmap_stats_t t = {
         .capacity = h->size,
         .nbr_elems = h->n,
         .max_bucket_size = h->max_bucket_size,
-        .generation = h->generation
+        .generation = h->generation,
+        .value_size = h->value_size,
+        .borrowed = h->borrowed,
+        .hfn_name = hfn_name(h->hfn)
     };
     return t;
 }
 
 #define BITS_TO_HSIZE(b) (1U << (b))
 #define HASH_SIZE(ht) ((ht)->size)
+#define HASH_PAGES(ht) ((HASH_SIZE(ht) + LCH_PAGE_BUCKETS - 1) >> LCH_PAGE_BITS)
+/* The buckets after the last one in the last page stay empty */
 #define for_each_lch_bucket(ht,e) \
-    for(e=(ht)->table;e!=(ht)->table+HASH_SIZE(ht);e++)
+    for (lch_hmap_bucket** _pg = (ht)->pages; _pg != (ht)->pages + HASH_PAGES(ht); ++_pg) \
+        for (e = *_pg; e != *_pg + LCH_PAGE_BUCKETS; e++)
 
 #define _HSH_P0 5U
 #define _HSH_P1 11U
@@ -158,7 +248,10 @@ static uint32_t mod_hash_size(lch_hmap_t* ht, uint32_t k)
                        return lch_fast_mod32(k, ht->size);
     };
 }
-#define ht_hash_to_bucket(ht,h)  ((ht)->table + (mod_hash_size((ht), (h))))
+#define _ht_bucket(ht,i) ((ht)->pages[(i) >> LCH_PAGE_BITS] + ((i) & (LCH_PAGE_BUCKETS - 1)))
+#define ht_hash_to_bucket(ht,h)  _ht_bucket((ht), mod_hash_size((ht), (h)))
+/* Is what is stamped with this epoch shared with the snapshot? */
+#define _ht_shared(ht,stamp) ((ht)->snap != NULL && (stamp) != (ht)->epoch)
 
 static uint32_t _next_prime_for_expand(uint32_t minSize)
 {
@@ -168,7 +261,46 @@ static uint32_t _next_prime_for_expand(uint32_t minSize)
     return (*p ? *p : _primes[_primes_len - 1]);
 }
 
-lch_hmap_t* ht_create(uint32_t initial_size, hfn_t hfn)
+static int _ht_table_alloc(lch_hmap_t* ht)
+{
+    uint32_t npages = HASH_PAGES(ht);
+    ht->table = pg_alloc((size_t) npages * LCH_PAGE_BUCKETS * sizeof *ht->table, &ht->policy);
+    ht->pages = malloc(npages * sizeof *ht->pages);
+    ht->page_epochs = malloc(npages * sizeof *ht->page_epochs);
+    if (!ht->table || !ht->pages || !ht->page_epochs) {
+        perror("ht_create");
+        if (ht->table)
+            pg_free(ht->table, (size_t) npages * LCH_PAGE_BUCKETS * sizeof *ht->table, &ht->policy);
+        free(ht->pages);
+        free(ht->page_epochs);
+        return -1;
+    }
+    for (uint32_t p = 0; p < npages; ++p) {
+        ht->pages[p] = ht->table + (size_t) p * LCH_PAGE_BUCKETS;
+        ht->page_epochs[p] = ht->epoch;
+    }
+    ht->pages_epoch = ht->epoch;
+    return 0;
+}
+
+/* Was the page copied, rather than being in the block of the table? */
+#define _ht_page_copied(ht,page) \
+    ((page) < (ht)->table || (page) >= (ht)->table + (size_t) HASH_PAGES(ht) * LCH_PAGE_BUCKETS)
+
+static void _ht_table_free(lch_hmap_t* ht)
+{
+    uint32_t npages = HASH_PAGES(ht);
+    for (uint32_t p = 0; p < npages; ++p) {
+        if (_ht_page_copied(ht, ht->pages[p]))
+            free(ht->pages[p]);
+    }
+    pg_free(ht->table, (size_t) npages * LCH_PAGE_BUCKETS * sizeof *ht->table, &ht->policy);
+    free(ht->pages);
+    free(ht->page_epochs);
+}
+
+lch_hmap_t* ht_create_sized(uint32_t initial_size, hfn_t hfn,
+        const pg_policy_t* policy, size_t value_size)
 {
     lch_hmap_t *h = calloc(1U, sizeof *h);
     if (!h) {
@@ -177,37 +309,358 @@ lch_hmap_t* ht_create(uint32_t initial_size, hfn_t hfn)
     }
     h->size = _next_prime_for_expand(initial_size);
     h->hfn = hfn;
-    h->table = calloc(h->size, sizeof(lch_hmap_bucket));
-    if (h->table == NULL) {
-        perror("ht_create");
+    if (policy)
+        h->policy = *policy;
+    if (_ht_table_alloc(h) < 0) {
         free(h);
         return NULL;
     }
     h->ordered = 1;
+    h->value_size = value_size;
+    h->key_offset = offsetof(lch_hmap_entry_t, val) + _ht_value_room(value_size);
     /* printf("Hashtable created with size %u\n", HASH_SIZE(h)); */
     return h;
 }
 
-static lch_hmap_entry_t* _ht_entry_create(lch_hmap_t* ht, const char* word, uint32_t h)
+lch_hmap_t* ht_create_ex(uint32_t initial_size, hfn_t hfn, const pg_policy_t* policy)
+{
+    return ht_create_sized(initial_size, hfn, policy, 0);
+}
+
+lch_hmap_t* ht_create(uint32_t initial_size, hfn_t hfn)
 {
-    size_t word_len = strlen(word);
-    lch_hmap_entry_t* e = calloc(1, sizeof(lch_hmap_t) + word_len + 1);
+    return ht_create_ex(initial_size, hfn, NULL);
+}
+
+/* How far from the ideal key distribution we accept, see hfn_select */
+#define LCH_AUTO_MAX_SCORE 1.10
+
+lch_hmap_t* ht_create_auto(uint32_t initial_size,
+        const char** sample_keys, size_t n)
+{
+    uint32_t size = _next_prime_for_expand(initial_size);
+    hfn_t hfn = hfn_select(sample_keys, n, size, LCH_AUTO_MAX_SCORE);
+    return ht_create(size, hfn);
+}
+
+static lch_hmap_entry_t* _ht_entry_create(lch_hmap_t* ht, const char* word,
+        size_t word_len, uint32_t h)
+{
+    size_t key_size = ht->borrowed ? sizeof word : word_len + 1;
+    lch_hmap_entry_t* e = calloc(1, ht->key_offset + key_size);
 
     if (!e) {
         perror("_ht_entry_create");
         return NULL;
     }
     e->hash = h;
-    memcpy(e->key, word, word_len+1);
+    e->epoch = ht->epoch;
+    e->key_len = word_len;
+    char* key = _ht_key_mem(ht, e);
+    if (ht->borrowed) {
+        memcpy(key, &word, sizeof word);
+    }
+    else {
+        memcpy(key, word, word_len);
+        key[word_len] = '\0';
+    }
     return e;
 }
 
+static inline const char* _ht_key(const lch_hmap_t* ht, const lch_hmap_entry_t* e)
+{
+    const char* key;
+    if (!ht->borrowed)
+        return _ht_key_mem(ht, e);
+    memcpy(&key, _ht_key_mem(ht, e), sizeof key);
+    return key;
+}
+
+/* What the callbacks get for the value: itself, or a pointer to it */
+static inline lch_value_t _ht_val_arg(const lch_hmap_t* ht, lch_hmap_entry_t* e)
+{
+    if (ht->value_size == 0)
+        return e->val;
+    return (lch_value_t) { .p = &e->val };
+}
+
+/* Does the (not necessarily NUL terminated) word match the entry's key? */
+static inline bool _ht_entry_match(const lch_hmap_t* ht, const lch_hmap_entry_t* e,
+        const char* word, size_t len, uint32_t h)
+{
+    /* The word may have NULs in it: no str* functions */
+    return h == e->hash && e->key_len == len && memcmp(_ht_key(ht, e), word, len) == 0;
+}
+
+/**********************************************************
+ *  Copy on write, for the snapshot
+ *********************************************************/
+
+/* Frees the snapshot, and what only it still used, once released */
+static void _ht_snap_collect(lch_hmap_t* ht)
+{
+    lch_hmap_snapshot_t* s = ht->snap;
+    if (s == NULL || !__atomic_load_n(&s->released, __ATOMIC_ACQUIRE))
+        return;
+    /* Their values may be in the entries of the garbage */
+    for (size_t k = 0; k < s->ndead; ++k)
+        s->dead[k].fn(s->dead[k].val);
+    free(s->dead);
+    for (size_t k = 0; k < s->ngarbage; ++k)
+        free(s->garbage[k]);
+    free(s->garbage);
+    free(s);
+    ht->snap = NULL;
+}
+
+/* Makes room for n more of what the map leaves to the snapshot */
+static int _ht_garbage_reserve(lch_hmap_t* ht, size_t n)
+{
+    lch_hmap_snapshot_t* s = ht->snap;
+    if (s->ngarbage + n <= s->garbage_cap)
+        return 0;
+    size_t cap = s->garbage_cap ? 2*s->garbage_cap : 64;
+    while (cap < s->ngarbage + n)
+        cap *= 2;
+    void** garbage = realloc(s->garbage, cap * sizeof *garbage);
+    if (!garbage) {
+        perror("ht_snapshot");
+        return -1;
+    }
+    s->garbage = garbage;
+    s->garbage_cap = cap;
+    return 0;
+}
+
+/* Only after _ht_garbage_reserve */
+#define _ht_garbage_add(ht,p) ((ht)->snap->garbage[(ht)->snap->ngarbage++] = (p))
+
+/* Makes room for n more values to destroy once the snapshot is released */
+static int _ht_dead_reserve(lch_hmap_t* ht, size_t n)
+{
+    lch_hmap_snapshot_t* s = ht->snap;
+    if (s->ndead + n <= s->dead_cap)
+        return 0;
+    size_t cap = s->dead_cap ? 2*s->dead_cap : 64;
+    while (cap < s->ndead + n)
+        cap *= 2;
+    lch_dead_val_t* dead = realloc(s->dead, cap * sizeof *dead);
+    if (!dead) {
+        perror("ht_snapshot");
+        return -1;
+    }
+    s->dead = dead;
+    s->dead_cap = cap;
+    return 0;
+}
+
+/* Frees an entry taken out of the map, unless the snapshot has it */
+static void _ht_entry_free(lch_hmap_t* ht, lch_hmap_entry_t* t)
+{
+    if (_ht_shared(ht, t->epoch))
+        _ht_garbage_add(ht, t);
+    else
+        free(t);
+}
+
+/*
+ * Passes the value of an entry taken out of the map to destroy_val_fn
+ * (if not NULL) and frees the entry. While the snapshot lives both wait
+ * for its release: a copied entry still shares what its value points
+ * to. Only after _ht_garbage_reserve and _ht_dead_reserve
+ */
+static void _ht_entry_dispose(lch_hmap_t* ht, lch_hmap_entry_t* t,
+        void (*destroy_val_fn)(lch_value_t))
+{
+    if (destroy_val_fn == NULL) {
+        _ht_entry_free(ht, t);
+    }
+    else if (ht->snap) {
+        lch_hmap_snapshot_t* s = ht->snap;
+        s->dead[s->ndead++] = (lch_dead_val_t) { destroy_val_fn, _ht_val_arg(ht, t) };
+        _ht_garbage_add(ht, t);
+    }
+    else {
+        destroy_val_fn(_ht_val_arg(ht, t));
+        free(t);
+    }
+}
+
+/*
+ * The bucket i, to be changed: its page is copied first if the
+ * snapshot shares it, and so is the array of the pages. NULL if out of
+ * memory
+ */
+static lch_hmap_bucket* _ht_bucket_w(lch_hmap_t* ht, uint32_t i)
+{
+    uint32_t p = i >> LCH_PAGE_BITS;
+    if (!_ht_shared(ht, ht->page_epochs[p]))
+        return _ht_bucket(ht, i);
+    if (_ht_garbage_reserve(ht, 2) < 0)
+        return NULL;
+    if (_ht_shared(ht, ht->pages_epoch)) {
+        size_t bytes = HASH_PAGES(ht) * sizeof *ht->pages;
+        lch_hmap_bucket** pages = malloc(bytes);
+        if (!pages) {
+            perror("ht_snapshot");
+            return NULL;
+        }
+        memcpy(pages, ht->pages, bytes);
+        _ht_garbage_add(ht, ht->pages);
+        ht->pages = pages;
+        ht->pages_epoch = ht->epoch;
+    }
+    lch_hmap_bucket* page = malloc(LCH_PAGE_BUCKETS * sizeof *page);
+    if (!page) {
+        perror("ht_snapshot");
+        return NULL;
+    }
+    memcpy(page, ht->pages[p], LCH_PAGE_BUCKETS * sizeof *page);
+    /* The block of the table is freed as a whole, later */
+    if (_ht_page_copied(ht, ht->pages[p]))
+        _ht_garbage_add(ht, ht->pages[p]);
+    ht->pages[p] = page;
+    ht->page_epochs[p] = ht->epoch;
+    return _ht_bucket(ht, i);
+}
+
+/*
+ * Puts a copy of the entry e, which the snapshot shares, in its place in
+ * the insertion order and the deadlines, and leaves e to the snapshot.
+ * The caller links the copy in the bucket. NULL if out of memory
+ */
+static lch_hmap_entry_t* _ht_entry_copy(lch_hmap_t* ht, lch_hmap_entry_t* e)
+{
+    if (_ht_garbage_reserve(ht, 1) < 0)
+        return NULL;
+    size_t size = ht->key_offset
+        + (ht->borrowed ? sizeof(char*) : e->key_len + 1);
+    lch_hmap_entry_t* c = malloc(size);
+    if (!c) {
+        perror("ht_snapshot");
+        return NULL;
+    }
+    bool deadline = ht->expiry && _ht_ttl(ht, e)->deadline != 0;
+    if (deadline)
+        ss_pairing_delete(&ht->deadlines, &_ht_ttl(ht, e)->node);
+    memcpy(c, e, size);
+    c->epoch = ht->epoch;
+    if (deadline)
+        ss_pairing_insert(&ht->deadlines, &_ht_ttl(ht, c)->node);
+    if (ht->ordered) {
+        if (e->newer == e) {
+            c->older = c;
+            c->newer = c;
+        }
+        else {
+            c->older->newer = c;
+            c->newer->older = c;
+        }
+        if (ht->first == e)
+            ht->first = c;
+    }
+    _ht_garbage_add(ht, e);
+    return c;
+}
+
+/*
+ * The link to the entry t of the bucket i (the head of the bucket or
+ * the next of the entry before t), to be changed: the bucket and the
+ * entries before t are copied first if the snapshot shares them. It
+ * also makes room for t to be left to the snapshot. NULL if out of
+ * memory
+ */
+static lch_hmap_entry_t** _ht_link_w(lch_hmap_t* ht, uint32_t i, lch_hmap_entry_t* t)
+{
+    lch_hmap_bucket* b = _ht_bucket_w(ht, i);
+    if (!b)
+        return NULL;
+    lch_hmap_entry_t** link = &b->e;
+    while (*link != t) {
+        if (_ht_shared(ht, (*link)->epoch)) {
+            lch_hmap_entry_t* c = _ht_entry_copy(ht, *link);
+            if (!c)
+                return NULL;
+            *link = c;
+        }
+        link = &(*link)->next;
+    }
+    if (ht->snap && _ht_garbage_reserve(ht, 1) < 0)
+        return NULL;
+    return link;
+}
+
+/* The entry e of the bucket i, to be changed. NULL if out of memory */
+static lch_hmap_entry_t* _ht_entry_w(lch_hmap_t* ht, uint32_t i, lch_hmap_entry_t* e)
+{
+    if (!_ht_shared(ht, e->epoch))
+        return e;
+    lch_hmap_entry_t** link = _ht_link_w(ht, i, e);
+    if (!link)
+        return NULL;
+    lch_hmap_entry_t* c = _ht_entry_copy(ht, e);
+    if (!c)
+        return NULL;
+    *link = c;
+    return c;
+}
+
+/* ht_clear while the snapshot lives: the map gets new, empty pages */
+static int _ht_clear_shared(lch_hmap_t* ht, void (*destroy_val_fn) (lch_value_t))
+{
+    uint32_t npages = HASH_PAGES(ht);
+    if (_ht_garbage_reserve(ht, ht->n + npages + 1) < 0
+            || (destroy_val_fn && _ht_dead_reserve(ht, ht->n) < 0))
+        return -1;
+    lch_hmap_bucket** pages = calloc(npages, sizeof *pages);
+    if (!pages)
+        goto oom;
+    for (uint32_t p = 0; p < npages; ++p) {
+        pages[p] = calloc(LCH_PAGE_BUCKETS, sizeof **pages);
+        if (!pages[p])
+            goto oom;
+    }
+
+    lch_hmap_bucket* he;
+    for_each_lch_bucket(ht,he) {
+        for (lch_hmap_entry_t* t = he->e; t; ) {
+            lch_hmap_entry_t* tnext = t->next;
+            _ht_entry_dispose(ht, t, destroy_val_fn);
+            t = tnext;
+        }
+    }
+    for (uint32_t p = 0; p < npages; ++p) {
+        /* The block of the table is freed as a whole, later */
+        if (_ht_page_copied(ht, ht->pages[p])) {
+            if (_ht_shared(ht, ht->page_epochs[p]))
+                _ht_garbage_add(ht, ht->pages[p]);
+            else
+                free(ht->pages[p]);
+        }
+        ht->page_epochs[p] = ht->epoch;
+    }
+    if (_ht_shared(ht, ht->pages_epoch))
+        _ht_garbage_add(ht, ht->pages);
+    else
+        free(ht->pages);
+    ht->pages = pages;
+    ht->pages_epoch = ht->epoch;
+    return 0;
+
+oom:
+    perror("ht_clear");
+    for (uint32_t p = 0; pages && p < npages; ++p)
+        free(pages[p]);
+    free(pages);
+    return -1;
+}
+
 static void _ht_entry_destroy(lch_hmap_t* ht, lch_hmap_bucket* he,
         void (*destroy_val_fn)(lch_value_t))
 {
     for(lch_hmap_entry_t* t = he->e; t; ) {
         if (destroy_val_fn != NULL)
-            destroy_val_fn(t->val);
+            destroy_val_fn(_ht_val_arg(ht, t));
         lch_hmap_entry_t* tnext = t->next;
         free(t);
         t = tnext;
@@ -219,16 +672,39 @@ static void _ht_entry_destroy(lch_hmap_t* ht, lch_hmap_bucket* he,
 void ht_destroy(lch_hmap_t* ht, void (*destroy_val_fn) (lch_value_t))
 {
     lch_hmap_bucket* e;
+    _ht_snap_collect(ht);
+    /* The snapshot reads what is freed here: it is a bug to get here first */
+    if (ht->snap) {
+        fprintf(stderr, "ht_destroy: the snapshot of the map is not released\n");
+        abort();
+    }
     for_each_lch_bucket(ht,e) _ht_entry_destroy(ht, e, destroy_val_fn);
-    free(ht->table);
+    _ht_table_free(ht);
+    free(ht->bloom_mem);
     free(ht);
 }
 
 void ht_clear(lch_hmap_t* ht, void (*destroy_val_fn) (lch_value_t))
 {
-    lch_hmap_bucket* e;
-    for_each_lch_bucket(ht,e)
-        _ht_entry_destroy(ht, e, destroy_val_fn);
+    _ht_snap_collect(ht);
+    if (ht->snap) {
+        if (_ht_clear_shared(ht, destroy_val_fn) < 0)
+            return;
+    }
+    else {
+        lch_hmap_bucket* e;
+        for_each_lch_bucket(ht,e)
+            _ht_entry_destroy(ht, e, destroy_val_fn);
+    }
+    ht->n = 0;
+    ht->first = NULL;
+    ht->generation++;
+    if (ht->bloom) {
+        memset(ht->bloom, 0, ht->bloom_blocks * sizeof *ht->bloom);
+        ht->bloom_deleted = 0;
+    }
+    if (ht->expiry)
+        ss_pairing_init(&ht->deadlines, ht->deadlines.compar);
 }
 
 void ht_traverse(lch_hmap_t* ht,
@@ -238,7 +714,9 @@ void ht_traverse(lch_hmap_t* ht,
     lch_hmap_bucket* he;
     for_each_lch_bucket(ht,he) {
         for (lch_hmap_entry_t* e = he->e; e; e = e->next) {
-            int w = action(e->key, e->val, arg);
+            if (_ht_expired(ht, e))
+                continue;
+            int w = action((lch_key_t) _ht_key(ht, e), _ht_val_arg(ht, e), arg);
             assert(ht->generation == generation);
             if (w < 0)
                 return;
@@ -253,7 +731,11 @@ void ht_traverse_ordered(lch_hmap_t* ht,
     if (!e)
         return;
     do {
-        int w = action(e->key, e->val, arg);
+        if (_ht_expired(ht, e)) {
+            e = e->newer;
+            continue;
+        }
+        int w = action((lch_key_t) _ht_key(ht, e), _ht_val_arg(ht, e), arg);
         assert(ht->generation == generation);
         if (w < 0)
             return;
@@ -267,15 +749,100 @@ float ht_load_factor(lch_hmap_t* h)
     return h->n*1.0/HASH_SIZE(h);
 }
 
+/**********************************************************
+ *  The Bloom filter
+ *********************************************************/
+
+#define LCH_BLOOM_BITS_PER_KEY 10
+#define LCH_BLOOM_K 6 /* bits set per key */
+
+/*
+ * The block of a hash and, from a different mixing of it, the
+ * LCH_BLOOM_K bits in the block (9 bits for each)
+ */
+#define _ht_bloom_block(ht,h) ((ht)->bloom + lch_fast_mod32(fmix32(h), (ht)->bloom_blocks))
+
+static void _ht_bloom_add(lch_hmap_t* ht, uint32_t h)
+{
+    lch_bloom_block_t* b = _ht_bloom_block(ht, h);
+    uint64_t bits = fmix64(h);
+    for (int k = 0; k < LCH_BLOOM_K; ++k, bits >>= 9)
+        b->w[(bits >> 6) & 7] |= 1ULL << (bits & 63);
+}
+
+static bool _ht_bloom_maybe(lch_hmap_t* ht, uint32_t h)
+{
+    lch_bloom_block_t* b = _ht_bloom_block(ht, h);
+    uint64_t bits = fmix64(h);
+    for (int k = 0; k < LCH_BLOOM_K; ++k, bits >>= 9) {
+        if (!(b->w[(bits >> 6) & 7] & (1ULL << (bits & 63))))
+            return false;
+    }
+    return true;
+}
+
+/* Is the key certainly not in the map? */
+#define _ht_bloom_miss(ht,h) ((ht)->bloom && !_ht_bloom_maybe((ht), (h)))
+
+static void _ht_bloom_free(lch_hmap_t* ht)
+{
+    free(ht->bloom_mem);
+    ht->bloom_mem = NULL;
+    ht->bloom = NULL;
+    ht->bloom_blocks = 0;
+    ht->bloom_deleted = 0;
+}
+
+/*
+ * (Re)builds the filter for the entries that fit in the map before its
+ * next rehash. Deleted keys cannot be removed from a Bloom filter, so
+ * this is also how they are dropped.
+ */
+static int _ht_bloom_build(lch_hmap_t* ht)
+{
+    size_t keys = (3*(size_t) HASH_SIZE(ht) >> 2) + 1;
+    uint32_t blocks = (keys * LCH_BLOOM_BITS_PER_KEY + 511) / 512;
+    void* mem = calloc(blocks + 1, sizeof(lch_bloom_block_t));
+    if (!mem) {
+        perror("_ht_bloom_build");
+        return -1;
+    }
+    _ht_bloom_free(ht);
+    ht->bloom_mem = mem;
+    ht->bloom = (lch_bloom_block_t*) (((uintptr_t) mem + sizeof(lch_bloom_block_t) - 1)
+            & ~(uintptr_t) (sizeof(lch_bloom_block_t) - 1));
+    ht->bloom_blocks = blocks;
+
+    lch_hmap_bucket* he;
+    for_each_lch_bucket(ht,he) {
+        for (lch_hmap_entry_t* e = he->e; e; e = e->next)
+            _ht_bloom_add(ht, e->hash);
+    }
+    return 0;
+}
+
+bool ht_set_bloom(lch_hmap_t* ht, bool enabled)
+{
+    if (!enabled)
+        _ht_bloom_free(ht);
+    else if (!ht->bloom)
+        return _ht_bloom_build(ht) == 0;
+    return true;
+}
+
 static void _ht_insert_entry(lch_hmap_t* ht, lch_hmap_bucket* bucket,
         lch_hmap_entry_t* e);
-static void _ht_rehash(lch_hmap_t* ht)
+
+/* Moves the entries to bigger buckets. On failure the map is left as it was */
+static int _ht_rehash(lch_hmap_t* ht, uint32_t min_size)
 {
-    uint32_t newSize = _next_prime_for_expand(2*HASH_SIZE(ht));
+    uint32_t newSize = _next_prime_for_expand(min_size);
     /* printf("Current load factor %4.2f.. (size=%u, N=%u, max bkt size=%u) rehashing to %u ..\n", ht_load_factor(ht), ht->size, ht->n, ht->max_bucket_size, newSize); */
-    lch_hmap_t* hnew = ht_create(newSize, ht->hfn);
+    /* The snapshot keeps the buckets it shares: grow after it is released */
+    assert(ht->snap == NULL);
+    lch_hmap_t* hnew = ht_create_ex(newSize, ht->hfn, &ht->policy);
     if (!hnew)
-        return;
+        return -1;
     lch_hmap_bucket* he;
     for_each_lch_bucket(ht,he) {
         for (lch_hmap_entry_t* e = he->e; e;) {
@@ -287,12 +854,19 @@ static void _ht_rehash(lch_hmap_t* ht)
         he->e = NULL;
     }
 
-    free(ht->table);
+    _ht_table_free(ht);
     ht->table = hnew->table;
+    ht->pages = hnew->pages;
+    ht->page_epochs = hnew->page_epochs;
+    ht->pages_epoch = hnew->pages_epoch;
     ht->size = hnew->size;
     ht->max_bucket_size = hnew->max_bucket_size;
     free(hnew);
+    if (ht->bloom && _ht_bloom_build(ht) < 0)
+        _ht_bloom_free(ht);
+    return 0;
 }
+
 static void _ht_insert_entry(lch_hmap_t* ht, lch_hmap_bucket* bucket, lch_hmap_entry_t* e)
 {
     bucket->len++;
@@ -303,99 +877,415 @@ static void _ht_insert_entry(lch_hmap_t* ht, lch_hmap_bucket* bucket, lch_hmap_e
         ht->max_bucket_size = bucket->len;
 }
 
+/* Takes the entry *e out of the bucket b and of the map */
+static lch_hmap_entry_t* _ht_unlink(lch_hmap_t* ht, lch_hmap_bucket* b,
+        lch_hmap_entry_t** e)
+{
+    lch_hmap_entry_t* t = *e;
+    *e = t->next;
+
+    if (ht->ordered) {
+        if (t->newer == t) {
+            /* The element to be deleted is the last one! */
+            ht->first = NULL;
+        }
+        else {
+            t->newer->older = t->older;
+            t->older->newer = t->newer;
+            if (ht->first == t)
+                ht->first = t->newer;
+        }
+    }
+    if (ht->expiry && _ht_ttl(ht, t)->deadline != 0)
+        ss_pairing_delete(&ht->deadlines, &_ht_ttl(ht, t)->node);
+    b->len--;
+    ht->n--;
+    ht->generation++;
+    /* Its bits stay set: rebuild once they start to add up */
+    if (ht->bloom && ++ht->bloom_deleted > HASH_SIZE(ht) / 8 && _ht_bloom_build(ht) < 0)
+        _ht_bloom_free(ht);
+    return t;
+}
+
 void ht_delete(lch_hmap_t* ht, const char* word)
 {
-    uint32_t h = ht->hfn(word, strlen(word));
-    lch_hmap_bucket* b = ht_hash_to_bucket(ht, h);
+    _ht_snap_collect(ht);
+    size_t len = strlen(word);
+    uint32_t h = ht->hfn(word, len);
+    uint32_t i = mod_hash_size(ht, h);
+    lch_hmap_bucket* b = _ht_bucket(ht, i);
 
-    if (b->e == NULL) {
+    if (b->e == NULL || _ht_bloom_miss(ht, h)) {
         return;
     }
-    lch_hmap_entry_t** e;
-    for (e = &b->e; *e; ) {
-        lch_hmap_entry_t* t = *e;
-        if (h == t->hash && strcmp(t->key, word) == 0) {
-            *e = t->next;
-
-            if (ht->ordered) {
-                if (t->newer == t) {
-                    /* The element to be deleted is the last one! */
-                    ht->first = NULL;
-                }
-                else {
-                    t->newer->older = t->older;
-                    t->older->newer = t->newer;
-                    if (ht->first == t)
-                        ht->first = t->newer;
-                }
-            }
-            free(t->key);
-            free(t);
-            b->len--;
-            ht->n--;
-            ht->generation++;
+    for (lch_hmap_entry_t* t = b->e; t; t = t->next) {
+        if (_ht_entry_match(ht, t, word, len, h)) {
+            lch_hmap_entry_t** e = _ht_link_w(ht, i, t);
+            if (e)
+                _ht_entry_free(ht, _ht_unlink(ht, _ht_bucket(ht, i), e));
             return;
         }
-        e = &t->next;
     }
 }
 
-lch_value_t* ht_get(lch_hmap_t* ht, const char* word)
+/* Removes an entry whose deadline has passed. -1 if out of memory */
+static int _ht_expire_entry(lch_hmap_t* ht, lch_hmap_entry_t* t)
+{
+    uint32_t i = mod_hash_size(ht, t->hash);
+    if (ht->snap && ht->expired_val_fn && _ht_dead_reserve(ht, 1) < 0)
+        return -1;
+    lch_hmap_entry_t** e = _ht_link_w(ht, i, t);
+    if (!e)
+        return -1;
+    _ht_unlink(ht, _ht_bucket(ht, i), e);
+    _ht_entry_dispose(ht, t, ht->expired_val_fn);
+    return 0;
+}
+
+/* The entry of the key, NULL if missing (or expired, and then removed) */
+static lch_hmap_entry_t* _ht_find(lch_hmap_t* ht, const char* word, size_t len, uint32_t h)
 {
-    uint32_t h = ht->hfn(word, strlen(word));
+    if (_ht_bloom_miss(ht, h))
+        return NULL;
     lch_hmap_bucket* b = ht_hash_to_bucket(ht, h);
     for (lch_hmap_entry_t* e = b->e; e; e = e->next) {
-        if (h == e->hash && strcmp(e->key, word) == 0) {
-            return &e->val;
+        if (_ht_entry_match(ht, e, word, len, h)) {
+            if (!_ht_expired(ht, e))
+                return e;
+            _ht_snap_collect(ht);
+            _ht_expire_entry(ht, e);
+            break;
         }
     }
     return NULL;
 }
 
+lch_value_t* ht_get_hashed(lch_hmap_t* ht, const char* word, size_t len, uint32_t h)
+{
+    lch_hmap_entry_t* e = _ht_find(ht, word, len, h);
+    if (!e)
+        return NULL;
+    _ht_snap_collect(ht);
+    /* The caller may change the value, the snapshot's must not */
+    e = _ht_entry_w(ht, mod_hash_size(ht, h), e);
+    return e ? &e->val : NULL;
+}
+
+lch_value_t* ht_get(lch_hmap_t* ht, const char* word)
+{
+    size_t len = strlen(word);
+    return ht_get_hashed(ht, word, len, ht->hfn(word, len));
+}
+
 lch_value_t* ht_put(lch_hmap_t* ht, const char* word)
 {
-    ht->generation++;
-    uint32_t h = ht->hfn(word, strlen(word));
-    lch_hmap_bucket* b = ht_hash_to_bucket(ht, h);
+    size_t len = strlen(word);
+    return ht_put_hashed(ht, word, len, ht->hfn(word, len));
+}
 
+/* Appends the entry to the insertion order */
+static void _ht_link_newest(lch_hmap_t* ht, lch_hmap_entry_t* e)
+{
+    if (!ht->ordered)
+        return;
+    if (ht->first) {
+        lch_hmap_entry_t* tail = ht->first->older;
+        e->older = tail;
+        e->newer = tail->newer;
+        tail->newer->older = e;
+        tail->newer = e;
+    }
+    else {
+        e->older = e;
+        e->newer = e;
+        ht->first = e;
+    }
+}
+
+/*
+ * The one lookup and (if missing) insertion behind ht_put_hashed,
+ * ht_increment and ht_upsert. *created tells which of the two it was
+ */
+static lch_value_t* _ht_upsert_hashed(lch_hmap_t* ht, const char* word, size_t len,
+        uint32_t h, bool* created)
+{
+    uint32_t i = mod_hash_size(ht, h);
+
+    _ht_snap_collect(ht);
+    *created = false;
     lch_hmap_entry_t* e;
-    for (e = b->e; e; e = e->next) {
-        if (h == e->hash && strcmp(e->key, word) == 0) {
-            return &e->val;
+    if (!_ht_bloom_miss(ht, h)) {
+        for (e = _ht_bucket(ht, i)->e; e; e = e->next) {
+            if (_ht_entry_match(ht, e, word, len, h)) {
+                if (!_ht_expired(ht, e)) {
+                    /* The caller may change the value, the snapshot's must not */
+                    e = _ht_entry_w(ht, i, e);
+                    return e ? &e->val : NULL;
+                }
+                /* Gone, and added again below */
+                if (_ht_expire_entry(ht, e) < 0)
+                    return NULL;
+                break;
+            }
         }
     }
 
-    e = _ht_entry_create(ht, word, h);
+    e = _ht_entry_create(ht, word, len, h);
     if (!e)
         return NULL;
 
-    if (ht->n + 1 > (3*ht->size >> 2)) { /* Use the 0.75 factor */
-        /* We need to rehash ... */
-        _ht_rehash(ht);
-        b = ht_hash_to_bucket(ht, h);
+    /* Use the 0.75 factor, unless the snapshot shares the buckets */
+    if (ht->n + 1 > (3*ht->size >> 2) && ht->snap == NULL) {
+        /* We need to rehash ... or go on chaining if it fails */
+        _ht_rehash(ht, 2*HASH_SIZE(ht));
+        i = mod_hash_size(ht, h);
+    }
+    lch_hmap_bucket* b = _ht_bucket_w(ht, i);
+    if (!b) {
+        free(e);
+        return NULL;
     }
 
     _ht_insert_entry(ht, b, e);
-    if (ht->ordered) {
-        if (ht->first) {
-            lch_hmap_entry_t* tail = ht->first->older;
-            e->older = tail;
-            e->newer = tail->newer;
-            tail->newer->older = e;
-            tail->newer = e;
+    ht->generation++;
+    *created = true;
+    if (ht->bloom)
+        _ht_bloom_add(ht, h);
+    _ht_link_newest(ht, e);
+
+    return &e->val;
+}
+
+lch_value_t* ht_put_hashed(lch_hmap_t* ht, const char* word, size_t len, uint32_t h)
+{
+    bool created;
+    return _ht_upsert_hashed(ht, word, len, h, &created);
+}
+
+lch_value_t* ht_increment(lch_hmap_t* ht, const char* word, size_t len, long delta)
+{
+    bool created;
+    lch_value_t* v = _ht_upsert_hashed(ht, word, len, ht->hfn(word, len), &created);
+    if (v)
+        v->l += delta;
+    return v;
+}
+
+lch_value_t* ht_upsert(lch_hmap_t* ht, const char* word, size_t len,
+        void (*init_fn) (lch_value_t*, void*),
+        void (*update_fn) (lch_value_t*, void*), void* arg)
+{
+    bool created;
+    lch_value_t* v = _ht_upsert_hashed(ht, word, len, ht->hfn(word, len), &created);
+    if (!v)
+        return NULL;
+    if (created) {
+        if (init_fn)
+            init_fn(v, arg);
+    }
+    else if (update_fn)
+        update_fn(v, arg);
+    return v;
+}
+
+int ht_merge(lch_hmap_t* dst, lch_hmap_t* src,
+        void (*combine_fn) (lch_value_t* dst_val, lch_value_t src_val))
+{
+    if (dst == src || src->n == 0)
+        return 0;
+    /* The entries are moved as they are, so they must look the same */
+    if (dst->borrowed != src->borrowed || dst->value_size != src->value_size
+            || dst->expiry != src->expiry)
+        return -1;
+    /* and their buckets must not be shared */
+    _ht_snap_collect(dst);
+    _ht_snap_collect(src);
+    if (dst->snap || src->snap)
+        return -1;
+    /* Grow once, to what the 0.75 factor needs for all the entries */
+    uint64_t total = (uint64_t) dst->n + src->n;
+    if (total > (3*(uint64_t) dst->size >> 2)
+            && _ht_rehash(dst, total > UINT32_MAX / 4 * 3 ? UINT32_MAX : total * 4 / 3 + 1) < 0)
+        return -1;
+    bool same_hfn = dst->hfn == src->hfn;
+
+    /* In the insertion order of src, which goes after that of dst */
+    lch_hmap_entry_t* e = src->first;
+    for (unsigned int k = src->n; k > 0; --k) {
+        lch_hmap_entry_t* next = e->newer;
+        const char* key = _ht_key(src, e);
+        size_t len = e->key_len;
+        if (!same_hfn)
+            e->hash = dst->hfn(key, len);
+        lch_hmap_bucket* b = ht_hash_to_bucket(dst, e->hash);
+        lch_hmap_entry_t* t = NULL;
+        if (!_ht_bloom_miss(dst, e->hash)) {
+            for (t = b->e; t; t = t->next) {
+                if (_ht_entry_match(dst, t, key, len, e->hash))
+                    break;
+            }
+        }
+        if (t) {
+            if (combine_fn)
+                combine_fn(&t->val, _ht_val_arg(src, e));
+            free(e);
         }
         else {
-            e->older = e;
-            e->newer = e;
-            ht->first = e;
+            e->epoch = dst->epoch;
+            _ht_insert_entry(dst, b, e);
+            if (dst->bloom)
+                _ht_bloom_add(dst, e->hash);
+            _ht_link_newest(dst, e);
+            if (dst->expiry && _ht_ttl(dst, e)->deadline != 0)
+                ss_pairing_insert(&dst->deadlines, &_ht_ttl(dst, e)->node);
         }
+        e = next;
     }
+    dst->generation++;
 
-    return &e->val;
+    for (uint32_t p = 0; p < HASH_PAGES(src); ++p)
+        memset(src->pages[p], 0, LCH_PAGE_BUCKETS * sizeof **src->pages);
+    src->n = 0;
+    src->first = NULL;
+    src->generation++;
+    if (src->bloom) {
+        memset(src->bloom, 0, src->bloom_blocks * sizeof *src->bloom);
+        src->bloom_deleted = 0;
+    }
+    if (src->expiry)
+        ss_pairing_init(&src->deadlines, src->deadlines.compar);
+    return 0;
+}
+
+bool ht_set_borrowed_keys(lch_hmap_t* ht, bool enabled)
+{
+    if (ht->n > 0)
+        return ht->borrowed == enabled;
+    ht->borrowed = enabled;
+    return true;
+}
+
+/**********************************************************
+ *  Expiry
+ *********************************************************/
+
+static int _ht_ttl_cmp(ss_pairing_node* a, ss_pairing_node* b)
+{
+    uint64_t da = container_of(a, lch_ttl_t, node)->deadline;
+    uint64_t db = container_of(b, lch_ttl_t, node)->deadline;
+    return da < db ? -1 : da > db;
+}
+
+bool ht_enable_expiry(lch_hmap_t* ht, void (*destroy_val_fn) (lch_value_t))
+{
+    if (!ht->expiry) {
+        if (ht->n > 0)
+            return false;
+        /* Room for the deadline before the key */
+        ht->expiry = true;
+        ht->ttl_offset = ht->key_offset;
+        ht->key_offset += sizeof(lch_ttl_t);
+        ss_pairing_init(&ht->deadlines, _ht_ttl_cmp);
+    }
+    ht->expired_val_fn = destroy_val_fn;
+    return true;
+}
+
+bool ht_set_deadline(lch_hmap_t* ht, const char* word, size_t len, uint64_t deadline)
+{
+    if (!ht->expiry)
+        return false;
+    /* ht_get_hashed copies the entry if the snapshot shares it */
+    lch_value_t* v = ht_get_hashed(ht, word, len, ht->hfn(word, len));
+    if (v == NULL)
+        return false;
+    lch_hmap_entry_t* e = container_of(v, lch_hmap_entry_t, val);
+    lch_ttl_t* t = _ht_ttl(ht, e);
+    if (t->deadline != 0)
+        ss_pairing_delete(&ht->deadlines, &t->node);
+    t->deadline = deadline;
+    if (deadline != 0)
+        ss_pairing_insert(&ht->deadlines, &t->node);
+    return true;
+}
+
+size_t ht_expire(lch_hmap_t* ht, uint64_t now, size_t max_work)
+{
+    if (!ht->expiry)
+        return 0;
+    if (now > ht->now)
+        ht->now = now;
+    _ht_snap_collect(ht);
+    size_t n = 0;
+    for (; n < max_work; ++n) {
+        ss_pairing_node* min = ss_pairing_find_min(&ht->deadlines);
+        if (min == NULL || container_of(min, lch_ttl_t, node)->deadline > ht->now)
+            break;
+        if (_ht_expire_entry(ht, (lch_hmap_entry_t*) ((char*) min - ht->ttl_offset)) < 0)
+            break;
+    }
+    return n;
 }
 
 bool ht_contains(lch_hmap_t* ht, const char* word)
 {
-    return ht_get(ht, word) != NULL;
+    size_t len = strlen(word);
+    return _ht_find(ht, word, len, ht->hfn(word, len)) != NULL;
+}
+
+/**********************************************************
+ *  Snapshots
+ *********************************************************/
+
+lch_hmap_snapshot_t* ht_snapshot(lch_hmap_t* ht)
+{
+    _ht_snap_collect(ht);
+    if (ht->snap) {
+        errno = EBUSY;
+        return NULL;
+    }
+    lch_hmap_snapshot_t* s = calloc(1, sizeof *s);
+    if (!s) {
+        perror("ht_snapshot");
+        return NULL;
+    }
+    s->view = *ht;
+    /* All that is there now becomes shared */
+    ht->snap = s;
+    ht->epoch++;
+    return s;
+}
+
+const lch_value_t* ht_snapshot_get(lch_hmap_snapshot_t* s, const char* word)
+{
+    lch_hmap_t* ht = &s->view;
+    size_t len = strlen(word);
+    uint32_t h = ht->hfn(word, len);
+    for (lch_hmap_entry_t* e = ht_hash_to_bucket(ht, h)->e; e; e = e->next) {
+        if (_ht_entry_match(ht, e, word, len, h))
+            return _ht_expired(ht, e) ? NULL : &e->val;
+    }
+    return NULL;
+}
+
+void ht_snapshot_traverse(lch_hmap_snapshot_t* s,
+        int (*action) (lch_key_t, lch_value_t, void*), void* arg)
+{
+    lch_hmap_t* ht = &s->view;
+    lch_hmap_bucket* he;
+    for_each_lch_bucket(ht,he) {
+        for (lch_hmap_entry_t* e = he->e; e; e = e->next) {
+            if (_ht_expired(ht, e))
+                continue;
+            if (action((lch_key_t) _ht_key(ht, e), _ht_val_arg(ht, e), arg) < 0)
+                return;
+        }
+    }
+}
+
+void ht_snapshot_release(lch_hmap_snapshot_t* s)
+{
+    /* The map frees it at its next change, in its own thread */
+    __atomic_store_n(&s->released, 1, __ATOMIC_RELEASE);
 }
 
@@ -6,6 +6,22 @@ extern "C" {
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+
+#include "pgalloc.h"
+
+    /*
+     * The interface of the chained hashmap of lch_hmap.c, which lch_hmap2,
+     * lch_hmap3 and lch_hmap4 implement with other layouts, but not all
+     * of it. Where a feature is missing, the call that enables it fails
+     * and the others do nothing:
+     *
+     *   Bloom filter (ht_set_bloom)            not in lch_hmap2, lch_hmap3, lch_hmap4
+     *   borrowed keys (ht_set_borrowed_keys)   not in lch_hmap3, lch_hmap4
+     *   sized values (ht_create_sized)         not in lch_hmap3, lch_hmap4
+     *   expiry (ht_enable_expiry)              not in lch_hmap2, lch_hmap3, lch_hmap4
+     *   snapshots (ht_snapshot)                not in lch_hmap2, lch_hmap3, lch_hmap4
+     */
 
     /*
      * the type of the keys : C strings
@@ -25,10 +41,14 @@ extern "C" {
         unsigned int nbr_elems;
         unsigned int capacity;
         unsigned int max_bucket_size;
-        unsigned long long generation;
+        unsigned long long generation; /* changes when keys are added or removed */
+        size_t value_size; /* 0 for a plain lch_value_t, see ht_create_sized */
+        bool borrowed; /* see ht_set_borrowed_keys */
+        const char* hfn_name; /* NULL if not one of hfn.h functions */
     } lch_hmap_stats_t;
 
     typedef struct lch_hmap lch_hmap_t;
+    typedef struct lch_hmap_snapshot lch_hmap_snapshot_t;
     /*
      * Creates a new chained hashmap, with the initial_size given
      * and the provided hash function
@@ -36,6 +56,39 @@ extern "C" {
     lch_hmap_t* ht_create(uint32_t initial_size, 
             uint32_t (*hfn_t)(const char*, size_t));
 
+    /*
+     * Same as ht_create, but the buckets are allocated with the given
+     * policy (see pgalloc.h), e.g. on huge pages or interleaved over
+     * NUMA nodes: for big maps, whose lookups would otherwise miss the
+     * TLB almost every time. The entries are allocated as usual
+     */
+    lch_hmap_t* ht_create_ex(uint32_t initial_size,
+            uint32_t (*hfn_t)(const char*, size_t), const pg_policy_t* policy);
+
+    /*
+     * Same as ht_create_ex, but each key gets a (zeroed) value of
+     * value_size bytes inside its entry, instead of an lch_value_t: a
+     * struct too big for an lch_value_t then needs no malloc of its own
+     * and no pointer to follow. The lch_value_t* that ht_get, ht_put etc
+     * return points to that value, aligned as an lch_value_t, to be cast
+     * to the caller's type; the lch_value_t that ht_traverse, combine_fn
+     * and destroy_val_fn get has `p` pointing to it. Returns NULL with
+     * errno set to EINVAL also if value_size is not supported (any but 0,
+     * in the maps without sized values)
+     */
+    lch_hmap_t* ht_create_sized(uint32_t initial_size,
+            uint32_t (*hfn_t)(const char*, size_t), const pg_policy_t* policy,
+            size_t value_size);
+
+    /*
+     * Creates a new chained hashmap, with the initial_size given
+     * and the hash function of hfn.h that best fits the sample of
+     * keys provided (see hfn_select). The chosen function is reported
+     * by ht_stats
+     */
+    lch_hmap_t* ht_create_auto(uint32_t initial_size,
+            const char** sample_keys, size_t n);
+
     /*
      * Returns the current "load factor" of the hashmap
      */
@@ -47,17 +100,116 @@ extern "C" {
 
     /*
      * Finds the entry with the given key.
-     * Returns NULL if not found
+     * Returns NULL if not found. The value returned, here and by
+     * ht_put, must not be used after the next insertion: lch_hmap2
+     * moves the values as keys are added, and lch_hmap3 and lch_hmap4
+     * reallocate their tables. Nor after ht_snapshot, as the map then
+     * copies the entry before changing it
      */
     lch_value_t* ht_get(lch_hmap_t* ht, const char* word);
 
     /*
      * Inserts a new key in the hashmap and returns the 
      * inserted lch_value_t. If the key exists already
-     * it returns the existing value
+     * it returns the existing value. As with ht_get, the
+     * value is valid until the next insertion only
      */
     lch_value_t* ht_put(lch_hmap_t* ht, const char* word);
 
+    /*
+     * Same as ht_get and ht_put but for a key of `len` bytes that need
+     * not be NUL terminated (e.g. a window in a larger text), whose hash
+     * `h` has been computed already by the caller. `h` must be what the
+     * map's hash function returns for the key: e.g. the Rabin-Karp
+     * hashes of hfn_roll_t are equal to h31_hash of the window.
+     */
+    lch_value_t* ht_get_hashed(lch_hmap_t* ht, const char* word, size_t len, uint32_t h);
+    lch_value_t* ht_put_hashed(lch_hmap_t* ht, const char* word, size_t len, uint32_t h);
+
+    /*
+     * Adds `delta` to the (long) value of the key of `len` bytes,
+     * inserting the key with a value of 0 first if it is missing, and
+     * returns the value. E.g. ht_increment(ht, word, strlen(word), 1)
+     * counts words. The key is hashed and looked up once
+     */
+    lch_value_t* ht_increment(lch_hmap_t* ht, const char* word, size_t len, long delta);
+
+    /*
+     * Looks up the key of `len` bytes once and, if it is missing,
+     * inserts it with a zeroed value and calls init_fn on the value,
+     * else calls update_fn on the existing value (either can be NULL).
+     * `arg` is passed to both. Returns the value, or NULL if the key
+     * cannot be inserted
+     */
+    lch_value_t* ht_upsert(lch_hmap_t* ht, const char* word, size_t len,
+            void (*init_fn) (lch_value_t*, void*),
+            void (*update_fn) (lch_value_t*, void*), void* arg);
+
+    /*
+     * Moves all the entries of src to dst, leaving src empty but usable.
+     * For keys in both maps dst keeps its entry, and combine_fn (if not
+     * NULL) gets its value and the value from src, e.g. to add counts.
+     * Entries are relinked rather than copied, their cached hashes are
+     * reused if both maps have the same hash function, and dst grows
+     * once up front. Returns 0, or -1 if dst ran out of memory (then
+     * nothing was moved; in lch_hmap3 and lch_hmap4 the entries not
+     * moved yet are still in src), or only one of the two maps has
+     * borrowed keys (see ht_set_borrowed_keys) or expiry (see
+     * ht_enable_expiry), or their value sizes differ, or either has a
+     * snapshot (see ht_snapshot)
+     */
+    int ht_merge(lch_hmap_t* dst, lch_hmap_t* src,
+            void (*combine_fn) (lch_value_t* dst_val, lch_value_t src_val));
+
+    /*
+     * Enables (or disables) a Bloom filter in front of the buckets, so
+     * that most lookups of keys that are not in the map return without
+     * touching any entry, at about 10 bits per key. It is worth it when
+     * misses are frequent or the chains are long. Returns false if it
+     * cannot be enabled (out of memory, or not supported)
+     */
+    bool ht_set_bloom(lch_hmap_t* ht, bool enabled);
+
+    /*
+     * Makes the map keep the pointers to the keys it is given instead of
+     * copies of them ("borrowed" keys): e.g. words in a file read or
+     * mmap'ed in memory, or in an arena, that outlive the map. Adding a
+     * key then copies no bytes, and destroying the map frees none. The
+     * map stores the pointer and the length, so the keys need not be NUL
+     * terminated, but ht_traverse passes the pointers as they were given.
+     * Only an empty map can change mode. Returns false if it cannot (the
+     * map is not empty, or it is not supported)
+     */
+    bool ht_set_borrowed_keys(lch_hmap_t* ht, bool enabled);
+
+    /*
+     * Lets the entries of an empty map have deadlines, e.g. for a cache
+     * of sessions: entries whose deadline has passed are removed lazily
+     * when a lookup finds them, and in bounded slices by ht_expire, in
+     * deadline order, so the work follows the number of expiring keys
+     * rather than the size of the map. The values of the removed entries
+     * are passed to destroy_val_fn (if not NULL). It costs 32 bytes per
+     * entry. Returns false if the map is not empty, or it is not
+     * supported
+     */
+    bool ht_enable_expiry(lch_hmap_t* ht, void (*destroy_val_fn) (lch_value_t));
+
+    /*
+     * Sets the deadline of the key of `len` bytes, in the caller's time
+     * unit (e.g. ms since some epoch), or clears it if 0. Returns false
+     * if the key is not in the map or the map has no expiry
+     */
+    bool ht_set_deadline(lch_hmap_t* ht, const char* word, size_t len, uint64_t deadline);
+
+    /*
+     * Advances the clock of the map to `now` (it never goes back) and
+     * removes up to max_work of the entries whose deadline is `now` or
+     * earlier. Lookups treat entries as expired by this clock, so even
+     * ht_expire(ht, now, 0) makes a difference. Returns the number of
+     * entries removed
+     */
+    size_t ht_expire(lch_hmap_t* ht, uint64_t now, size_t max_work);
+
     /*
      * Checks if the given key is contained in the hashmap
      */
@@ -66,12 +218,49 @@ extern "C" {
     void ht_traverse(lch_hmap_t* ht, 
             int (*action) (lch_key_t, lch_value_t, void*), void* arg);
 
+    /*
+     * Like ht_traverse, in insertion order. lch_hmap3 and lch_hmap4 keep
+     * no such order: they sort the entries each time, in O(n log n) and
+     * n pointers
+     */
     void ht_traverse_ordered(lch_hmap_t* ht, 
             int (*action) (lch_key_t, lch_value_t, void*), void* arg);
 
     void ht_clear(lch_hmap_t* ht, 
         void (*destroy_val_fn) (lch_value_t));
 
+    /*
+     * Takes a read-only snapshot of the map in O(1), e.g. for another
+     * thread to save while this one keeps changing the map. The snapshot
+     * shares the buckets and the entries with the map, which copies them
+     * before it changes them: so ht_get and ht_put (and ht_increment,
+     * ht_upsert) copy the entry of a key that the snapshot shares, and
+     * return NULL if out of memory for it. Values are copied as bytes:
+     * what they point to is shared, so the values that ht_clear and
+     * expiry remove are passed to their destroy_val_fn only once the
+     * snapshot is released. The map does not grow while the snapshot
+     * lives. There can be one snapshot at a time: returns NULL with errno
+     * set to EBUSY if there is one already, to ENOMEM if out of memory,
+     * or to ENOTSUP if not supported
+     */
+    lch_hmap_snapshot_t* ht_snapshot(lch_hmap_t* ht);
+
+    /*
+     * Lookup and traversal (in no particular order) of the snapshot,
+     * which can be done in another thread than that of the map
+     */
+    const lch_value_t* ht_snapshot_get(lch_hmap_snapshot_t* s, const char* word);
+    void ht_snapshot_traverse(lch_hmap_snapshot_t* s,
+            int (*action) (lch_key_t, lch_value_t, void*), void* arg);
+
+    /*
+     * Releases the snapshot, from any thread. The map frees it (and the
+     * entries and buckets that only it had) at its next change, so it
+     * must be released before the map is destroyed: ht_destroy aborts
+     * otherwise
+     */
+    void ht_snapshot_release(lch_hmap_snapshot_t* s);
+
     /*
      * Destroys/deallocates the hashmap. If destroy_val_fn is not NULL
      * it is called for each lch_value_t in the hashmap
@@ -4,45 +4,156 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <errno.h>
 
 #include "lch_hmap.h"
+#include "hfn.h"
 
+/*
+ * A "compact" ordered hashmap, after the dict of Python 3.6: the
+ * entries are kept in a dense array in insertion order, and the hash
+ * table is just an index of small integers into it (1, 2 or 4 bytes
+ * each depending on its size), probed as in lch_hmap3. Ordered
+ * traversal is then a scan of the array, and an entry costs no links.
+ *
+ * A deleted entry leaves a hole in the array (its key is NULL) and a
+ * LCH_IX_DUMMY in the index, for the probes to go on. The holes are
+ * removed when the array is full and the index is rebuilt, so values
+ * move when keys are added: the pointers returned by ht_get and ht_put
+ * are valid only until the next insertion.
+ */
 typedef struct {
-    char* key;
-    lch_value_t val;
+    char* key; /* NULL for the hole of a deleted entry */
     uint32_t hash; /* the hash of the key, cached */
+    uint32_t len; /* of the key, which may be borrowed */
+    lch_value_t val; /* the first bytes of a bigger value, see ht_create_sized */
 } lch_hmap_entry_t;
 
-#define LCH_BIN_SIZE 5
-typedef struct lch_hmap_bucket {
-    struct lch_hmap_bucket* next;
-    unsigned int len; /* how many of the LCH_BIN_SIZE are used */
-    lch_hmap_entry_t entries[LCH_BIN_SIZE];
-} lch_hmap_bucket_t;
+#define LCH_IX_EMPTY UINT32_MAX
+#define LCH_IX_DUMMY (UINT32_MAX - 1)
 
-#define lch_bucket_empty(b) ((b)->len == 0 && (b)->next == NULL) 
-#define lch_bucket_full(b) ((b)->len == LCH_BIN_SIZE) 
+#define LCH_MIN_SIZE 8U
 
 typedef uint32_t (*hfn_t)(const char*, size_t);
 struct lch_hmap  {
     unsigned int n; /* current number of elements (entries) */
-    uint32_t size; /* number of buckets */
-    unsigned int max_bucket_size;
+    uint32_t nentries; /* used entries in the array, holes included */
+    uint32_t entries_cap; /* allocated entries, 2/3 of the index size */
+    uint32_t size; /* number of index slots, a power of 2 */
+    unsigned int ix_width; /* bytes per index slot */
+    unsigned int max_bucket_size; /* the longest probe sequence */
+    bool borrowed; /* keys are the caller's, see ht_set_borrowed_keys */
+    size_t value_size; /* 0 for a plain lch_value_t */
+    size_t entry_size; /* the stride of the array, with the value */
     unsigned long long generation;
     hfn_t hfn;
-    lch_hmap_bucket_t** table;  /* pointers to buckets */
+    pg_policy_t policy; /* of the index and the entries */
+    void* index;
+    lch_hmap_entry_t* entries;
 };
 
-#define for_each_lch_bucket(ht,bkt) \
-    for(bkt=(ht)->table;bkt!=(ht)->table+HASH_SIZE(ht);bkt++)
+#define HASH_SIZE(ht) ((ht)->size)
+#define _ht_entry(ht,i) ((lch_hmap_entry_t*) ((char*) (ht)->entries + (size_t) (i) * (ht)->entry_size))
+#define _ht_value_bytes(ht) ((ht)->entry_size - offsetof(lch_hmap_entry_t, val))
+#define lch_usable(size) ((size) / 3 * 2 + (size) % 3 * 2 / 3)
+
+static unsigned int _ix_width_for(uint32_t size)
+{
+    /* The two largest values of a width are EMPTY and DUMMY */
+    if (size <= 0xFE)
+        return 1;
+    if (size <= 0xFFFE)
+        return 2;
+    return 4;
+}
+
+static inline uint32_t _ix_get(const lch_hmap_t* ht, uint32_t i)
+{
+    uint32_t v;
+    switch (ht->ix_width) {
+        case 1:
+            v = ((const uint8_t*) ht->index)[i];
+            return v >= 0xFE ? v | 0xFFFFFF00U : v;
+        case 2:
+            v = ((const uint16_t*) ht->index)[i];
+            return v >= 0xFFFE ? v | 0xFFFF0000U : v;
+        default:
+            return ((const uint32_t*) ht->index)[i];
+    }
+}
+
+static inline void _ix_set(lch_hmap_t* ht, uint32_t i, uint32_t v)
+{
+    /* Truncation keeps EMPTY and DUMMY the largest values of the width */
+    switch (ht->ix_width) {
+        case 1: ((uint8_t*) ht->index)[i] = (uint8_t) v; break;
+        case 2: ((uint16_t*) ht->index)[i] = (uint16_t) v; break;
+        default: ((uint32_t*) ht->index)[i] = v; break;
+    }
+}
+
+/* The bytes of a value, rounded up so that the next entry is aligned */
+#define _ht_value_room(value_size) \
+    ((value_size) > sizeof(lch_value_t) \
+     ? ((value_size) + sizeof(lch_value_t) - 1) / sizeof(lch_value_t) * sizeof(lch_value_t) \
+     : sizeof(lch_value_t))
+
+/* What the callbacks get for the value: itself, or a pointer to it */
+static inline lch_value_t _ht_val_arg(const lch_hmap_t* ht, lch_hmap_entry_t* e)
+{
+    if (ht->value_size == 0)
+        return e->val;
+    return (lch_value_t) { .p = &e->val };
+}
+
+/* Does the (not necessarily NUL terminated) word match the entry's key? */
+#define _ht_entry_match(e,word,len,h) \
+    ((h) == (e)->hash && (len) == (e)->len && memcmp((e)->key, (word), (len)) == 0)
 
-#define for_each_lch_bucket_entry(bkt, e) \
-      for(lch_hmap_bucket_t* __bkt2=(bkt); __bkt2; __bkt2=__bkt2->next)\
-        for(e=__bkt2->entries;e!=__bkt2->entries+__bkt2->len;++e)
+/*
+ * Probes the index for the key: returns its slot, or UINT32_MAX if not
+ * found and then `*empty` is the first empty or dummy slot on the way,
+ * reached after `*probes` probes
+ */
+static uint32_t _ht_probe(lch_hmap_t* ht, const char* word, size_t len, uint32_t h,
+        uint32_t* empty, unsigned int* probes)
+{
+    uint32_t mask = ht->size - 1;
+    uint32_t i = fmix32(h) & mask;
+    uint32_t first_free = UINT32_MAX;
+    /* A third of the slots at least are EMPTY, so this ends */
+    for (uint32_t k = 1; ; ++k) {
+        uint32_t ix = _ix_get(ht, i);
+        if (ix >= LCH_IX_DUMMY) {
+            if (first_free == UINT32_MAX) {
+                first_free = i;
+                if (probes)
+                    *probes = k;
+            }
+            if (ix == LCH_IX_EMPTY)
+                break;
+        }
+        else if (_ht_entry_match(_ht_entry(ht, ix), word, len, h)) {
+            return i;
+        }
+        /* Triangular numbers: all the slots are visited */
+        i = (i + k) & mask;
+    }
+    if (empty)
+        *empty = first_free;
+    return UINT32_MAX;
+}
 
-#define for_each_lch_entry(h, bkt, e) \
-    for_each_lch_bucket(ht,bkt)\
-        for_each_lch_bucket_entry(bkt,e)
+/* The first EMPTY slot for the hash, in an index without dummies */
+static uint32_t _ht_probe_empty(lch_hmap_t* ht, uint32_t h, unsigned int* probes)
+{
+    uint32_t mask = ht->size - 1;
+    uint32_t i = fmix32(h) & mask, k = 1;
+    while (_ix_get(ht, i) != LCH_IX_EMPTY)
+        i = (i + k++) & mask;
+    *probes = k;
+    return i;
+}
 
 lch_hmap_stats_t ht_stats(lch_hmap_t* h)
 {
@@ -50,204 +161,182 @@ lch_hmap_stats_t ht_stats(lch_hmap_t* h)
         .capacity = h->size,
         .nbr_elems = h->n,
         .max_bucket_size = h->max_bucket_size,
-        .generation = h->generation
+        .generation = h->generation,
+        .value_size = h->value_size,
+        .borrowed = h->borrowed,
+        .hfn_name = hfn_name(h->hfn)
     };
     return t;
 }
 
-#define HASH_SIZE(ht) ((ht)->size)
-
-#define _HSH_P0 5U
-#define _HSH_P1 11U
-#define _HSH_P2 23U
-#define _HSH_P3 47U
-#define _HSH_P4 97U
-#define _HSH_P5 199U
-#define _HSH_P6 409U
-#define _HSH_P7 823U
-#define _HSH_P8 1741U
-#define _HSH_P9 3469U
-#define _HSH_P10 6949U
-#define _HSH_P11 14033U
-#define _HSH_P12 28411U
-#define _HSH_P13 57557U
-#define _HSH_P14 116731U
-#define _HSH_P15 236897U
-#define _HSH_P16 480881U
-#define _HSH_P17 976369U
-#define _HSH_P18 1982627U
-#define _HSH_P19 4026031U
-#define _HSH_P20 8175383U
-#define _HSH_P21 16601593U
-#define _HSH_P22 33712729U
-#define _HSH_P23 68460391U
-#define _HSH_P24 139022417U
-#define _HSH_P25 282312799U
-#define _HSH_P26 573292817U
-#define _HSH_P27 1164186217U
-#define _HSH_P28 2364114217U
-#define _HSH_P29 4294967291U
-
-static uint32_t _primes[] = {
-    _HSH_P0,
-    _HSH_P1,
-    _HSH_P2,
-    _HSH_P3,
-    _HSH_P4,
-    _HSH_P5,
-    _HSH_P6,
-    _HSH_P7,
-    _HSH_P8,
-    _HSH_P9,
-    _HSH_P10,
-    _HSH_P11,
-    _HSH_P12,
-    _HSH_P13,
-    _HSH_P14,
-    _HSH_P15,
-    _HSH_P16,
-    _HSH_P17,
-    _HSH_P18,
-    _HSH_P19,
-    _HSH_P20,
-    _HSH_P21,
-    _HSH_P22,
-    _HSH_P23,
-    _HSH_P24,
-    _HSH_P25,
-    _HSH_P26,
-    _HSH_P27,
-    _HSH_P28,
-    _HSH_P29,
-    0U
-};
-
-#define _primes_len (sizeof(_primes)/sizeof(_primes[0])-1)
-
-/* See "A fast alternative to the modulo reduction":
- * lemire.me/blog/2016/06/27/a-fast-alternative-to-the-modulo-reduction/
- */
-#define lch_fast_mod32(x,N) (((uint64_t) (x) * (uint64_t) (N)) >> 32)
-
-static uint32_t mod_hash_size(lch_hmap_t* ht, uint32_t k)
-{
-    switch (ht->size) {
-        case _HSH_P0:  return k % _HSH_P0; 
-        case _HSH_P1:  return k % _HSH_P1; 
-        case _HSH_P2:  return k % _HSH_P2; 
-        case _HSH_P3:  return k % _HSH_P3; 
-        case _HSH_P4:  return k % _HSH_P4; 
-        case _HSH_P5:  return k % _HSH_P5; 
-        case _HSH_P6:  return k % _HSH_P6; 
-        case _HSH_P7:  return k % _HSH_P7; 
-        case _HSH_P8:  return k % _HSH_P8; 
-        case _HSH_P9:  return k % _HSH_P9; 
-        case _HSH_P10: return k %_HSH_P10; 
-        case _HSH_P11: return k %_HSH_P11; 
-        case _HSH_P12: return k %_HSH_P12; 
-        case _HSH_P13: return k %_HSH_P13; 
-        case _HSH_P14: return k %_HSH_P14; 
-        case _HSH_P15: return k %_HSH_P15; 
-        case _HSH_P16: return k %_HSH_P16; 
-        case _HSH_P17: return k %_HSH_P17; 
-        case _HSH_P18: return k %_HSH_P18; 
-        case _HSH_P19: return k %_HSH_P19; 
-        case _HSH_P20: return k %_HSH_P20; 
-        case _HSH_P21: return k %_HSH_P21; 
-        case _HSH_P22: return k %_HSH_P22; 
-        case _HSH_P23: return k %_HSH_P23; 
-        case _HSH_P24: return k %_HSH_P24; 
-        case _HSH_P25: return k %_HSH_P25; 
-        case _HSH_P26: return k %_HSH_P26; 
-        case _HSH_P27: return k %_HSH_P27; 
-        case _HSH_P28: return k %_HSH_P28; 
-        case _HSH_P29: return k %_HSH_P29; 
-        default:
-                       return lch_fast_mod32(k, ht->size);
-    };
+static uint32_t _ht_size_for(uint64_t n)
+{
+    uint32_t size = LCH_MIN_SIZE;
+    while (lch_usable(size) < n && size < (1U << 31))
+        size <<= 1;
+    return size;
 }
-#define ht_hash_to_bucket(ht,h)  ((ht)->table[mod_hash_size((ht), (h))])
 
-static uint32_t _next_prime_for_expand(uint32_t minSize)
+/*
+ * Moves the live entries to the front of the array (keeping their
+ * order) and builds an index of new_size slots for them. Returns -1,
+ * changing nothing, if out of memory
+ */
+static int _ht_resize(lch_hmap_t* ht, uint32_t new_size)
 {
-    uint32_t* p;
+    unsigned int width = _ix_width_for(new_size);
+    uint32_t cap = lch_usable(new_size);
+    if (cap < ht->n)
+        return -1;
+    void* index = pg_alloc((size_t) new_size * width, &ht->policy);
+    if (index == NULL) {
+        perror("ht_resize");
+        return -1;
+    }
+    if (cap > ht->entries_cap) {
+        lch_hmap_entry_t* entries = pg_realloc(ht->entries,
+                (size_t) ht->entries_cap * ht->entry_size,
+                (size_t) cap * ht->entry_size, &ht->policy);
+        if (entries == NULL) {
+            perror("ht_resize");
+            pg_free(index, (size_t) new_size * width, &ht->policy);
+            return -1;
+        }
+        ht->entries = entries;
+    }
 
-    for (p=_primes; *p && *p < minSize; ++p);
-    return (*p ? *p : _primes[_primes_len - 1]);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < ht->nentries; ++i) {
+        if (_ht_entry(ht, i)->key) {
+            if (n != i)
+                memcpy(_ht_entry(ht, n), _ht_entry(ht, i), ht->entry_size);
+            ++n;
+        }
+    }
+    assert(n == ht->n);
+
+    if (ht->index)
+        pg_free(ht->index, (size_t) ht->size * ht->ix_width, &ht->policy);
+    ht->index = index;
+    ht->size = new_size;
+    ht->ix_width = width;
+    memset(index, 0xFF, (size_t) new_size * width);
+    ht->max_bucket_size = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        unsigned int probes;
+        _ix_set(ht, _ht_probe_empty(ht, _ht_entry(ht, i)->hash, &probes), i);
+        if (probes > ht->max_bucket_size)
+            ht->max_bucket_size = probes;
+    }
+    ht->nentries = n;
+
+    if (cap < ht->entries_cap) {
+        /* If it cannot shrink, the array is just bigger than needed */
+        lch_hmap_entry_t* entries = pg_realloc(ht->entries,
+                (size_t) ht->entries_cap * ht->entry_size,
+                (size_t) cap * ht->entry_size, &ht->policy);
+        if (entries == NULL)
+            return 0;
+        ht->entries = entries;
+    }
+    ht->entries_cap = cap;
+    return 0;
 }
 
-lch_hmap_t* ht_create(uint32_t initial_size, hfn_t hfn)
+lch_hmap_t* ht_create_sized(uint32_t initial_size, hfn_t hfn,
+        const pg_policy_t* policy, size_t value_size)
 {
     lch_hmap_t *h = calloc(1U, sizeof *h);
     if (!h) {
         perror("ht_create");
         return NULL;
     }
-    h->size = _next_prime_for_expand(initial_size);
     h->hfn = hfn;
-    h->table = calloc(h->size, sizeof *h->table);
-    if (h->table == NULL) {
-        perror("ht_create");
+    if (policy)
+        h->policy = *policy;
+    h->value_size = value_size;
+    h->entry_size = offsetof(lch_hmap_entry_t, val) + _ht_value_room(value_size);
+    if (_ht_resize(h, _ht_size_for(lch_usable(initial_size))) != 0) {
         free(h);
         return NULL;
     }
-    /* printf("Hashtable created with size %u\n", HASH_SIZE(h)); */
     return h;
 }
 
-static void _ht_destroy_entries(lch_hmap_bucket_t* bkt,
+lch_hmap_t* ht_create_ex(uint32_t initial_size, hfn_t hfn, const pg_policy_t* policy)
+{
+    return ht_create_sized(initial_size, hfn, policy, 0);
+}
+
+lch_hmap_t* ht_create(uint32_t initial_size, hfn_t hfn)
+{
+    return ht_create_ex(initial_size, hfn, NULL);
+}
+
+/* How far from the ideal key distribution we accept, see hfn_select */
+#define LCH_AUTO_MAX_SCORE 1.10
+
+lch_hmap_t* ht_create_auto(uint32_t initial_size,
+        const char** sample_keys, size_t n)
+{
+    uint32_t size = _ht_size_for(lch_usable(initial_size));
+    hfn_t hfn = hfn_select(sample_keys, n, size, LCH_AUTO_MAX_SCORE);
+    return ht_create(size, hfn);
+}
+
+static void _ht_destroy_entries(lch_hmap_t* ht,
         void (*destroy_val_fn) (lch_value_t))
 {
-    while(bkt) {
-        for(lch_hmap_entry_t* e=bkt->entries; e!=bkt->entries+bkt->len; ++e) {
-            if (destroy_val_fn != NULL)
-                destroy_val_fn(e->val);
+    for (uint32_t i = 0; i < ht->nentries; ++i) {
+        lch_hmap_entry_t* e = _ht_entry(ht, i);
+        if (e->key == NULL)
+            continue;
+        if (destroy_val_fn != NULL)
+            destroy_val_fn(_ht_val_arg(ht, e));
+        if (!ht->borrowed)
             free(e->key);
-            e->key = NULL;
-        }
-        bkt->len = 0;
-        bkt = bkt->next;
+        e->key = NULL;
     }
 }
 
 void ht_destroy(lch_hmap_t* ht, void (*destroy_val_fn) (lch_value_t))
 {
-    for (uint32_t i=0; i<ht->size; ++i) {
-        for(lch_hmap_bucket_t* bkt = ht->table[i]; bkt;) {
-            _ht_destroy_entries(bkt, destroy_val_fn);
-            lch_hmap_bucket_t* bnext = bkt->next;
-            free(bkt);
-            bkt = bnext;
-        }
-        ht->table[i] = NULL;
-    }
-
-    free(ht->table);
+    _ht_destroy_entries(ht, destroy_val_fn);
+    pg_free(ht->entries, (size_t) ht->entries_cap * ht->entry_size, &ht->policy);
+    pg_free(ht->index, (size_t) ht->size * ht->ix_width, &ht->policy);
     free(ht);
 }
 
+void ht_clear(lch_hmap_t* ht, void (*destroy_val_fn) (lch_value_t))
+{
+    _ht_destroy_entries(ht, destroy_val_fn);
+    memset(ht->index, 0xFF, (size_t) ht->size * ht->ix_width);
+    ht->n = 0;
+    ht->nentries = 0;
+    ht->max_bucket_size = 0;
+    ht->generation++;
+}
+
 void ht_traverse(lch_hmap_t* ht,
         int (*action) (lch_key_t, lch_value_t, void*), void* arg)
 {
     unsigned long long generation = ht->generation;
-    lch_hmap_entry_t* e;
-    for (uint32_t i=0; i<ht->size; ++i) {
-        for(lch_hmap_bucket_t* bkt = ht->table[i]; bkt; bkt = bkt->next) {
-            for_each_lch_bucket_entry(bkt, e) {
-                int w = action(e->key, e->val, arg);
-                assert(ht->generation == generation);
-                if (w < 0)
-                    return;
-            }
-        }
+    for (uint32_t i = 0; i < ht->nentries; ++i) {
+        lch_hmap_entry_t* e = _ht_entry(ht, i);
+        if (e->key == NULL)
+            continue;
+        int w = action(e->key, _ht_val_arg(ht, e), arg);
+        assert(ht->generation == generation);
+        if (w < 0)
+            return;
     }
 }
 
 void ht_traverse_ordered(lch_hmap_t* ht,
-        int (*action) (lch_key_t, lch_value_t, void*), void* arg) {
-  /* XXX : not implemented */
-  ht_traverse(ht, action, arg);
-
+        int (*action) (lch_key_t, lch_value_t, void*), void* arg)
+{
+    /* The array is in insertion order already */
+    ht_traverse(ht, action, arg);
 }
 
 float ht_load_factor(lch_hmap_t* h)
@@ -255,186 +344,243 @@ float ht_load_factor(lch_hmap_t* h)
     return h->n*1.0/HASH_SIZE(h);
 }
 
-/*
-   static lch_hmap_bucket* ht_key_to_bucket(lch_hmap_t* ht, const char* word)
-   {
-   uint32_t h = ht->hfn(word, strlen(word));
-   lch_hmap_bucket* b = ht_hash_to_bucket(ht, h);
-   return b;
-   }
-   */
-
-static lch_value_t* _ht_insert_entry(lch_hmap_bucket_t* b, uint32_t hash, char* word)
-{
-    /*
-     * There are two cases:
-     *
-     * a) either the bucket element in the hashtable has
-     *  empty space left and therefore we can add the new 
-     *  entry here, or
-     * 
-     * b) there is no space left, which means that neither of
-     *  subsequent buckets in the chain has space either, so we care a
-     *  new bucket, transfer the entries of the bucket there, and then add
-     *  the new element in the bucket.
-     */
-
-    if (lch_bucket_full(b)) {
-        lch_hmap_bucket_t* new_bkt = malloc(sizeof *new_bkt);
-        if (new_bkt == NULL) {
-            perror("malloc");
-            return NULL;
-        }
-        *new_bkt = *b;
+void ht_delete(lch_hmap_t* ht, const char* word)
+{
+    size_t len = strlen(word);
+    uint32_t slot = _ht_probe(ht, word, len, ht->hfn(word, len), NULL, NULL);
+    if (slot == UINT32_MAX)
+        return;
 
-        b->next = new_bkt;
-        b->len = 0;
-    }
-    lch_hmap_entry_t* e = b->entries + b->len;
-    e->key = word;
-    e->hash = hash;
-    b->len++;
+    lch_hmap_entry_t* e = _ht_entry(ht, _ix_get(ht, slot));
+    if (!ht->borrowed)
+        free(e->key);
+    e->key = NULL;
+    _ix_set(ht, slot, LCH_IX_DUMMY);
+    ht->n--;
+    ht->generation++;
+}
+
+lch_value_t* ht_get_hashed(lch_hmap_t* ht, const char* word, size_t len, uint32_t h)
+{
+    uint32_t slot = _ht_probe(ht, word, len, h, NULL, NULL);
+    if (slot == UINT32_MAX)
+        return NULL;
+    return &_ht_entry(ht, _ix_get(ht, slot))->val;
+}
+
+lch_value_t* ht_get(lch_hmap_t* ht, const char* word)
+{
+    size_t len = strlen(word);
+    return ht_get_hashed(ht, word, len, ht->hfn(word, len));
+}
+
+lch_value_t* ht_put(lch_hmap_t* ht, const char* word)
+{
+    size_t len = strlen(word);
+    return ht_put_hashed(ht, word, len, ht->hfn(word, len));
+}
+
+/*
+ * Appends the entry to the array, indexed at the free slot found by
+ * _ht_probe. There must be room in the array
+ */
+static lch_value_t* _ht_append(lch_hmap_t* ht, char* key, size_t len, uint32_t h,
+        uint32_t free_slot, unsigned int probes)
+{
+    assert(ht->nentries < lch_usable(ht->size));
+    lch_hmap_entry_t* e = _ht_entry(ht, ht->nentries);
+    e->key = key;
+    e->len = len;
+    e->hash = h;
+    memset(&e->val, 0, _ht_value_bytes(ht));
+    _ix_set(ht, free_slot, ht->nentries++);
+    if (probes > ht->max_bucket_size)
+        ht->max_bucket_size = probes;
+    ht->n++;
     return &e->val;
 }
 
-static void _ht_rehash(lch_hmap_t* ht)
+/*
+ * The one lookup and (if missing) insertion behind ht_put_hashed,
+ * ht_increment and ht_upsert. *created tells which of the two it was
+ */
+static lch_value_t* _ht_upsert_hashed(lch_hmap_t* ht, const char* word, size_t len,
+        uint32_t h, bool* created)
 {
-    uint32_t newSize = _next_prime_for_expand(2*HASH_SIZE(ht));
-    /* printf("Current load factor %4.2f.. (max bkt size=%u) rehashing to %u ..\n", ht_load_factor(ht), ht->max_bucket_size, newSize); */
-    lch_hmap_t* hnew = ht_create(newSize, ht->hfn);
-    if (!hnew) {
-        perror("_ht_rehash");
-        return;
+    *created = false;
+    uint32_t free_slot;
+    unsigned int probes;
+    uint32_t slot = _ht_probe(ht, word, len, h, &free_slot, &probes);
+    if (slot != UINT32_MAX)
+        return &_ht_entry(ht, _ix_get(ht, slot))->val;
+
+    if (ht->nentries >= lch_usable(ht->size)) {
+        /* Grow, or just compact if it's mostly holes */
+        if (_ht_resize(ht, _ht_size_for(2 * (uint64_t) ht->n)) != 0)
+            return NULL;
+        free_slot = _ht_probe_empty(ht, h, &probes);
     }
-    for (size_t i=0; i<ht->size; ++i) {
-        lch_hmap_bucket_t* b = ht->table[i];
-        lch_hmap_entry_t* e;
-        for_each_lch_bucket_entry(b, e) {
-            uint32_t idx = mod_hash_size(hnew, e->hash);
-            lch_hmap_bucket_t* new_bkt = hnew->table[idx];
-            if (new_bkt == NULL) {
-                new_bkt = calloc(1, sizeof *new_bkt);
-                if (new_bkt == NULL) {
-                    perror("_ht_rehash");
-                    goto rehash_end;
-                }
-                hnew->table[idx] = new_bkt;
-            }
-            lch_value_t* v = _ht_insert_entry(new_bkt, e->hash, e->key);
-            if (v == NULL)
-                /* XXX: well, here we can have done the half rehashes... */
-                goto rehash_end;
-            e->key = NULL;
-        }
 
-        lch_hmap_bucket_t* bkt=b->next;
-        while(bkt) {
-            lch_hmap_bucket_t* bnext = bkt->next;
-            free(bkt);
-            bkt = bnext;
+    char* key = (char*) word;
+    if (!ht->borrowed) {
+        key = malloc(len + 1);
+        if (key == NULL) {
+            perror("ht_put");
+            return NULL;
         }
-        b->next = NULL;
+        memcpy(key, word, len);
+        key[len] = '\0';
     }
+    ht->generation++;
+    *created = true;
+    return _ht_append(ht, key, len, h, free_slot, probes);
+}
 
-    /* adopt the new hash table */
-    lch_hmap_bucket_t** new_table = hnew->table;
-    hnew->table = ht->table;
-    ht->table = new_table;
-
-    ht->size = hnew->size;
-    ht->max_bucket_size = hnew->max_bucket_size;
-rehash_end:
-    /* ht_destroy(hnew, NULL); */
-    free(hnew->table);
+lch_value_t* ht_put_hashed(lch_hmap_t* ht, const char* word, size_t len, uint32_t h)
+{
+    bool created;
+    return _ht_upsert_hashed(ht, word, len, h, &created);
 }
 
-void ht_delete(lch_hmap_t* ht, const char* word)
+lch_value_t* ht_increment(lch_hmap_t* ht, const char* word, size_t len, long delta)
 {
-    ht->generation++;
-    uint32_t h = ht->hfn(word, strlen(word));
-    lch_hmap_bucket_t* b = ht_hash_to_bucket(ht, h);
-    if (b == NULL)
-        return;
+    bool created;
+    lch_value_t* v = _ht_upsert_hashed(ht, word, len, ht->hfn(word, len), &created);
+    if (v)
+        v->l += delta;
+    return v;
+}
 
-    /* XXX: This is not so correct yet!!! */
-    lch_hmap_entry_t* e;
-    for(lch_hmap_bucket_t* bkt=b; bkt; bkt=bkt->next) {
-        for(e=bkt->entries;e!=bkt->entries+bkt->len;++e) {
-            if (h == e->hash && strcmp(e->key, word) == 0) {
-                /* Found it!
-                 * Swap it with the last element in the b bucket
-                 */
-                lch_hmap_entry_t temp = b->entries[b->len - 1];
-                temp = *e;
-                *e = temp;
-                b->len--;
-                free(temp.key);
-                /* return &temp->val; */
-                return;
-            }
-        }
+lch_value_t* ht_upsert(lch_hmap_t* ht, const char* word, size_t len,
+        void (*init_fn) (lch_value_t*, void*),
+        void (*update_fn) (lch_value_t*, void*), void* arg)
+{
+    bool created;
+    lch_value_t* v = _ht_upsert_hashed(ht, word, len, ht->hfn(word, len), &created);
+    if (!v)
+        return NULL;
+    if (created) {
+        if (init_fn)
+            init_fn(v, arg);
     }
+    else if (update_fn)
+        update_fn(v, arg);
+    return v;
 }
 
-lch_value_t* ht_get(lch_hmap_t* ht, const char* word)
+int ht_merge(lch_hmap_t* dst, lch_hmap_t* src,
+        void (*combine_fn) (lch_value_t* dst_val, lch_value_t src_val))
 {
-    uint32_t h = ht->hfn(word, strlen(word));
-    lch_hmap_bucket_t* b = ht_hash_to_bucket(ht, h);
-    if (b == NULL)
-        return NULL;
-    lch_hmap_entry_t* e;
-    for_each_lch_bucket_entry(b,e) {
-        if (h == e->hash && strcmp(e->key, word) == 0) {
-            return &e->val;
+    if (dst == src || src->n == 0)
+        return 0;
+    /* The keys are moved as they are, and the values are copied */
+    if (dst->borrowed != src->borrowed || dst->value_size != src->value_size)
+        return -1;
+    /* Room for all of src in the array, so nothing fails once started */
+    if ((uint64_t) dst->nentries + src->n > lch_usable(dst->size)
+            && _ht_resize(dst, _ht_size_for((uint64_t) dst->n + src->n)) != 0)
+        return -1;
+    bool same_hfn = dst->hfn == src->hfn;
+
+    /* In src's order, so that the new keys keep their relative order */
+    for (uint32_t i = 0; i < src->nentries; ++i) {
+        lch_hmap_entry_t* m = _ht_entry(src, i);
+        if (m->key == NULL)
+            continue;
+        size_t len = m->len;
+        uint32_t h = same_hfn ? m->hash : dst->hfn(m->key, len);
+        uint32_t free_slot;
+        unsigned int probes;
+        uint32_t slot = _ht_probe(dst, m->key, len, h, &free_slot, &probes);
+        if (slot != UINT32_MAX) {
+            if (combine_fn)
+                combine_fn(&_ht_entry(dst, _ix_get(dst, slot))->val, _ht_val_arg(src, m));
+            if (!src->borrowed)
+                free(m->key);
         }
+        else
+            memcpy(_ht_append(dst, m->key, len, h, free_slot, probes), &m->val,
+                    _ht_value_bytes(src));
+        m->key = NULL;
     }
-    return NULL;
+    memset(src->index, 0xFF, (size_t) src->size * src->ix_width);
+    src->n = 0;
+    src->nentries = 0;
+    src->max_bucket_size = 0;
+    src->generation++;
+    dst->generation++;
+    return 0;
 }
 
+bool ht_set_bloom(lch_hmap_t* ht, bool enabled)
+{
+    /* Not supported here, a miss reads just the small index */
+    (void) ht;
+    return !enabled;
+}
 
-lch_value_t* ht_put(lch_hmap_t* ht, const char* word)
+bool ht_set_borrowed_keys(lch_hmap_t* ht, bool enabled)
 {
-    if (ht->n + 1 > (3*ht->size >> 2)) { /* Use the 0.75 factor */
-        /* We need to rehash ... */
-        _ht_rehash(ht);
-    }
-    ht->generation++;
-    uint32_t h = ht->hfn(word, strlen(word));
-    uint32_t idx = mod_hash_size(ht, h);
-    lch_hmap_bucket_t* b = ht->table[idx];
-    if (b == NULL) {
-        b = calloc(1U, sizeof (lch_hmap_bucket_t));
-        if (b == NULL) {
-            perror("ht_put");
-            return NULL;
-        }
-        ht->table[idx] = b;
-    }
+    if (ht->n > 0)
+        return ht->borrowed == enabled;
+    ht->borrowed = enabled;
+    return true;
+}
 
-    /* First search to see if the new item exists
-     * already in the hash map
-     */
-    lch_hmap_entry_t* e;
-    for_each_lch_bucket_entry(b,e) {
-        if (h == e->hash && strcmp(e->key, word) == 0) {
-            return &e->val;
-        }
-    }
+bool ht_enable_expiry(lch_hmap_t* ht, void (*destroy_val_fn) (lch_value_t))
+{
+    /* Not supported here, entries move in the array, the heap would lose them */
+    (void) ht;
+    (void) destroy_val_fn;
+    return false;
+}
 
-    char* key = strdup(word);
-    if (key == NULL) {
-        perror("strdup");
-        return NULL;
-    }
-    lch_value_t* val = _ht_insert_entry(b, h, key);
-    if (val) {
-        ht->n++;
-    }
-    return val;
+bool ht_set_deadline(lch_hmap_t* ht, const char* word, size_t len, uint64_t deadline)
+{
+    (void) ht;
+    (void) word;
+    (void) len;
+    (void) deadline;
+    return false;
+}
+
+size_t ht_expire(lch_hmap_t* ht, uint64_t now, size_t max_work)
+{
+    (void) ht;
+    (void) now;
+    (void) max_work;
+    return 0;
+}
+
+lch_hmap_snapshot_t* ht_snapshot(lch_hmap_t* ht)
+{
+    /* Not supported here, the index and the entries are arrays that an insert may reallocate */
+    (void) ht;
+    errno = ENOTSUP;
+    return NULL;
+}
+
+const lch_value_t* ht_snapshot_get(lch_hmap_snapshot_t* s, const char* word)
+{
+    (void) s;
+    (void) word;
+    return NULL;
+}
+
+void ht_snapshot_traverse(lch_hmap_snapshot_t* s,
+        int (*action) (lch_key_t, lch_value_t, void*), void* arg)
+{
+    (void) s;
+    (void) action;
+    (void) arg;
+}
+
+void ht_snapshot_release(lch_hmap_snapshot_t* s)
+{
+    (void) s;
 }
 
 bool ht_contains(lch_hmap_t* ht, const char* word)
 {
     return ht_get(ht, word) != NULL;
 }
-
@@ -0,0 +1,599 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <errno.h>
+
+#include "lch_hmap.h"
+#include "hfn.h"
+
+/*
+ * A "sparse" hashmap, after Google's sparsehash: open addressing with
+ * quadratic probing over a power of 2 number of slots, where the slots
+ * are kept in groups of LCH_GROUP_SIZE. A group has a bitmap of the
+ * slots that are used and a packed array of just those, so an empty
+ * slot costs 16 bytes / 48 = 2.7 bits. The index of a used slot in the
+ * array is the number of 1s before it in the bitmap.
+ */
+typedef struct {
+    lch_value_t val;
+    uint64_t seq; /* the order of insertion, for ht_traverse_ordered */
+    uint32_t hash; /* the hash of the key, cached */
+    uint32_t key_len;
+    char key[];
+} lch_hmap_entry_t;
+
+#define LCH_GROUP_SIZE 48
+typedef struct {
+    uint64_t bitmap;
+    lch_hmap_entry_t** entries; /* exactly as many as the bits set */
+} lch_hmap_group_t;
+
+/* The marker of the deleted slots, which have to stay used for probing */
+static lch_hmap_entry_t _ht_deleted;
+#define LCH_DELETED (&_ht_deleted)
+
+#define LCH_MIN_SIZE 32U
+
+typedef uint32_t (*hfn_t)(const char*, size_t);
+struct lch_hmap  {
+    unsigned int n; /* current number of elements (entries) */
+    unsigned int deleted; /* slots marked deleted */
+    uint32_t size; /* number of slots, a power of 2 */
+    uint32_t ngroups;
+    unsigned int max_bucket_size; /* the longest probe sequence */
+    unsigned long long generation;
+    uint64_t next_seq; /* of the next entry added */
+    hfn_t hfn;
+    pg_policy_t policy; /* of the groups */
+    lch_hmap_group_t* groups;
+};
+
+#define HASH_SIZE(ht) ((ht)->size)
+#define lch_group_of(ht,i) ((ht)->groups + (i) / LCH_GROUP_SIZE)
+#define lch_group_bit(i) (1ULL << ((i) % LCH_GROUP_SIZE))
+#define lch_group_pos(g,i) ((unsigned) __builtin_popcountll((g)->bitmap & (lch_group_bit(i) - 1)))
+
+/* The entry at slot i, NULL if empty */
+static inline lch_hmap_entry_t* _ht_slot(lch_hmap_t* ht, uint32_t i)
+{
+    lch_hmap_group_t* g = lch_group_of(ht, i);
+    if (!(g->bitmap & lch_group_bit(i)))
+        return NULL;
+    return g->entries[lch_group_pos(g, i)];
+}
+
+static inline void _ht_slot_replace(lch_hmap_t* ht, uint32_t i, lch_hmap_entry_t* e)
+{
+    lch_hmap_group_t* g = lch_group_of(ht, i);
+    g->entries[lch_group_pos(g, i)] = e;
+}
+
+/* Makes room for an entry at the empty slot i, growing the group by one */
+static int _ht_slot_set(lch_hmap_t* ht, uint32_t i, lch_hmap_entry_t* e)
+{
+    lch_hmap_group_t* g = lch_group_of(ht, i);
+    unsigned len = __builtin_popcountll(g->bitmap);
+    unsigned pos = lch_group_pos(g, i);
+    lch_hmap_entry_t** entries = realloc(g->entries, (len + 1) * sizeof *entries);
+    if (!entries) {
+        perror("ht_slot_set");
+        return -1;
+    }
+    memmove(entries + pos + 1, entries + pos, (len - pos) * sizeof *entries);
+    entries[pos] = e;
+    g->entries = entries;
+    g->bitmap |= lch_group_bit(i);
+    return 0;
+}
+
+/*
+ * Probes for the key: returns its slot, or UINT32_MAX if not found and
+ * then `*empty` is the first empty or deleted slot on the way, reached
+ * after `*probes` probes
+ */
+static uint32_t _ht_probe(lch_hmap_t* ht, const char* word, size_t len, uint32_t h,
+        uint32_t* empty, unsigned int* probes)
+{
+    uint32_t mask = ht->size - 1;
+    uint32_t i = fmix32(h) & mask;
+    uint32_t first_free = UINT32_MAX;
+    for (uint32_t k = 1; k <= ht->size; ++k) {
+        lch_hmap_entry_t* e = _ht_slot(ht, i);
+        if (e == NULL || e == LCH_DELETED) {
+            if (first_free == UINT32_MAX) {
+                first_free = i;
+                if (probes)
+                    *probes = k;
+            }
+            if (e == NULL)
+                break;
+        }
+        else if (e->hash == h && e->key_len == len && memcmp(e->key, word, len) == 0) {
+            return i;
+        }
+        /* Triangular numbers: all the slots are visited */
+        i = (i + k) & mask;
+    }
+    if (empty)
+        *empty = first_free;
+    return UINT32_MAX;
+}
+
+lch_hmap_stats_t ht_stats(lch_hmap_t* h)
+{
+    lch_hmap_stats_t t = {
+        .capacity = h->size,
+        .nbr_elems = h->n,
+        .max_bucket_size = h->max_bucket_size,
+        .generation = h->generation,
+        .hfn_name = hfn_name(h->hfn)
+    };
+    return t;
+}
+
+static lch_hmap_group_t* _ht_groups_create(uint32_t size, const pg_policy_t* policy)
+{
+    return pg_alloc((size + LCH_GROUP_SIZE - 1) / LCH_GROUP_SIZE * sizeof(lch_hmap_group_t),
+            policy);
+}
+
+static void _ht_groups_free(lch_hmap_group_t* groups, uint32_t ngroups,
+        const pg_policy_t* policy)
+{
+    pg_free(groups, ngroups * sizeof *groups, policy);
+}
+
+static uint32_t _ht_size_for(uint32_t n)
+{
+    uint32_t size = LCH_MIN_SIZE;
+    while (size < (1U << 31) && n > (3*size >> 2))
+        size <<= 1;
+    return size;
+}
+
+lch_hmap_t* ht_create_ex(uint32_t initial_size, hfn_t hfn, const pg_policy_t* policy)
+{
+    lch_hmap_t *h = calloc(1U, sizeof *h);
+    if (!h) {
+        perror("ht_create");
+        return NULL;
+    }
+    h->size = _ht_size_for(initial_size);
+    h->ngroups = (h->size + LCH_GROUP_SIZE - 1) / LCH_GROUP_SIZE;
+    h->hfn = hfn;
+    if (policy)
+        h->policy = *policy;
+    h->groups = _ht_groups_create(h->size, &h->policy);
+    if (h->groups == NULL) {
+        free(h);
+        return NULL;
+    }
+    return h;
+}
+
+lch_hmap_t* ht_create_sized(uint32_t initial_size, hfn_t hfn,
+        const pg_policy_t* policy, size_t value_size)
+{
+    /* Not supported here, the entries hold just an lch_value_t */
+    if (value_size != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return ht_create_ex(initial_size, hfn, policy);
+}
+
+lch_hmap_t* ht_create(uint32_t initial_size, hfn_t hfn)
+{
+    return ht_create_ex(initial_size, hfn, NULL);
+}
+
+#define LCH_AUTO_MAX_SCORE 1.10
+
+lch_hmap_t* ht_create_auto(uint32_t initial_size,
+        const char** sample_keys, size_t n)
+{
+    lch_hmap_t* ht = ht_create(initial_size, NULL);
+    if (!ht)
+        return NULL;
+    /* Scored on the slots the map really has */
+    ht->hfn = hfn_select(sample_keys, n, ht->size, LCH_AUTO_MAX_SCORE);
+    return ht;
+}
+
+static void _ht_destroy_groups(lch_hmap_t* ht, void (*destroy_val_fn)(lch_value_t))
+{
+    for (lch_hmap_group_t* g = ht->groups; g != ht->groups + ht->ngroups; ++g) {
+        unsigned len = __builtin_popcountll(g->bitmap);
+        for (unsigned k = 0; k < len; ++k) {
+            lch_hmap_entry_t* e = g->entries[k];
+            if (e == LCH_DELETED)
+                continue;
+            if (destroy_val_fn != NULL)
+                destroy_val_fn(e->val);
+            free(e);
+        }
+        free(g->entries);
+        g->entries = NULL;
+        g->bitmap = 0;
+    }
+}
+
+void ht_destroy(lch_hmap_t* ht, void (*destroy_val_fn) (lch_value_t))
+{
+    _ht_destroy_groups(ht, destroy_val_fn);
+    _ht_groups_free(ht->groups, ht->ngroups, &ht->policy);
+    free(ht);
+}
+
+void ht_clear(lch_hmap_t* ht, void (*destroy_val_fn) (lch_value_t))
+{
+    _ht_destroy_groups(ht, destroy_val_fn);
+    ht->n = 0;
+    ht->deleted = 0;
+    ht->max_bucket_size = 0;
+    ht->generation++;
+}
+
+void ht_traverse(lch_hmap_t* ht,
+        int (*action) (lch_key_t, lch_value_t, void*), void* arg)
+{
+    for (lch_hmap_group_t* g = ht->groups; g != ht->groups + ht->ngroups; ++g) {
+        unsigned len = __builtin_popcountll(g->bitmap);
+        for (unsigned k = 0; k < len; ++k) {
+            lch_hmap_entry_t* e = g->entries[k];
+            if (e == LCH_DELETED)
+                continue;
+            if (action(e->key, e->val, arg) < 0)
+                return;
+        }
+    }
+}
+
+static int _ht_cmp_seq(const void* a, const void* b)
+{
+    uint64_t x = (*(lch_hmap_entry_t* const*) a)->seq;
+    uint64_t y = (*(lch_hmap_entry_t* const*) b)->seq;
+    return (x > y) - (x < y);
+}
+
+/*
+ * The entries keep no list in insertion order, which would cost 16
+ * bytes each: they are sorted by their seq instead, in O(n log n) and
+ * n pointers
+ */
+void ht_traverse_ordered(lch_hmap_t* ht,
+        int (*action) (lch_key_t, lch_value_t, void*), void* arg)
+{
+    if (ht->n == 0)
+        return;
+    lch_hmap_entry_t** order = malloc(ht->n * sizeof *order);
+    if (!order) {
+        perror("ht_traverse_ordered");
+        return;
+    }
+    unsigned int n = 0;
+    for (lch_hmap_group_t* g = ht->groups; g != ht->groups + ht->ngroups; ++g) {
+        unsigned len = __builtin_popcountll(g->bitmap);
+        for (unsigned k = 0; k < len; ++k)
+            if (g->entries[k] != LCH_DELETED)
+                order[n++] = g->entries[k];
+    }
+    qsort(order, n, sizeof *order, _ht_cmp_seq);
+    for (unsigned int i = 0; i < n; ++i)
+        if (action(order[i]->key, order[i]->val, arg) < 0)
+            break;
+    free(order);
+}
+
+float ht_load_factor(lch_hmap_t* h)
+{
+    return h->n*1.0/HASH_SIZE(h);
+}
+
+/*
+ * Moves the entries to a table of `size` slots, dropping the deleted
+ * ones
+ */
+static int _ht_rehash(lch_hmap_t* ht, uint32_t size)
+{
+    lch_hmap_t hnew = *ht;
+    hnew.size = size;
+    hnew.ngroups = (size + LCH_GROUP_SIZE - 1) / LCH_GROUP_SIZE;
+    hnew.groups = _ht_groups_create(size, &ht->policy);
+    if (!hnew.groups)
+        return -1;
+    hnew.max_bucket_size = 0;
+    uint32_t mask = size - 1;
+    for (lch_hmap_group_t* g = ht->groups; g != ht->groups + ht->ngroups; ++g) {
+        unsigned len = __builtin_popcountll(g->bitmap);
+        for (unsigned k = 0; k < len; ++k) {
+            lch_hmap_entry_t* e = g->entries[k];
+            if (e == LCH_DELETED)
+                continue;
+            /* All keys are distinct: just find an empty slot */
+            uint32_t i = fmix32(e->hash) & mask, probes = 1;
+            for (uint32_t step = 1; _ht_slot(&hnew, i); ++step, ++probes)
+                i = (i + step) & mask;
+            if (_ht_slot_set(&hnew, i, e) < 0) {
+                /* Leave the entries where they were */
+                for (lch_hmap_group_t* ng = hnew.groups; ng != hnew.groups + hnew.ngroups; ++ng)
+                    free(ng->entries);
+                _ht_groups_free(hnew.groups, hnew.ngroups, &ht->policy);
+                return -1;
+            }
+            if (probes > hnew.max_bucket_size)
+                hnew.max_bucket_size = probes;
+        }
+    }
+    for (lch_hmap_group_t* g = ht->groups; g != ht->groups + ht->ngroups; ++g)
+        free(g->entries);
+    _ht_groups_free(ht->groups, ht->ngroups, &ht->policy);
+    ht->groups = hnew.groups;
+    ht->ngroups = hnew.ngroups;
+    ht->size = size;
+    ht->deleted = 0;
+    ht->max_bucket_size = hnew.max_bucket_size;
+    return 0;
+}
+
+void ht_delete(lch_hmap_t* ht, const char* word)
+{
+    size_t len = strlen(word);
+    uint32_t i = _ht_probe(ht, word, len, ht->hfn(word, len), NULL, NULL);
+    if (i == UINT32_MAX)
+        return;
+    free(_ht_slot(ht, i));
+    _ht_slot_replace(ht, i, LCH_DELETED);
+    ht->n--;
+    ht->deleted++;
+    ht->generation++;
+}
+
+lch_value_t* ht_get_hashed(lch_hmap_t* ht, const char* word, size_t len, uint32_t h)
+{
+    uint32_t i = _ht_probe(ht, word, len, h, NULL, NULL);
+    return i == UINT32_MAX ? NULL : &_ht_slot(ht, i)->val;
+}
+
+lch_value_t* ht_get(lch_hmap_t* ht, const char* word)
+{
+    size_t len = strlen(word);
+    return ht_get_hashed(ht, word, len, ht->hfn(word, len));
+}
+
+lch_value_t* ht_put(lch_hmap_t* ht, const char* word)
+{
+    size_t len = strlen(word);
+    return ht_put_hashed(ht, word, len, ht->hfn(word, len));
+}
+
+/*
+ * Adds an entry whose key is not in the map, at the free slot (and
+ * after the probes) that _ht_probe found for it, unless the map has
+ * to grow first
+ */
+static int _ht_add(lch_hmap_t* ht, lch_hmap_entry_t* e, size_t len,
+        uint32_t free_slot, unsigned int probes)
+{
+    if (ht->n + ht->deleted + 1 > (3*ht->size >> 2)) { /* Use the 0.75 factor */
+        /* Grow, unless it is the deleted slots that fill it */
+        uint32_t size = _ht_size_for(ht->n + 1);
+        if (size < ht->size)
+            size = ht->size;
+        if (_ht_rehash(ht, size) == 0)
+            _ht_probe(ht, e->key, len, e->hash, &free_slot, &probes);
+    }
+    if (free_slot == UINT32_MAX)
+        return -1;
+
+    lch_hmap_entry_t* old = _ht_slot(ht, free_slot);
+    if (old == LCH_DELETED) {
+        _ht_slot_replace(ht, free_slot, e);
+        ht->deleted--;
+    }
+    else if (_ht_slot_set(ht, free_slot, e) < 0) {
+        return -1;
+    }
+    if (probes > ht->max_bucket_size)
+        ht->max_bucket_size = probes;
+    ht->n++;
+    ht->generation++;
+    return 0;
+}
+
+/*
+ * The one lookup and (if missing) insertion behind ht_put_hashed,
+ * ht_increment and ht_upsert. *created tells which of the two it was
+ */
+static lch_value_t* _ht_upsert_hashed(lch_hmap_t* ht, const char* word, size_t len,
+        uint32_t h, bool* created)
+{
+    *created = false;
+    uint32_t free_slot;
+    unsigned int probes;
+    uint32_t i = _ht_probe(ht, word, len, h, &free_slot, &probes);
+    if (i != UINT32_MAX)
+        return &_ht_slot(ht, i)->val;
+
+    lch_hmap_entry_t* e = malloc(sizeof *e + len + 1);
+    if (!e) {
+        perror("ht_put");
+        return NULL;
+    }
+    e->val.l = 0;
+    e->seq = ht->next_seq;
+    e->hash = h;
+    e->key_len = len;
+    memcpy(e->key, word, len);
+    e->key[len] = '\0';
+
+    if (_ht_add(ht, e, len, free_slot, probes) < 0) {
+        free(e);
+        return NULL;
+    }
+    ht->next_seq++;
+    *created = true;
+    return &e->val;
+}
+
+lch_value_t* ht_put_hashed(lch_hmap_t* ht, const char* word, size_t len, uint32_t h)
+{
+    bool created;
+    return _ht_upsert_hashed(ht, word, len, h, &created);
+}
+
+lch_value_t* ht_increment(lch_hmap_t* ht, const char* word, size_t len, long delta)
+{
+    bool created;
+    lch_value_t* v = _ht_upsert_hashed(ht, word, len, ht->hfn(word, len), &created);
+    if (v)
+        v->l += delta;
+    return v;
+}
+
+lch_value_t* ht_upsert(lch_hmap_t* ht, const char* word, size_t len,
+        void (*init_fn) (lch_value_t*, void*),
+        void (*update_fn) (lch_value_t*, void*), void* arg)
+{
+    bool created;
+    lch_value_t* v = _ht_upsert_hashed(ht, word, len, ht->hfn(word, len), &created);
+    if (!v)
+        return NULL;
+    if (created) {
+        if (init_fn)
+            init_fn(v, arg);
+    }
+    else if (update_fn)
+        update_fn(v, arg);
+    return v;
+}
+
+int ht_merge(lch_hmap_t* dst, lch_hmap_t* src,
+        void (*combine_fn) (lch_value_t* dst_val, lch_value_t src_val))
+{
+    if (dst == src || src->n == 0)
+        return 0;
+    uint32_t size = _ht_size_for(dst->n + src->n);
+    if (size > dst->size && _ht_rehash(dst, size) < 0)
+        return -1;
+    bool same_hfn = dst->hfn == src->hfn;
+
+    int ret = 0;
+    for (lch_hmap_group_t* g = src->groups; g != src->groups + src->ngroups; ++g) {
+        unsigned len = __builtin_popcountll(g->bitmap);
+        for (unsigned k = 0; k < len; ++k) {
+            lch_hmap_entry_t* e = g->entries[k];
+            if (e == LCH_DELETED)
+                continue;
+            size_t key_len = e->key_len;
+            uint32_t h = same_hfn ? e->hash : dst->hfn(e->key, key_len);
+            uint32_t free_slot;
+            unsigned int probes;
+            uint32_t i = _ht_probe(dst, e->key, key_len, h, &free_slot, &probes);
+            if (i != UINT32_MAX) {
+                if (combine_fn)
+                    combine_fn(&_ht_slot(dst, i)->val, e->val);
+                free(e);
+            }
+            else {
+                uint32_t old_hash = e->hash;
+                uint64_t old_seq = e->seq;
+                e->hash = h;
+                /* After the entries of dst, in their order in src */
+                e->seq += dst->next_seq;
+                if (_ht_add(dst, e, key_len, free_slot, probes) < 0) {
+                    e->hash = old_hash;
+                    e->seq = old_seq;
+                    ret = -1;
+                    goto out;
+                }
+            }
+            /* Moved out: src stays valid if it stops halfway */
+            g->entries[k] = LCH_DELETED;
+            src->n--;
+            src->deleted++;
+        }
+    }
+    _ht_destroy_groups(src, NULL);
+    src->deleted = 0;
+    src->max_bucket_size = 0;
+out:
+    dst->next_seq += src->next_seq;
+    src->generation++;
+    return ret;
+}
+
+bool ht_set_bloom(lch_hmap_t* ht, bool enabled)
+{
+    /* Not supported here, the point is to keep the memory low */
+    (void) ht;
+    return !enabled;
+}
+
+bool ht_set_borrowed_keys(lch_hmap_t* ht, bool enabled)
+{
+    /* Not supported here, the keys are part of the entries */
+    (void) ht;
+    return !enabled;
+}
+
+bool ht_enable_expiry(lch_hmap_t* ht, void (*destroy_val_fn) (lch_value_t))
+{
+    /* Not supported here, the point is to keep the memory low */
+    (void) ht;
+    (void) destroy_val_fn;
+    return false;
+}
+
+bool ht_set_deadline(lch_hmap_t* ht, const char* word, size_t len, uint64_t deadline)
+{
+    (void) ht;
+    (void) word;
+    (void) len;
+    (void) deadline;
+    return false;
+}
+
+size_t ht_expire(lch_hmap_t* ht, uint64_t now, size_t max_work)
+{
+    (void) ht;
+    (void) now;
+    (void) max_work;
+    return 0;
+}
+
+lch_hmap_snapshot_t* ht_snapshot(lch_hmap_t* ht)
+{
+    /* Not supported here, the groups are arrays that an insert reallocates */
+    (void) ht;
+    errno = ENOTSUP;
+    return NULL;
+}
+
+const lch_value_t* ht_snapshot_get(lch_hmap_snapshot_t* s, const char* word)
+{
+    (void) s;
+    (void) word;
+    return NULL;
+}
+
+void ht_snapshot_traverse(lch_hmap_snapshot_t* s,
+        int (*action) (lch_key_t, lch_value_t, void*), void* arg)
+{
+    (void) s;
+    (void) action;
+    (void) arg;
+}
+
+void ht_snapshot_release(lch_hmap_snapshot_t* s)
+{
+    (void) s;
+}
+
+bool ht_contains(lch_hmap_t* ht, const char* word)
+{
+    return ht_get(ht, word) != NULL;
+}
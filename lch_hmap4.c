@@ -0,0 +1,686 @@
+#define _POSIX_C_SOURCE 200809L /* posix_memalign */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <errno.h>
+
+#include "lch_hmap.h"
+#include "hfn.h"
+
+/*
+ * A bucketized cuckoo hashmap: every key has two candidate buckets of
+ * LCH_SLOTS slots each, and is in one of them (or, rarely, in the small
+ * stash). A lookup compares the cached hashes of at most 2 buckets,
+ * each one a cache line, and the key of an entry only when its full
+ * hash matches. Insertions make room by moving entries to their other
+ * bucket, along the shortest path found with a breadth first search.
+ * Keys with the very same hash have the same two buckets whatever the
+ * size: those that do not fit there stay in the stash, which grows.
+ * See "Algorithmic Improvements for Fast Concurrent Cuckoo Hashing",
+ * Li et al. 2014
+ */
+typedef struct {
+    lch_value_t val;
+    uint64_t seq; /* the order of insertion, for ht_traverse_ordered */
+    uint32_t hash; /* the hash of the key, cached */
+    uint32_t key_len;
+    char key[];
+} lch_hmap_entry_t;
+
+#define LCH_SLOTS 4
+typedef struct {
+    uint32_t hash[LCH_SLOTS];
+    lch_hmap_entry_t* e[LCH_SLOTS]; /* NULL if the slot is free */
+    char pad[64 - LCH_SLOTS * (sizeof(uint32_t) + sizeof(void*))]; /* 64 bytes */
+} lch_hmap_bucket_t;
+
+#define LCH_STASH_SIZE 8 /* entries before the map grows */
+#define LCH_MAX_LOAD 0.90
+#define LCH_BFS_MAX 256 /* nodes, i.e. paths of up to 4 moves */
+#define LCH_MIN_BUCKETS 8U
+
+typedef uint32_t (*hfn_t)(const char*, size_t);
+struct lch_hmap  {
+    unsigned int n; /* current number of elements (entries) */
+    uint32_t size; /* number of buckets, a power of 2 */
+    unsigned long long generation;
+    uint64_t next_seq; /* of the next entry added */
+    hfn_t hfn;
+    pg_policy_t policy; /* of the table */
+    lch_hmap_bucket_t* table;
+    unsigned int nstash, stash_cap;
+    lch_hmap_entry_t** stash;
+};
+
+#define HASH_SIZE(ht) ((ht)->size)
+#define for_each_lch_bucket(ht,bkt) \
+    for(bkt=(ht)->table;bkt!=(ht)->table+HASH_SIZE(ht);bkt++)
+
+/* The two buckets of a hash, from the two halves of a 64 bit mix */
+#define lch_bucket1(ht,h) ((uint32_t) fmix64(h) & ((ht)->size - 1))
+#define lch_bucket2(ht,h) ((uint32_t) (fmix64(h) >> 32) & ((ht)->size - 1))
+
+static inline uint32_t _ht_alt_bucket(lch_hmap_t* ht, uint32_t b, uint32_t h)
+{
+    uint32_t b1 = lch_bucket1(ht, h);
+    return b == b1 ? lch_bucket2(ht, h) : b1;
+}
+
+#define _ht_entry_match(e, word, len, h) ((e)->hash == (h) \
+        && (e)->key_len == (len) && memcmp((e)->key, (word), (len)) == 0)
+
+lch_hmap_stats_t ht_stats(lch_hmap_t* h)
+{
+    lch_hmap_stats_t t = {
+        .capacity = h->size * LCH_SLOTS,
+        .nbr_elems = h->n,
+        /* the most slots that a lookup may look at */
+        .max_bucket_size = 2 * LCH_SLOTS + h->nstash,
+        .generation = h->generation,
+        .hfn_name = hfn_name(h->hfn)
+    };
+    return t;
+}
+
+static lch_hmap_bucket_t* _ht_table_create(uint32_t size, const pg_policy_t* policy)
+{
+    /* Pages are aligned to cache lines already */
+    if (policy->pages != PG_PAGES_DEFAULT || policy->numa != PG_NUMA_DEFAULT)
+        return pg_alloc(size * sizeof(lch_hmap_bucket_t), policy);
+    void* table;
+    /* Each bucket in its own cache line */
+    int err = posix_memalign(&table, sizeof(lch_hmap_bucket_t), size * sizeof(lch_hmap_bucket_t));
+    if (err) {
+        errno = err;
+        perror("ht_create");
+        return NULL;
+    }
+    memset(table, 0, size * sizeof(lch_hmap_bucket_t));
+    return table;
+}
+
+static void _ht_table_free(lch_hmap_bucket_t* table, uint32_t size, const pg_policy_t* policy)
+{
+    pg_free(table, size * sizeof *table, policy);
+}
+
+static uint32_t _ht_size_for(uint32_t n)
+{
+    uint32_t size = LCH_MIN_BUCKETS;
+    while (size < (1U << 28) && n > size * LCH_SLOTS * LCH_MAX_LOAD)
+        size <<= 1;
+    return size;
+}
+
+lch_hmap_t* ht_create_ex(uint32_t initial_size, hfn_t hfn, const pg_policy_t* policy)
+{
+    lch_hmap_t *h = calloc(1U, sizeof *h);
+    if (!h) {
+        perror("ht_create");
+        return NULL;
+    }
+    h->size = _ht_size_for(initial_size);
+    h->hfn = hfn;
+    if (policy)
+        h->policy = *policy;
+    h->table = _ht_table_create(h->size, &h->policy);
+    if (h->table == NULL) {
+        free(h);
+        return NULL;
+    }
+    return h;
+}
+
+lch_hmap_t* ht_create_sized(uint32_t initial_size, hfn_t hfn,
+        const pg_policy_t* policy, size_t value_size)
+{
+    /* Not supported here, the entries hold just an lch_value_t */
+    if (value_size != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return ht_create_ex(initial_size, hfn, policy);
+}
+
+lch_hmap_t* ht_create(uint32_t initial_size, hfn_t hfn)
+{
+    return ht_create_ex(initial_size, hfn, NULL);
+}
+
+#define LCH_AUTO_MAX_SCORE 1.10
+
+lch_hmap_t* ht_create_auto(uint32_t initial_size,
+        const char** sample_keys, size_t n)
+{
+    lch_hmap_t* ht = ht_create(initial_size, NULL);
+    if (!ht)
+        return NULL;
+    /* Scored on the buckets the map really has */
+    ht->hfn = hfn_select(sample_keys, n, ht->size, LCH_AUTO_MAX_SCORE);
+    return ht;
+}
+
+static void _ht_destroy_entries(lch_hmap_t* ht, void (*destroy_val_fn)(lch_value_t))
+{
+    lch_hmap_bucket_t* b;
+    for_each_lch_bucket(ht,b) {
+        for (int k = 0; k < LCH_SLOTS; ++k) {
+            if (!b->e[k])
+                continue;
+            if (destroy_val_fn != NULL)
+                destroy_val_fn(b->e[k]->val);
+            free(b->e[k]);
+            b->e[k] = NULL;
+        }
+    }
+    for (unsigned int k = 0; k < ht->nstash; ++k) {
+        if (destroy_val_fn != NULL)
+            destroy_val_fn(ht->stash[k]->val);
+        free(ht->stash[k]);
+    }
+    ht->nstash = 0;
+}
+
+void ht_destroy(lch_hmap_t* ht, void (*destroy_val_fn) (lch_value_t))
+{
+    _ht_destroy_entries(ht, destroy_val_fn);
+    _ht_table_free(ht->table, ht->size, &ht->policy);
+    free(ht->stash);
+    free(ht);
+}
+
+void ht_clear(lch_hmap_t* ht, void (*destroy_val_fn) (lch_value_t))
+{
+    _ht_destroy_entries(ht, destroy_val_fn);
+    ht->n = 0;
+    ht->generation++;
+}
+
+void ht_traverse(lch_hmap_t* ht,
+        int (*action) (lch_key_t, lch_value_t, void*), void* arg)
+{
+    lch_hmap_bucket_t* b;
+    for_each_lch_bucket(ht,b) {
+        for (int k = 0; k < LCH_SLOTS; ++k) {
+            if (b->e[k] && action(b->e[k]->key, b->e[k]->val, arg) < 0)
+                return;
+        }
+    }
+    for (unsigned int k = 0; k < ht->nstash; ++k) {
+        if (action(ht->stash[k]->key, ht->stash[k]->val, arg) < 0)
+            return;
+    }
+}
+
+static int _ht_cmp_seq(const void* a, const void* b)
+{
+    uint64_t x = (*(lch_hmap_entry_t* const*) a)->seq;
+    uint64_t y = (*(lch_hmap_entry_t* const*) b)->seq;
+    return (x > y) - (x < y);
+}
+
+/*
+ * The entries move between their buckets, and keep no list in insertion
+ * order: they are sorted by their seq instead, in O(n log n) and n
+ * pointers
+ */
+void ht_traverse_ordered(lch_hmap_t* ht,
+        int (*action) (lch_key_t, lch_value_t, void*), void* arg)
+{
+    if (ht->n == 0)
+        return;
+    lch_hmap_entry_t** order = malloc(ht->n * sizeof *order);
+    if (!order) {
+        perror("ht_traverse_ordered");
+        return;
+    }
+    unsigned int n = 0;
+    lch_hmap_bucket_t* b;
+    for_each_lch_bucket(ht,b) {
+        for (int k = 0; k < LCH_SLOTS; ++k)
+            if (b->e[k])
+                order[n++] = b->e[k];
+    }
+    for (unsigned int k = 0; k < ht->nstash; ++k)
+        order[n++] = ht->stash[k];
+    qsort(order, n, sizeof *order, _ht_cmp_seq);
+    for (unsigned int i = 0; i < n; ++i)
+        if (action(order[i]->key, order[i]->val, arg) < 0)
+            break;
+    free(order);
+}
+
+float ht_load_factor(lch_hmap_t* h)
+{
+    return h->n*1.0/(HASH_SIZE(h) * LCH_SLOTS);
+}
+
+/**********************************************************
+ *  Insertion
+ *********************************************************/
+
+static int _ht_free_slot(lch_hmap_bucket_t* b)
+{
+    for (int k = 0; k < LCH_SLOTS; ++k) {
+        if (!b->e[k])
+            return k;
+    }
+    return -1;
+}
+
+typedef struct {
+    uint32_t bucket;
+    int parent; /* index of the node it came from, -1 for the two first */
+    int slot; /* the slot of the parent's bucket whose entry moves here */
+} lch_bfs_node_t;
+
+/*
+ * Puts the entry in one of its buckets, moving others to their other
+ * bucket if both are full. Returns false if no path to a free slot was
+ * found
+ */
+static bool _ht_cuckoo_insert(lch_hmap_t* ht, lch_hmap_entry_t* e)
+{
+    uint32_t b1 = lch_bucket1(ht, e->hash), b2 = lch_bucket2(ht, e->hash);
+    lch_bfs_node_t q[LCH_BFS_MAX];
+    int head = 0, tail = 0;
+    q[tail++] = (lch_bfs_node_t) {b1, -1, -1};
+    if (b2 != b1)
+        q[tail++] = (lch_bfs_node_t) {b2, -1, -1};
+
+    while (head < tail) {
+        int cur = head++;
+        lch_hmap_bucket_t* b = ht->table + q[cur].bucket;
+        int free_slot = _ht_free_slot(b);
+        if (free_slot >= 0) {
+            /* Move the entries along the path, from its end */
+            for (int node = cur; q[node].parent >= 0; node = q[node].parent) {
+                lch_hmap_bucket_t* from = ht->table + q[q[node].parent].bucket;
+                lch_hmap_bucket_t* to = ht->table + q[node].bucket;
+                int s = q[node].slot;
+                to->e[free_slot] = from->e[s];
+                to->hash[free_slot] = from->hash[s];
+                from->e[s] = NULL;
+                free_slot = s;
+            }
+            /* The first node of the path is the one freed */
+            int root = cur;
+            while (q[root].parent >= 0)
+                root = q[root].parent;
+            b = ht->table + q[root].bucket;
+            b->e[free_slot] = e;
+            b->hash[free_slot] = e->hash;
+            return true;
+        }
+        for (int k = 0; k < LCH_SLOTS && tail < LCH_BFS_MAX; ++k) {
+            uint32_t alt = _ht_alt_bucket(ht, q[cur].bucket, b->hash[k]);
+            /* A bucket can be on a path only once */
+            int node = cur;
+            while (node >= 0 && q[node].bucket != alt)
+                node = q[node].parent;
+            if (node < 0)
+                q[tail++] = (lch_bfs_node_t) {alt, cur, k};
+        }
+    }
+    return false;
+}
+
+static int _ht_stash_add(lch_hmap_t* ht, lch_hmap_entry_t* e)
+{
+    if (ht->nstash == ht->stash_cap) {
+        unsigned int cap = ht->stash_cap ? 2 * ht->stash_cap : LCH_STASH_SIZE;
+        lch_hmap_entry_t** stash = realloc(ht->stash, cap * sizeof *stash);
+        if (!stash) {
+            perror("ht_put");
+            return -1;
+        }
+        ht->stash = stash;
+        ht->stash_cap = cap;
+    }
+    ht->stash[ht->nstash++] = e;
+    return 0;
+}
+
+/*
+ * Moves all the entries to a table of `size` buckets, those that do not
+ * fit to the stash. On failure the map is left as it was
+ */
+static int _ht_rehash(lch_hmap_t* ht, uint32_t size)
+{
+    lch_hmap_t old = *ht;
+    ht->table = _ht_table_create(size, &ht->policy);
+    if (!ht->table) {
+        ht->table = old.table;
+        return -1;
+    }
+    ht->size = size;
+    ht->nstash = ht->stash_cap = 0;
+    ht->stash = NULL;
+    lch_hmap_bucket_t* b;
+    for_each_lch_bucket(&old,b) {
+        for (int k = 0; k < LCH_SLOTS; ++k) {
+            if (b->e[k] && !_ht_cuckoo_insert(ht, b->e[k])
+                    && _ht_stash_add(ht, b->e[k]) < 0)
+                goto fail;
+        }
+    }
+    for (unsigned int k = 0; k < old.nstash; ++k) {
+        if (!_ht_cuckoo_insert(ht, old.stash[k]) && _ht_stash_add(ht, old.stash[k]) < 0)
+            goto fail;
+    }
+    _ht_table_free(old.table, old.size, &old.policy);
+    free(old.stash);
+    return 0;
+fail:
+    _ht_table_free(ht->table, ht->size, &ht->policy);
+    free(ht->stash);
+    *ht = old;
+    return -1;
+}
+
+/* The entries of hash h in its two buckets and in the stash */
+static unsigned int _ht_hash_count(lch_hmap_t* ht, uint32_t h)
+{
+    lch_hmap_bucket_t* b1 = ht->table + lch_bucket1(ht, h);
+    lch_hmap_bucket_t* b2 = ht->table + lch_bucket2(ht, h);
+    unsigned int n = 0;
+    for (int k = 0; k < LCH_SLOTS; ++k)
+        n += (b1->e[k] && b1->hash[k] == h) + (b2 != b1 && b2->e[k] && b2->hash[k] == h);
+    for (unsigned int k = 0; k < ht->nstash; ++k)
+        n += ht->stash[k]->hash == h;
+    return n;
+}
+
+/*
+ * Inserts an entry that is not in the map, wherever it fits. When the
+ * stash is full it grows the map once, but not for a hash that fills
+ * both its buckets already: no size would separate those keys
+ */
+static int _ht_place(lch_hmap_t* ht, lch_hmap_entry_t* e)
+{
+    if (_ht_cuckoo_insert(ht, e))
+        return 0;
+    if (ht->nstash >= LCH_STASH_SIZE && _ht_hash_count(ht, e->hash) < 2 * LCH_SLOTS
+            && _ht_rehash(ht, 2 * ht->size) == 0 && _ht_cuckoo_insert(ht, e))
+        return 0;
+    return _ht_stash_add(ht, e);
+}
+
+/**********************************************************
+ *  Lookups
+ *********************************************************/
+
+static lch_hmap_entry_t** _ht_find(lch_hmap_t* ht, const char* word, size_t len, uint32_t h)
+{
+    lch_hmap_bucket_t* b1 = ht->table + lch_bucket1(ht, h);
+    lch_hmap_bucket_t* b2 = ht->table + lch_bucket2(ht, h);
+    for (int k = 0; k < LCH_SLOTS; ++k) {
+        if (b1->hash[k] == h && b1->e[k] && _ht_entry_match(b1->e[k], word, len, h))
+            return b1->e + k;
+    }
+    for (int k = 0; k < LCH_SLOTS; ++k) {
+        if (b2->hash[k] == h && b2->e[k] && _ht_entry_match(b2->e[k], word, len, h))
+            return b2->e + k;
+    }
+    for (unsigned int k = 0; k < ht->nstash; ++k) {
+        if (_ht_entry_match(ht->stash[k], word, len, h))
+            return ht->stash + k;
+    }
+    return NULL;
+}
+
+lch_value_t* ht_get_hashed(lch_hmap_t* ht, const char* word, size_t len, uint32_t h)
+{
+    lch_hmap_entry_t** e = _ht_find(ht, word, len, h);
+    return e ? &(*e)->val : NULL;
+}
+
+lch_value_t* ht_get(lch_hmap_t* ht, const char* word)
+{
+    size_t len = strlen(word);
+    return ht_get_hashed(ht, word, len, ht->hfn(word, len));
+}
+
+lch_value_t* ht_put(lch_hmap_t* ht, const char* word)
+{
+    size_t len = strlen(word);
+    return ht_put_hashed(ht, word, len, ht->hfn(word, len));
+}
+
+/*
+ * The one lookup and (if missing) insertion behind ht_put_hashed,
+ * ht_increment and ht_upsert. *created tells which of the two it was
+ */
+static lch_value_t* _ht_upsert_hashed(lch_hmap_t* ht, const char* word, size_t len,
+        uint32_t h, bool* created)
+{
+    *created = false;
+    lch_hmap_entry_t** found = _ht_find(ht, word, len, h);
+    if (found)
+        return &(*found)->val;
+
+    lch_hmap_entry_t* e = malloc(sizeof *e + len + 1);
+    if (!e) {
+        perror("ht_put");
+        return NULL;
+    }
+    e->val.l = 0;
+    e->seq = ht->next_seq;
+    e->hash = h;
+    e->key_len = len;
+    memcpy(e->key, word, len);
+    e->key[len] = '\0';
+
+    if (ht->n + 1 > HASH_SIZE(ht) * LCH_SLOTS * LCH_MAX_LOAD)
+        _ht_rehash(ht, 2 * ht->size);
+    if (_ht_place(ht, e) < 0) {
+        free(e);
+        return NULL;
+    }
+    ht->next_seq++;
+    ht->n++;
+    ht->generation++;
+    *created = true;
+    return &e->val;
+}
+
+lch_value_t* ht_put_hashed(lch_hmap_t* ht, const char* word, size_t len, uint32_t h)
+{
+    bool created;
+    return _ht_upsert_hashed(ht, word, len, h, &created);
+}
+
+lch_value_t* ht_increment(lch_hmap_t* ht, const char* word, size_t len, long delta)
+{
+    bool created;
+    lch_value_t* v = _ht_upsert_hashed(ht, word, len, ht->hfn(word, len), &created);
+    if (v)
+        v->l += delta;
+    return v;
+}
+
+lch_value_t* ht_upsert(lch_hmap_t* ht, const char* word, size_t len,
+        void (*init_fn) (lch_value_t*, void*),
+        void (*update_fn) (lch_value_t*, void*), void* arg)
+{
+    bool created;
+    lch_value_t* v = _ht_upsert_hashed(ht, word, len, ht->hfn(word, len), &created);
+    if (!v)
+        return NULL;
+    if (created) {
+        if (init_fn)
+            init_fn(v, arg);
+    }
+    else if (update_fn)
+        update_fn(v, arg);
+    return v;
+}
+
+void ht_delete(lch_hmap_t* ht, const char* word)
+{
+    size_t len = strlen(word);
+    lch_hmap_entry_t** e = _ht_find(ht, word, len, ht->hfn(word, len));
+    if (!e)
+        return;
+    free(*e);
+    if (e >= ht->stash && e < ht->stash + ht->nstash) {
+        *e = ht->stash[--ht->nstash];
+    }
+    else {
+        *e = NULL;
+        /* There may be room now for what is in the stash */
+        for (unsigned int k = 0; k < ht->nstash; ) {
+            if (_ht_cuckoo_insert(ht, ht->stash[k]))
+                ht->stash[k] = ht->stash[--ht->nstash];
+            else
+                ++k;
+        }
+    }
+    ht->n--;
+    ht->generation++;
+}
+
+/* Moves one entry of a merged map to dst */
+static int _ht_merge_entry(lch_hmap_t* dst, lch_hmap_entry_t* e, bool same_hfn,
+        void (*combine_fn) (lch_value_t* dst_val, lch_value_t src_val))
+{
+    size_t len = e->key_len;
+    uint32_t h = same_hfn ? e->hash : dst->hfn(e->key, len);
+    lch_hmap_entry_t** found = _ht_find(dst, e->key, len, h);
+    if (found) {
+        if (combine_fn)
+            combine_fn(&(*found)->val, e->val);
+        free(e);
+        return 0;
+    }
+    uint32_t old_hash = e->hash;
+    uint64_t old_seq = e->seq;
+    e->hash = h;
+    /* After the entries of dst, in their order in src */
+    e->seq += dst->next_seq;
+    if (_ht_place(dst, e) < 0) {
+        e->hash = old_hash;
+        e->seq = old_seq;
+        return -1;
+    }
+    dst->n++;
+    dst->generation++;
+    return 0;
+}
+
+int ht_merge(lch_hmap_t* dst, lch_hmap_t* src,
+        void (*combine_fn) (lch_value_t* dst_val, lch_value_t src_val))
+{
+    if (dst == src || src->n == 0)
+        return 0;
+    uint64_t total = (uint64_t) dst->n + src->n;
+    uint32_t size = dst->size;
+    while (total > size * LCH_SLOTS * LCH_MAX_LOAD && size < (1U << 31))
+        size <<= 1;
+    if (size > dst->size && _ht_rehash(dst, size) < 0)
+        return -1;
+    bool same_hfn = dst->hfn == src->hfn;
+
+    int ret = 0;
+    lch_hmap_bucket_t* b;
+    for_each_lch_bucket(src,b) {
+        for (int k = 0; k < LCH_SLOTS; ++k) {
+            if (!b->e[k])
+                continue;
+            if (_ht_merge_entry(dst, b->e[k], same_hfn, combine_fn) < 0) {
+                ret = -1;
+                goto out;
+            }
+            b->e[k] = NULL;
+            src->n--;
+        }
+    }
+    while (src->nstash > 0) {
+        if (_ht_merge_entry(dst, src->stash[src->nstash - 1], same_hfn, combine_fn) < 0) {
+            ret = -1;
+            goto out;
+        }
+        src->nstash--;
+        src->n--;
+    }
+out:
+    dst->next_seq += src->next_seq;
+    src->generation++;
+    return ret;
+}
+
+bool ht_set_bloom(lch_hmap_t* ht, bool enabled)
+{
+    /* Not needed here, a miss looks at 2 buckets at most */
+    (void) ht;
+    return !enabled;
+}
+
+bool ht_set_borrowed_keys(lch_hmap_t* ht, bool enabled)
+{
+    /* Not supported here, the keys are part of the entries */
+    (void) ht;
+    return !enabled;
+}
+
+bool ht_enable_expiry(lch_hmap_t* ht, void (*destroy_val_fn) (lch_value_t))
+{
+    /* Not supported here, entries move between their buckets */
+    (void) ht;
+    (void) destroy_val_fn;
+    return false;
+}
+
+bool ht_set_deadline(lch_hmap_t* ht, const char* word, size_t len, uint64_t deadline)
+{
+    (void) ht;
+    (void) word;
+    (void) len;
+    (void) deadline;
+    return false;
+}
+
+size_t ht_expire(lch_hmap_t* ht, uint64_t now, size_t max_work)
+{
+    (void) ht;
+    (void) now;
+    (void) max_work;
+    return 0;
+}
+
+lch_hmap_snapshot_t* ht_snapshot(lch_hmap_t* ht)
+{
+    /* Not supported here, an insert moves the entries between the tables */
+    (void) ht;
+    errno = ENOTSUP;
+    return NULL;
+}
+
+const lch_value_t* ht_snapshot_get(lch_hmap_snapshot_t* s, const char* word)
+{
+    (void) s;
+    (void) word;
+    return NULL;
+}
+
+void ht_snapshot_traverse(lch_hmap_snapshot_t* s,
+        int (*action) (lch_key_t, lch_value_t, void*), void* arg)
+{
+    (void) s;
+    (void) action;
+    (void) arg;
+}
+
+void ht_snapshot_release(lch_hmap_snapshot_t* s)
+{
+    (void) s;
+}
+
+bool ht_contains(lch_hmap_t* ht, const char* word)
+{
+    return ht_get(ht, word) != NULL;
+}
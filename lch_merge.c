@@ -0,0 +1,63 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "lch_merge.h"
+
+typedef struct {
+    lch_hmap_t* dst;
+    lch_hmap_t* src;
+    void (*combine_fn) (lch_value_t*, lch_value_t);
+    int ret;
+} merge_job_t;
+
+static void* _merge_job(void* arg)
+{
+    merge_job_t* job = arg;
+    job->ret = ht_merge(job->dst, job->src, job->combine_fn);
+    return NULL;
+}
+
+lch_hmap_t* ht_merge_tree(lch_hmap_t** maps, size_t n,
+        void (*combine_fn) (lch_value_t* dst_val, lch_value_t src_val))
+{
+    if (n == 0)
+        return NULL;
+    merge_job_t* jobs = malloc((n / 2 + 1) * sizeof *jobs);
+    pthread_t* threads = malloc((n / 2 + 1) * sizeof *threads);
+    bool* started = malloc((n / 2 + 1) * sizeof *started);
+    bool failed = !jobs || !threads || !started;
+    if (failed)
+        perror("ht_merge_tree");
+
+    for (size_t step = 1; step < n && !failed; step *= 2) {
+        size_t njobs = 0;
+        for (size_t i = 0; i + step < n; i += 2 * step) {
+            /* The bigger one stays, fewer entries move */
+            if (ht_stats(maps[i]).nbr_elems < ht_stats(maps[i + step]).nbr_elems) {
+                lch_hmap_t* t = maps[i];
+                maps[i] = maps[i + step];
+                maps[i + step] = t;
+            }
+            jobs[njobs++] = (merge_job_t) {maps[i], maps[i + step], combine_fn, 0};
+        }
+        /* The first one in this thread, and the rest in new ones */
+        for (size_t j = 1; j < njobs; ++j)
+            started[j] = pthread_create(threads + j, NULL, _merge_job, jobs + j) == 0;
+        _merge_job(jobs);
+        for (size_t j = 1; j < njobs; ++j) {
+            if (started[j])
+                pthread_join(threads[j], NULL);
+            else
+                _merge_job(jobs + j);
+        }
+        for (size_t j = 0; j < njobs; ++j)
+            failed = failed || jobs[j].ret < 0;
+    }
+    free(jobs);
+    free(threads);
+    free(started);
+    return failed ? NULL : maps[0];
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "lch_hmap.h"
+
+    /*
+     * Merges the n maps into one with ht_merge, in ceil(log2(n)) rounds:
+     * in every round the maps are merged in pairs, each pair in its own
+     * thread, the smaller map of a pair into the bigger one. This is
+     * the last step of counting in parallel with one map per thread.
+     *
+     * The result is left in maps[0] (the maps are reordered) and the
+     * others are left empty, for the caller to destroy. Returns maps[0],
+     * or NULL if a merge failed (no entries are lost then, but they may
+     * be spread over several of the maps): if it ran out of memory, or
+     * the maps differ in borrowed keys, value size or expiry, or one of
+     * them has a live snapshot (see ht_merge)
+     */
+    lch_hmap_t* ht_merge_tree(lch_hmap_t** maps, size_t n,
+            void (*combine_fn) (lch_value_t* dst_val, lch_value_t src_val));
+
+#ifdef __cplusplus
+}
+#endif
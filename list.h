@@ -19,8 +19,16 @@ static inline void list_init_head(struct list* head)
 	head->prev = head;
 }
 
+static inline void list_del(struct list* node)
+{
+	node->prev->next = node->next;
+	node->next->prev = node->prev;
+	node->next = node->prev = node;
+}
+
+#define list_empty(head) ((head)->next == (head))
 
-struct list* list_insert(struct list* head, struct list* node)
+static inline struct list* list_insert(struct list* head, struct list* node)
 {
     node->next = head->next;
     node->prev = head;
@@ -29,7 +37,7 @@ struct list* list_insert(struct list* head, struct list* node)
     return node;
 }
 
-struct list* list_insert_tail(struct list* head, struct list* node)
+static inline struct list* list_insert_tail(struct list* head, struct list* node)
 {
     node->next = head;
     node->prev = head->prev;
@@ -0,0 +1,101 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "lch_hmap.h"
+#include "lch_merge.h"
+#include "hfn.h"
+
+/*
+ * The last step of a parallel count: NMAPS partial maps, with partly
+ * overlapping keys, combined into one by re-inserting every key (with
+ * ht_traverse and ht_put), by ht_merge one after the other, and by
+ * ht_merge_tree
+ */
+
+#define NMAPS 8
+#define KEYS_PER_MAP 200000
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void build(lch_hmap_t** maps)
+{
+    char key[32];
+    for (int t = 0; t < NMAPS; ++t) {
+        maps[t] = ht_create(701, fnv32_hash);
+        /* Each map shares half of its keys with the next one */
+        for (int i = 0; i < KEYS_PER_MAP; ++i) {
+            int len = sprintf(key, "key:%d", t * KEYS_PER_MAP / 2 + i);
+            ht_increment(maps[t], key, len, 1);
+        }
+    }
+}
+
+static void add_counts(lch_value_t* dst, lch_value_t src)
+{
+    dst->l += src.l;
+}
+
+static int put_count(lch_key_t key, lch_value_t val, void* arg)
+{
+    ht_put(arg, key)->l += val.l;
+    return 0;
+}
+
+static int sum_counts(lch_key_t key, lch_value_t val, void* arg)
+{
+    (void) key;
+    *(long*) arg += val.l;
+    return 0;
+}
+
+static void report(const char* what, double ms, lch_hmap_t* ht)
+{
+    long sum = 0;
+    ht_traverse(ht, sum_counts, &sum);
+    printf("%-22s %7.1f ms: %u keys, counts add up to %ld%s\n", what, ms,
+            ht_stats(ht).nbr_elems, sum,
+            sum == (long) NMAPS * KEYS_PER_MAP ? "" : " (wrong!)");
+}
+
+int main(void)
+{
+    lch_hmap_t* maps[NMAPS];
+
+    build(maps);
+    double start = now_ms();
+    lch_hmap_t* all = ht_create(701, fnv32_hash);
+    for (int t = 0; t < NMAPS; ++t)
+        ht_traverse(maps[t], put_count, all);
+    report("ht_traverse + ht_put", now_ms() - start, all);
+    ht_destroy(all, NULL);
+    for (int t = 0; t < NMAPS; ++t)
+        ht_destroy(maps[t], NULL);
+
+    build(maps);
+    start = now_ms();
+    for (int t = 1; t < NMAPS; ++t)
+        ht_merge(maps[0], maps[t], add_counts);
+    report("ht_merge", now_ms() - start, maps[0]);
+    for (int t = 0; t < NMAPS; ++t)
+        ht_destroy(maps[t], NULL);
+
+    build(maps);
+    start = now_ms();
+    all = ht_merge_tree(maps, NMAPS, add_counts);
+    if (!all)
+        return 1;
+    report("ht_merge_tree", now_ms() - start, all);
+    for (int t = 0; t < NMAPS; ++t)
+        ht_destroy(maps[t], NULL);
+}
@@ -0,0 +1,142 @@
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS, MAP_HUGETLB, MADV_HUGEPAGE, syscall */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+#include "pgalloc.h"
+
+#define PG_2MB (2UL << 20)
+#define PG_1GB (1UL << 30)
+
+#define _pg_is_default(p) (!(p) || ((p)->pages == PG_PAGES_DEFAULT && (p)->numa == PG_NUMA_DEFAULT))
+
+static size_t _pg_page_size(const pg_policy_t* policy)
+{
+    switch (policy->pages) {
+        case PG_PAGES_HUGE_1GB: return PG_1GB;
+        case PG_PAGES_HUGE_2MB:
+        case PG_PAGES_THP: return PG_2MB;
+        default: return (size_t) sysconf(_SC_PAGESIZE);
+    }
+}
+
+/*
+ * The length of the mapping for `size` bytes: whole pages of the policy,
+ * whatever kind of pages the kernel gave in the end, so that pg_free
+ * can compute it again
+ */
+static size_t _pg_length(size_t size, const pg_policy_t* policy)
+{
+    size_t page = _pg_page_size(policy);
+    return (size + page - 1) / page * page;
+}
+
+#ifdef MAP_HUGETLB
+/* The fallback to transparent huge pages is reported only the first time */
+static int _pg_hugetlb_warned = 0;
+
+static void* _pg_map_hugetlb(size_t len, const pg_policy_t* policy)
+{
+    int shift = policy->pages == PG_PAGES_HUGE_1GB ? 30 : 21;
+    void* p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT), -1, 0);
+    if (p == MAP_FAILED) {
+        if (!__atomic_exchange_n(&_pg_hugetlb_warned, 1, __ATOMIC_RELAXED))
+            fprintf(stderr, "pg_alloc: no %s huge pages available, trying transparent ones\n",
+                    shift == 30 ? "1GB" : "2MB");
+        return NULL;
+    }
+    return p;
+}
+#endif
+
+/* A mapping aligned to `align`, so that the kernel can back it with huge pages */
+static void* _pg_map_aligned(size_t len, size_t align)
+{
+    char* p = mmap(NULL, len + align, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("pg_alloc");
+        return NULL;
+    }
+    char* start = (char*) (((uintptr_t) p + align - 1) & ~(uintptr_t) (align - 1));
+    if (start > p)
+        munmap(p, start - p);
+    if (start + len < p + len + align)
+        munmap(start + len, p + len + align - (start + len));
+    return start;
+}
+
+void* pg_alloc(size_t size, const pg_policy_t* policy)
+{
+    if (_pg_is_default(policy)) {
+        void* p = calloc(1U, size);
+        if (!p)
+            perror("pg_alloc");
+        return p;
+    }
+    size_t len = _pg_length(size, policy);
+    void* p = NULL;
+#ifdef MAP_HUGETLB
+    if (policy->pages == PG_PAGES_HUGE_2MB || policy->pages == PG_PAGES_HUGE_1GB)
+        p = _pg_map_hugetlb(len, policy);
+#endif
+    if (!p) {
+        p = _pg_map_aligned(len, policy->pages == PG_PAGES_DEFAULT ? 1 : PG_2MB);
+        if (!p)
+            return NULL;
+#ifdef MADV_HUGEPAGE
+        if (policy->pages != PG_PAGES_DEFAULT && madvise(p, len, MADV_HUGEPAGE) < 0)
+            perror("pg_alloc: madvise");
+#endif
+    }
+#if defined(__linux__) && defined(SYS_mbind)
+    if (policy->numa != PG_NUMA_DEFAULT) {
+        unsigned long mask = policy->nodemask;
+        int mode = policy->numa == PG_NUMA_BIND ? MPOL_BIND : MPOL_INTERLEAVE;
+        /* Only a hint: the memory is usable anyway */
+        if (syscall(SYS_mbind, p, len, mode, &mask, sizeof mask * 8, 0) < 0)
+            perror("pg_alloc: mbind");
+    }
+#endif
+    return p;
+}
+
+void pg_free(void* p, size_t size, const pg_policy_t* policy)
+{
+    if (!p)
+        return;
+    if (_pg_is_default(policy))
+        free(p);
+    else
+        munmap(p, _pg_length(size, policy));
+}
+
+void* pg_realloc(void* p, size_t old_size, size_t new_size, const pg_policy_t* policy)
+{
+    if (_pg_is_default(policy)) {
+        void* t = realloc(p, new_size);
+        if (!t)
+            perror("pg_realloc");
+        return t;
+    }
+    if (p && _pg_length(old_size, policy) == _pg_length(new_size, policy))
+        return p;
+    void* t = pg_alloc(new_size, policy);
+    if (!t)
+        return NULL;
+    if (p) {
+        memcpy(t, p, old_size < new_size ? old_size : new_size);
+        pg_free(p, old_size, policy);
+    }
+    return t;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /*
+     * Where the memory of big arrays (the buckets of a hashmap, a large
+     * vec) comes from. With a big array almost every random access
+     * misses the TLB with 4 KB pages, and on a NUMA machine half of the
+     * accesses go to the other node if the pages land there.
+     *
+     * PG_PAGES_THP asks for transparent huge pages (madvise), which the
+     * kernel may or may not provide, and PG_PAGES_HUGE_2MB/1GB for huge
+     * pages from the reserved pool (see /proc/sys/vm/nr_hugepages),
+     * falling back to transparent ones if there are not enough (which
+     * is reported on stderr the first time only). The NUMA
+     * policy applies to the nodes of `nodemask` (bit i is node i).
+     * These are Linux only: elsewhere the policy is ignored.
+     */
+    typedef enum {
+        PG_PAGES_DEFAULT = 0, /* plain calloc */
+        PG_PAGES_THP,
+        PG_PAGES_HUGE_2MB,
+        PG_PAGES_HUGE_1GB
+    } pg_pages_t;
+
+    typedef enum {
+        PG_NUMA_DEFAULT = 0, /* first touch */
+        PG_NUMA_BIND, /* only the nodes given */
+        PG_NUMA_INTERLEAVE /* page by page over the nodes given */
+    } pg_numa_t;
+
+    typedef struct {
+        pg_pages_t pages;
+        pg_numa_t numa;
+        unsigned long nodemask;
+    } pg_policy_t;
+
+    /*
+     * Allocates `size` zeroed bytes with the given policy (NULL is the
+     * default policy). The memory must be released with pg_free, or
+     * resized with pg_realloc, given the same size and policy
+     */
+    void* pg_alloc(size_t size, const pg_policy_t* policy);
+    void pg_free(void* p, size_t size, const pg_policy_t* policy);
+
+    /*
+     * Resizes memory from pg_alloc, keeping its contents (but not
+     * zeroing any bytes added). On failure it returns NULL and p is
+     * still valid
+     */
+    void* pg_realloc(void* p, size_t old_size, size_t new_size, const pg_policy_t* policy);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "lch_hmap.h"
+#include "hfn.h"
+
+/*
+ * Throughput of the rolling hashes of hfn.h, and a small substring
+ * dedup example: counting the distinct windows of a text using the
+ * rolled hashes directly as the map hashes
+ */
+
+#define WINDOW 16
+
+char* readFile(const char* fn, size_t* len)
+{
+    FILE* fp = fopen(fn, "r");
+    if (!fp) {
+        perror("readFile");
+        exit(-1);
+    }
+    fseek(fp, 0, SEEK_END);
+    long sz = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char* buf = malloc(sz + 1);
+    *len = fread(buf, 1, sz, fp);
+    buf[*len] = '\0';
+    fclose(fp);
+    return buf;
+}
+
+static double mb_per_sec(size_t bytes, float secs)
+{
+    return secs > 0 ? bytes / (1024.0 * 1024.0) / secs : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t len;
+    char* text = readFile(argc > 1 ? argv[1] : "book.txt", &len);
+    printf("Read %zu bytes..\n", len);
+
+    hfn_roll_t r;
+    const char* names[] = {"Rabin-Karp", "Buzhash"};
+    hfn_roll_kind kinds[] = {HFN_ROLL_RK, HFN_ROLL_BUZ};
+    for (int k = 0; k < 2; ++k) {
+        uint32_t sink = 0;
+        hfn_roll_init(&r, kinds[k], WINDOW);
+        float startTime = (float)clock()/CLOCKS_PER_SEC;
+        for (size_t i = 0; i < len; ++i)
+            sink ^= hfn_roll_push(&r, text[i]);
+        float endTime = (float)clock()/CLOCKS_PER_SEC;
+        printf("%s (window %d): %.1f MB/s (%x)\n", names[k], WINDOW,
+                mb_per_sec(len, endTime - startTime), sink);
+        hfn_roll_free(&r);
+    }
+
+    size_t chunks = 0;
+    float startTime = (float)clock()/CLOCKS_PER_SEC;
+    for (size_t off = 0; off < len; ++chunks)
+        off += hfn_chunk(text + off, len - off, 2048, 8192, 65536);
+    float endTime = (float)clock()/CLOCKS_PER_SEC;
+    printf("Gear chunking: %.1f MB/s, %zu chunks of %zu bytes on average\n",
+            mb_per_sec(len, endTime - startTime), chunks, chunks ? len / chunks : 0);
+
+    /* The RK hashes are h31 hashes, so they can go straight to the map */
+    lch_hmap_t* ht = ht_create(len / 4, h31_hash);
+    hfn_roll_init(&r, HFN_ROLL_RK, WINDOW);
+    startTime = (float)clock()/CLOCKS_PER_SEC;
+    for (size_t i = 0; i < len; ++i) {
+        uint32_t h = hfn_roll_push(&r, text[i]);
+        if (hfn_roll_full(&r))
+            ht_put_hashed(ht, text + i + 1 - WINDOW, WINDOW, h)->l++;
+    }
+    endTime = (float)clock()/CLOCKS_PER_SEC;
+    hfn_roll_free(&r);
+    printf("Distinct windows of %d bytes: %u of %zu in %.3f ms (%.1f MB/s)\n",
+            WINDOW, ht_stats(ht).nbr_elems, len - WINDOW + 1,
+            1000*(endTime - startTime), mb_per_sec(len, endTime - startTime));
+    ht_destroy(ht, NULL);
+    free(text);
+}
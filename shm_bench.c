@@ -0,0 +1,119 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime, getline, strdup */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "lch_hmap.h"
+#include "shm_hmap.h"
+#include "hfn.h"
+#include "vec.h"
+
+/*
+ * A pre-fork setup: the parent counts the words of book.txt in a
+ * shm_hmap, and the workers attach to it read-only instead of each one
+ * building its own lch_hmap
+ */
+
+#define SHM_NAME "/c-structs-shm-bench"
+#define NWORKERS 4
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static vec_entry* read_words(const char* fn)
+{
+    FILE* fp = fopen(fn, "r");
+    if (!fp) {
+        perror("read_words");
+        exit(-1);
+    }
+    vec_entry* words = vec_create(1000);
+    char *line = NULL;
+    size_t linecap = 0;
+    while (getline(&line, &linecap, fp) != -1) {
+        const char* sep = " \t\n\x0B\f\r";
+        for (char* str = strtok(line, sep); str ; str = strtok(NULL, sep)) {
+            vec_entry e;
+            e.p = strdup(str);
+            vec_append(&words, e);
+        }
+    }
+    free(line);
+    fclose(fp);
+    return words;
+}
+
+static void free_word(vec_entry e)
+{
+    free(e.p);
+}
+
+static void worker(int id, vec_entry* words)
+{
+    double start = now_ms();
+    shm_hmap_t* ht = shm_ht_open(SHM_NAME, false);
+    if (!ht)
+        exit(1);
+    double open_ms = now_ms() - start;
+
+    /* CPU time, as the workers may share the CPUs */
+    clock_t cstart = clock();
+    long total = 0;
+    for (size_t i = 0; i < vec_length(words); ++i) {
+        lch_value_t* v = shm_ht_get(ht, words[i].p);
+        total += v ? v->l : 0;
+    }
+    printf("worker %d: attached in %.3f ms, %zu lookups in %.1f ms (sum of counts %ld)\n",
+            id, open_ms, vec_length(words), 1000.0 * (clock() - cstart) / CLOCKS_PER_SEC, total);
+    shm_ht_close(ht);
+    exit(0);
+}
+
+int main(int argc, char* argv[])
+{
+    vec_entry* words = read_words(argc > 1 ? argv[1] : "book.txt");
+    size_t n = vec_length(words);
+
+    double start = now_ms();
+    lch_hmap_t* local = ht_create(701, fnv32_hash);
+    for (size_t i = 0; i < n; ++i)
+        ht_put(local, words[i].p)->l++;
+    printf("lch_hmap built in %.1f ms (what every worker would do)\n", now_ms() - start);
+    ht_destroy(local, NULL);
+
+    shm_ht_unlink(SHM_NAME);
+    start = now_ms();
+    shm_hmap_t* ht = shm_ht_create(SHM_NAME, 64UL << 20, 701, fnv32_hash);
+    if (!ht)
+        return 1;
+    for (size_t i = 0; i < n; ++i)
+        shm_ht_put(ht, words[i].p)->l++;
+    shm_hmap_stats_t st = shm_ht_stats(ht);
+    printf("shm_hmap built in %.1f ms: %u words, %zu of %zu bytes used\n",
+            now_ms() - start, st.nbr_elems, st.bytes_used, st.bytes_total);
+
+    fflush(stdout);
+    for (int k = 0; k < NWORKERS; ++k) {
+        pid_t pid = fork();
+        if (pid == 0)
+            worker(k, words);
+        if (pid < 0)
+            perror("fork");
+    }
+    while (wait(NULL) > 0)
+        ;
+
+    shm_ht_close(ht);
+    shm_ht_unlink(SHM_NAME);
+    vec_free(&words, free_word);
+}
@@ -0,0 +1,395 @@
+#define _POSIX_C_SOURCE 200809L /* shm_open, robust mutexes */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm_hmap.h"
+
+#define SHM_HT_MAGIC 0x53484d31U /* "SHM1" */
+#define SHM_HT_ALIGN 8U
+
+/*
+ * The start of the region. All the "pointers" in the region are
+ * offsets from its start, with 0 for NULL
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t seq; /* odd while a writer changes the map */
+    uint64_t region_size;
+    uint64_t used; /* the region is allocated in order, up to here */
+    uint64_t table; /* offset of the buckets */
+    uint32_t size; /* number of buckets, a power of 2 */
+    uint32_t n;
+    uint32_t max_bucket_size;
+    uint64_t generation;
+    char hfn[32]; /* the name of the hash function, see hfn_all */
+    pthread_mutex_t lock;
+} shm_ht_header_t;
+
+typedef struct {
+    uint64_t next;
+    uint32_t hash;
+    uint32_t len;
+    lch_value_t val;
+    char key[];
+} shm_ht_entry_t;
+
+struct shm_hmap {
+    shm_ht_header_t* hdr;
+    char* base;
+    size_t size;
+    bool writable;
+    lch_hfn hfn;
+};
+
+#define SHM_HT_PTR(ht,off) ((void*) ((ht)->base + (off)))
+#define shm_ht_bucket(ht,table,size,h) ((uint64_t*) SHM_HT_PTR((ht), (table)) + (fmix32(h) & ((size) - 1)))
+
+#define shm_load(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define shm_store(p,v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static uint64_t _shm_ht_alloc(shm_hmap_t* ht, size_t bytes)
+{
+    uint64_t off = ht->hdr->used;
+    bytes = (bytes + SHM_HT_ALIGN - 1) & ~(size_t) (SHM_HT_ALIGN - 1);
+    if (off + bytes > ht->size)
+        return 0;
+    ht->hdr->used = off + bytes;
+    return off;
+}
+
+static shm_hmap_t* _shm_ht_map(int fd, size_t size, bool writable)
+{
+    shm_hmap_t* ht = calloc(1U, sizeof *ht);
+    if (!ht) {
+        perror("shm_ht_map");
+        return NULL;
+    }
+    void* p = mmap(NULL, size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        perror("shm_ht_map");
+        free(ht);
+        return NULL;
+    }
+    ht->base = p;
+    ht->hdr = p;
+    ht->size = size;
+    ht->writable = writable;
+    return ht;
+}
+
+shm_hmap_t* shm_ht_create(const char* name, size_t region_size,
+        uint32_t initial_size, lch_hfn hfn)
+{
+    const char* fn_name = hfn_name(hfn);
+    if (!fn_name) {
+        fprintf(stderr, "shm_ht_create: the hash function must be one of hfn_all\n");
+        return NULL;
+    }
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        perror("shm_ht_create");
+        return NULL;
+    }
+    shm_hmap_t* ht = NULL;
+    if (ftruncate(fd, region_size) < 0) {
+        perror("shm_ht_create");
+        goto out;
+    }
+    ht = _shm_ht_map(fd, region_size, true);
+    if (!ht)
+        goto out;
+
+    shm_ht_header_t* hdr = ht->hdr;
+    hdr->magic = SHM_HT_MAGIC;
+    hdr->region_size = region_size;
+    hdr->used = sizeof *hdr;
+    hdr->size = 16;
+    while (hdr->size < initial_size && hdr->size < (1U << 31))
+        hdr->size <<= 1;
+    hdr->table = _shm_ht_alloc(ht, hdr->size * sizeof(uint64_t));
+    strncpy(hdr->hfn, fn_name, sizeof hdr->hfn - 1);
+    ht->hfn = hfn;
+
+    /*
+     * Robust, so that a writer dying while holding it does not block
+     * the others for ever
+     */
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&hdr->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    if (hdr->table == 0) {
+        fprintf(stderr, "shm_ht_create: the region is too small\n");
+        shm_ht_close(ht);
+        ht = NULL;
+    }
+out:
+    close(fd);
+    if (!ht)
+        shm_unlink(name);
+    return ht;
+}
+
+shm_hmap_t* shm_ht_open(const char* name, bool writable)
+{
+    int fd = shm_open(name, writable ? O_RDWR : O_RDONLY, 0);
+    if (fd < 0) {
+        perror("shm_ht_open");
+        return NULL;
+    }
+    struct stat st;
+    shm_hmap_t* ht = NULL;
+    if (fstat(fd, &st) < 0) {
+        perror("shm_ht_open");
+    }
+    else if ((size_t) st.st_size < sizeof(shm_ht_header_t)) {
+        fprintf(stderr, "shm_ht_open: %s is not a hashmap\n", name);
+    }
+    else {
+        ht = _shm_ht_map(fd, st.st_size, writable);
+    }
+    close(fd);
+    if (!ht)
+        return NULL;
+
+    if (ht->hdr->magic != SHM_HT_MAGIC || ht->hdr->region_size != ht->size) {
+        fprintf(stderr, "shm_ht_open: %s is not a hashmap\n", name);
+        shm_ht_close(ht);
+        return NULL;
+    }
+    for (const hfn_info_t* f = hfn_all; f->name; ++f) {
+        if (strcmp(f->name, ht->hdr->hfn) == 0)
+            ht->hfn = f->fn;
+    }
+    if (!ht->hfn) {
+        fprintf(stderr, "shm_ht_open: unknown hash function %s\n", ht->hdr->hfn);
+        shm_ht_close(ht);
+        return NULL;
+    }
+    return ht;
+}
+
+void shm_ht_close(shm_hmap_t* ht)
+{
+    munmap(ht->base, ht->size);
+    free(ht);
+}
+
+int shm_ht_unlink(const char* name)
+{
+    return shm_unlink(name);
+}
+
+/**********************************************************
+ *  Writers
+ *********************************************************/
+
+static void _shm_ht_lock(shm_hmap_t* ht)
+{
+    if (pthread_mutex_lock(&ht->hdr->lock) == EOWNERDEAD) {
+        /* The previous writer died: the map is as it left it */
+        if (ht->hdr->seq & 1)
+            shm_store(&ht->hdr->seq, ht->hdr->seq + 1);
+        pthread_mutex_consistent(&ht->hdr->lock);
+    }
+}
+
+static void _shm_ht_unlock(shm_hmap_t* ht)
+{
+    pthread_mutex_unlock(&ht->hdr->lock);
+}
+
+/* Around every change, so that the lookups know they have to retry */
+static void _shm_ht_begin_write(shm_hmap_t* ht)
+{
+    __atomic_store_n(&ht->hdr->seq, ht->hdr->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void _shm_ht_end_write(shm_hmap_t* ht)
+{
+    shm_store(&ht->hdr->seq, ht->hdr->seq + 1);
+    ht->hdr->generation++;
+}
+
+/*
+ * Doubles the buckets, if there's room in the region: the old ones are
+ * lost, but may still be read by lookups
+ */
+static void _shm_ht_rehash(shm_hmap_t* ht)
+{
+    shm_ht_header_t* hdr = ht->hdr;
+    if (hdr->size >= (1U << 31))
+        return;
+    uint32_t size = 2 * hdr->size;
+    uint64_t table = _shm_ht_alloc(ht, size * sizeof(uint64_t));
+    if (table == 0)
+        return;
+    /* ftruncate'd memory is zeroed, and never reused */
+    uint32_t max_bucket_size = 0;
+    for (uint32_t i = 0; i < hdr->size; ++i) {
+        uint64_t* b = (uint64_t*) SHM_HT_PTR(ht, hdr->table) + i;
+        for (uint64_t off = *b; off; ) {
+            shm_ht_entry_t* e = SHM_HT_PTR(ht, off);
+            uint64_t next = e->next;
+            uint64_t* nb = shm_ht_bucket(ht, table, size, e->hash);
+            shm_store(&e->next, *nb);
+            shm_store(nb, off);
+            off = next;
+        }
+    }
+    for (uint32_t i = 0; i < size; ++i) {
+        uint32_t len = 0;
+        for (uint64_t off = ((uint64_t*) SHM_HT_PTR(ht, table))[i]; off;
+                off = ((shm_ht_entry_t*) SHM_HT_PTR(ht, off))->next)
+            ++len;
+        if (len > max_bucket_size)
+            max_bucket_size = len;
+    }
+    shm_store(&hdr->table, table);
+    shm_store(&hdr->size, size);
+    hdr->max_bucket_size = max_bucket_size;
+}
+
+/**********************************************************
+ *  Lookups
+ *********************************************************/
+
+/*
+ * Lock free lookup, see ss_chmap.c. The table and its size may be read
+ * half way through a rehash, so the offsets are checked to be in the
+ * region before they are followed
+ */
+static shm_ht_entry_t* _shm_ht_find(shm_hmap_t* ht, const char* word, size_t len, uint32_t h)
+{
+    shm_ht_header_t* hdr = ht->hdr;
+    unsigned int spins = 0;
+    for (;;) {
+        uint32_t s = shm_load(&hdr->seq);
+        if (s & 1) {
+            if (++spins % 128 == 0)
+                sched_yield();
+            continue;
+        }
+        uint64_t table = shm_load(&hdr->table);
+        uint32_t size = shm_load(&hdr->size);
+        uint32_t n = shm_load(&hdr->n);
+        shm_ht_entry_t* found = NULL;
+        uint64_t off = shm_load(shm_ht_bucket(ht, table, size, h));
+        for (uint32_t steps = 0; off && steps <= n; ++steps) {
+            if (off % SHM_HT_ALIGN || off > ht->size - sizeof(shm_ht_entry_t) - len)
+                break;
+            shm_ht_entry_t* e = SHM_HT_PTR(ht, off);
+            if (e->hash == h && e->len == len && memcmp(e->key, word, len) == 0) {
+                found = e;
+                break;
+            }
+            off = shm_load(&e->next);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&hdr->seq, __ATOMIC_RELAXED) == s)
+            return found;
+    }
+}
+
+lch_value_t* shm_ht_get(shm_hmap_t* ht, const char* word)
+{
+    size_t len = strlen(word);
+    shm_ht_entry_t* e = _shm_ht_find(ht, word, len, ht->hfn(word, len));
+    return e ? &e->val : NULL;
+}
+
+lch_value_t* shm_ht_put(shm_hmap_t* ht, const char* word)
+{
+    if (!ht->writable)
+        return NULL;
+    size_t len = strlen(word);
+    uint32_t h = ht->hfn(word, len);
+    _shm_ht_lock(ht);
+
+    shm_ht_header_t* hdr = ht->hdr;
+    /* No other writer, so the lookup will not retry */
+    shm_ht_entry_t* e = _shm_ht_find(ht, word, len, h);
+    if (e) {
+        _shm_ht_unlock(ht);
+        return &e->val;
+    }
+    uint64_t off = _shm_ht_alloc(ht, sizeof *e + len + 1);
+    if (off == 0) {
+        _shm_ht_unlock(ht);
+        return NULL;
+    }
+    e = SHM_HT_PTR(ht, off);
+    e->hash = h;
+    e->len = len;
+    memcpy(e->key, word, len + 1);
+
+    _shm_ht_begin_write(ht);
+    if (hdr->n + 1 > (3*hdr->size >> 2)) /* Use the 0.75 factor */
+        _shm_ht_rehash(ht);
+    uint64_t* b = shm_ht_bucket(ht, hdr->table, hdr->size, h);
+    uint32_t len_b = 1;
+    for (uint64_t o = *b; o; o = ((shm_ht_entry_t*) SHM_HT_PTR(ht, o))->next)
+        ++len_b;
+    if (len_b > hdr->max_bucket_size)
+        hdr->max_bucket_size = len_b;
+    e->next = *b;
+    shm_store(b, off);
+    shm_store(&hdr->n, hdr->n + 1);
+    _shm_ht_end_write(ht);
+
+    _shm_ht_unlock(ht);
+    return &e->val;
+}
+
+void shm_ht_delete(shm_hmap_t* ht, const char* word)
+{
+    if (!ht->writable)
+        return;
+    size_t len = strlen(word);
+    uint32_t h = ht->hfn(word, len);
+    _shm_ht_lock(ht);
+
+    shm_ht_header_t* hdr = ht->hdr;
+    uint64_t* prev = shm_ht_bucket(ht, hdr->table, hdr->size, h);
+    for (uint64_t off = *prev; off; ) {
+        shm_ht_entry_t* e = SHM_HT_PTR(ht, off);
+        if (e->hash == h && e->len == len && memcmp(e->key, word, len) == 0) {
+            _shm_ht_begin_write(ht);
+            shm_store(prev, e->next);
+            shm_store(&hdr->n, hdr->n - 1);
+            _shm_ht_end_write(ht);
+            break;
+        }
+        prev = &e->next;
+        off = *prev;
+    }
+    _shm_ht_unlock(ht);
+}
+
+shm_hmap_stats_t shm_ht_stats(shm_hmap_t* ht)
+{
+    shm_hmap_stats_t st;
+    st.nbr_elems = shm_load(&ht->hdr->n);
+    st.capacity = shm_load(&ht->hdr->size);
+    st.max_bucket_size = ht->hdr->max_bucket_size;
+    st.bytes_used = ht->hdr->used;
+    st.bytes_total = ht->size;
+    st.generation = ht->hdr->generation;
+    st.hfn_name = ht->hdr->hfn;
+    return st;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "lch_hmap.h"
+#include "hfn.h"
+
+    /*
+     * A chained hashmap of C strings to lch_value_t that lives entirely
+     * in a POSIX shared memory object, so that many processes can use
+     * the same one: e.g. the parent builds it and the forked workers
+     * attach to it read-only.
+     *
+     * Entries refer to each other by their offset in the region, which
+     * is of a fixed size given at creation and is filled in order:
+     * deleted entries are not reused. Entries never move, so the values
+     * returned stay valid while the map is open (but values that are
+     * pointers make sense only in the process that stored them).
+     *
+     * Writers are serialized by a process-shared mutex, and lookups take
+     * no lock: they retry if a writer changed the map meanwhile.
+     */
+    typedef struct shm_hmap shm_hmap_t;
+
+    typedef struct {
+        unsigned int nbr_elems;
+        unsigned int capacity;
+        unsigned int max_bucket_size;
+        size_t bytes_used;
+        size_t bytes_total;
+        unsigned long long generation;
+        const char* hfn_name;
+    } shm_hmap_stats_t;
+
+    /*
+     * Creates the shared memory object `name` (see shm_open) of
+     * `region_size` bytes, for a hashmap with the initial_size given and
+     * one of the hash functions of hfn.h. Fails if it exists already
+     */
+    shm_hmap_t* shm_ht_create(const char* name, size_t region_size,
+            uint32_t initial_size, lch_hfn hfn);
+
+    /*
+     * Attaches to the hashmap in the shared memory object `name`. If not
+     * `writable` the memory is mapped read-only, and only lookups can be
+     * done
+     */
+    shm_hmap_t* shm_ht_open(const char* name, bool writable);
+
+    /*
+     * Detaches from the hashmap. The shared memory object stays until
+     * shm_ht_unlink
+     */
+    void shm_ht_close(shm_hmap_t* ht);
+    int shm_ht_unlink(const char* name);
+
+    /*
+     * Finds the entry with the given key.
+     * Returns NULL if not found. The value must not be changed through
+     * a read-only map
+     */
+    lch_value_t* shm_ht_get(shm_hmap_t* ht, const char* word);
+
+    /*
+     * Inserts a new key in the hashmap and returns the inserted
+     * lch_value_t. If the key exists already it returns the existing
+     * value. Returns NULL if the region is full or the map is read-only
+     */
+    lch_value_t* shm_ht_put(shm_hmap_t* ht, const char* word);
+
+    void shm_ht_delete(shm_hmap_t* ht, const char* word);
+
+    shm_hmap_stats_t shm_ht_stats(shm_hmap_t* ht);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,113 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lch_hmap.h"
+#include "hfn.h"
+
+/*
+ * A point-in-time dump of a map of counters that keep being incremented:
+ * with the writer stopped for a whole ht_traverse, and with ht_snapshot
+ * and the dump in another thread while the writer goes on. The dump
+ * must add up to what the counters added up to when it was taken
+ */
+
+#define KEYS 1000000
+#define OPS 2000000
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+struct dump {
+    lch_hmap_snapshot_t* snap;
+    long sum;
+    unsigned int keys;
+    double ms;
+};
+
+static int add_count(lch_key_t key, lch_value_t val, void* arg)
+{
+    struct dump* d = arg;
+    (void) key;
+    d->sum += val.l;
+    d->keys++;
+    return 0;
+}
+
+static void* dump_run(void* arg)
+{
+    struct dump* d = arg;
+    double start = now_ms();
+    ht_snapshot_traverse(d->snap, add_count, d);
+    d->ms = now_ms() - start;
+    ht_snapshot_release(d->snap);
+    return NULL;
+}
+
+/* ns per increment of random keys */
+static double increment(lch_hmap_t* ht, char (*keys)[16], long n)
+{
+    double start = now_ms();
+    for (long i = 0; i < n; ++i) {
+        const char* key = keys[rand() % KEYS];
+        ht_increment(ht, key, strlen(key), 1);
+    }
+    return (now_ms() - start) * 1e6 / n;
+}
+
+int main(void)
+{
+    char (*keys)[16] = malloc(KEYS * sizeof *keys);
+    lch_hmap_t* ht = ht_create(701, fnv32_hash);
+    if (!keys || !ht)
+        return 1;
+    srand(42);
+    for (int i = 0; i < KEYS; ++i) {
+        sprintf(keys[i], "key:%d", i);
+        ht_increment(ht, keys[i], strlen(keys[i]), 1);
+    }
+    long total = KEYS;
+
+    printf("%-28s %7.1f ns/increment\n", "no snapshot", increment(ht, keys, OPS));
+    total += OPS;
+
+    struct dump d = { NULL, 0, 0, 0 };
+    double start = now_ms();
+    ht_traverse(ht, add_count, &d);
+    printf("%-28s %7.1f ms the writer waits (%u keys)\n", "ht_traverse",
+            now_ms() - start, d.keys);
+
+    memset(&d, 0, sizeof d);
+    start = now_ms();
+    d.snap = ht_snapshot(ht);
+    double snap_ms = now_ms() - start;
+    if (!d.snap)
+        return 1;
+    long expected = total;
+    pthread_t t;
+    pthread_create(&t, NULL, dump_run, &d);
+    printf("%-28s %7.1f ns/increment\n", "snapshot being dumped", increment(ht, keys, OPS));
+    total += OPS;
+    pthread_join(t, NULL);
+    printf("%-28s %7.3f ms the writer waits, dumped in %.1f ms: %u keys, "
+            "counts add up to %ld%s\n", "ht_snapshot", snap_ms, d.ms, d.keys, d.sum,
+            d.sum == expected ? "" : " (wrong!)");
+    printf("%-28s %7.1f ns/increment\n", "snapshot released", increment(ht, keys, OPS));
+    total += OPS;
+
+    memset(&d, 0, sizeof d);
+    ht_traverse(ht, add_count, &d);
+    printf("map counts add up to %ld%s\n", d.sum, d.sum == total ? "" : " (wrong!)");
+    ht_destroy(ht, NULL);
+    free(keys);
+}
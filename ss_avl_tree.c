@@ -41,6 +41,8 @@ ss_avl_node* ss_avl_find(ss_avl_tree* avl, ss_avl_node* val)
 static
 ss_avl_node* balance(ss_avl_node* node)
 {
+    if (node == NULL)
+        return NULL;
     int b = BALANCE_FACTOR(node);
     if (b > 1) {
         /* Imbalance left */
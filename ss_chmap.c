@@ -0,0 +1,301 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <sched.h>
+
+#include "ss_chmap.h"
+
+/*
+ * The sequence number of a bucket is odd while a writer holds it, so
+ * that it is both the writers' spinlock and the readers' seqlock
+ */
+typedef struct {
+    uint32_t seq;
+    ss_chmap_entry_t* e;
+} cht_bucket_t;
+
+struct ss_chmap_table {
+    uint32_t size; /* number of buckets, a power of 2 */
+    unsigned int bits; /* log2(size) */
+    ss_chmap_table_t* next; /* the table the buckets are moving to */
+    ss_chmap_table_t* retired_next;
+    uint32_t migrate_idx; /* the next bucket to claim for moving */
+    uint32_t migrated; /* the number of buckets moved */
+    cht_bucket_t buckets[];
+};
+
+#define CHT_MIN_BITS 4
+#define CHT_MIGRATE_CHUNK 16U
+
+/* What a bucket points to once its entries have moved to the next table */
+#define CHT_MOVED ((ss_chmap_entry_t*) 1)
+
+/* Fibonacci hashing, so that a bucket i moves to 2i or 2i+1 */
+#define cht_index(t,h) ((uint32_t) ((h) * 2654435769U) >> (32 - (t)->bits))
+
+#define SS_CHMAP_ENTRY_VALUE(ht,e) ((void*)((char*)(e) - (ht)->offset))
+
+#define cht_load(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define cht_store(p,v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static inline void _cht_pause(unsigned int* spins)
+{
+    if (++*spins % 128 == 0)
+        sched_yield();
+#if defined(__x86_64__) || defined(__i386__)
+    else
+        __builtin_ia32_pause();
+#endif
+}
+
+static void _cht_lock(cht_bucket_t* b)
+{
+    unsigned int spins = 0;
+    for (;;) {
+        uint32_t s = __atomic_load_n(&b->seq, __ATOMIC_RELAXED);
+        if (!(s & 1) && __atomic_compare_exchange_n(&b->seq, &s, s + 1, false,
+                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+        _cht_pause(&spins);
+    }
+    /* The readers must see the odd number before any change */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void _cht_unlock(cht_bucket_t* b)
+{
+    __atomic_store_n(&b->seq, b->seq + 1, __ATOMIC_RELEASE);
+}
+
+static ss_chmap_table_t* _cht_table_create(unsigned int bits)
+{
+    ss_chmap_table_t* t = calloc(1U, sizeof *t + ((size_t) 1 << bits) * sizeof(cht_bucket_t));
+    if (!t) {
+        perror("cht_table_create");
+        return NULL;
+    }
+    t->bits = bits;
+    t->size = 1U << bits;
+    return t;
+}
+
+ss_chmap_t* cht_init(ss_chmap_t* h,
+                     uint32_t initial_size,
+                     int (*fn)(void* e1, void* e2),
+                     size_t offset)
+{
+    unsigned int bits = CHT_MIN_BITS;
+    while (bits < 31 && (1U << bits) < initial_size)
+        ++bits;
+    h->table = _cht_table_create(bits);
+    if (!h->table)
+        return NULL;
+    h->retired = NULL;
+    h->n = 0;
+    h->compar = fn;
+    h->offset = offset;
+    return h;
+}
+
+void cht_clear(ss_chmap_t* ht)
+{
+    ss_chmap_table_t* t = ht->table;
+    while (t) {
+        ss_chmap_table_t* next = t->next;
+        free(t);
+        t = next;
+    }
+    for (t = ht->retired; t; ) {
+        ss_chmap_table_t* next = t->retired_next;
+        free(t);
+        t = next;
+    }
+    ht->table = ht->retired = NULL;
+    ht->n = 0;
+}
+
+unsigned int cht_size(ss_chmap_t* ht)
+{
+    return __atomic_load_n(&ht->n, __ATOMIC_RELAXED);
+}
+
+/*
+ * Moves the entries of bucket i of t to the next table. Its readers
+ * retry while it is locked, and then find it moved
+ */
+static void _cht_migrate_bucket(ss_chmap_table_t* t, uint32_t i)
+{
+    ss_chmap_table_t* nt = t->next;
+    cht_bucket_t* b = t->buckets + i;
+    cht_bucket_t* nb = nt->buckets + 2*i;
+
+    _cht_lock(b);
+    _cht_lock(nb);
+    _cht_lock(nb + 1);
+    ss_chmap_entry_t* e = b->e;
+    while (e) {
+        ss_chmap_entry_t* next = e->next;
+        cht_bucket_t* to = nt->buckets + cht_index(nt, e->hashcode);
+        cht_store(&e->next, to->e);
+        cht_store(&to->e, e);
+        e = next;
+    }
+    cht_store(&b->e, CHT_MOVED);
+    _cht_unlock(nb + 1);
+    _cht_unlock(nb);
+    _cht_unlock(b);
+}
+
+/*
+ * Moves a chunk of the buckets of t, if it is being replaced, and if it
+ * was the last one makes the next table the current one
+ */
+static void _cht_help_migrate(ss_chmap_t* ht, ss_chmap_table_t* t)
+{
+    if (cht_load(&t->next) == NULL)
+        return;
+    uint32_t i = __atomic_fetch_add(&t->migrate_idx, CHT_MIGRATE_CHUNK, __ATOMIC_RELAXED);
+    if (i >= t->size)
+        return;
+    uint32_t end = i + CHT_MIGRATE_CHUNK < t->size ? i + CHT_MIGRATE_CHUNK : t->size;
+    for (uint32_t k = i; k < end; ++k)
+        _cht_migrate_bucket(t, k);
+    if (__atomic_add_fetch(&t->migrated, end - i, __ATOMIC_ACQ_REL) == t->size) {
+        cht_store(&ht->table, t->next);
+        /* Lookups may still be in there: it is freed by cht_clear */
+        ss_chmap_table_t* r = __atomic_load_n(&ht->retired, __ATOMIC_RELAXED);
+        do {
+            t->retired_next = r;
+        } while (!__atomic_compare_exchange_n(&ht->retired, &r, t, true,
+                    __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+}
+
+static void _cht_start_resize(ss_chmap_table_t* t)
+{
+    if (t->bits >= 31 || cht_load(&t->next) != NULL)
+        return;
+    ss_chmap_table_t* nt = _cht_table_create(t->bits + 1);
+    if (!nt)
+        return;
+    ss_chmap_table_t* expected = NULL;
+    if (!__atomic_compare_exchange_n(&t->next, &expected, nt, false,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        free(nt); /* Someone else started it */
+}
+
+/*
+ * Lock free lookup: either `key` is an object (compared with `compar`)
+ * or a raw key for `eq`
+ */
+static void* _cht_find(ss_chmap_t* ht, uint32_t h, const void* key,
+        bool (*eq)(const void* key, void* obj))
+{
+    ss_chmap_table_t* t = cht_load(&ht->table);
+    unsigned int spins = 0;
+    for (;;) {
+        cht_bucket_t* b = t->buckets + cht_index(t, h);
+        uint32_t s = cht_load(&b->seq);
+        if (s & 1) {
+            _cht_pause(&spins);
+            continue;
+        }
+        ss_chmap_entry_t* e = cht_load(&b->e);
+        if (e == CHT_MOVED) {
+            t = cht_load(&t->next);
+            continue;
+        }
+        void* found = NULL;
+        for (; e; e = cht_load(&e->next)) {
+            if (e->hashcode != h)
+                continue;
+            void* obj = SS_CHMAP_ENTRY_VALUE(ht, e);
+            if (eq ? eq(key, obj) : ht->compar((void*) key, obj) == 0) {
+                found = obj;
+                break;
+            }
+        }
+        /* Was the chain changed while walking it? */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&b->seq, __ATOMIC_RELAXED) == s)
+            return found;
+    }
+}
+
+void* cht_get(ss_chmap_t* ht, ss_chmap_entry_t* entry)
+{
+    return _cht_find(ht, entry->hashcode, SS_CHMAP_ENTRY_VALUE(ht, entry), NULL);
+}
+
+void* cht_find_hashed(ss_chmap_t* ht, uint32_t hash, const void* key,
+        bool (*eq)(const void* key, void* obj))
+{
+    return _cht_find(ht, hash, key, eq);
+}
+
+/*
+ * Locks the bucket of hash h, in the newest table it has moved to.
+ * Helps with the moving first
+ */
+static cht_bucket_t* _cht_lock_bucket(ss_chmap_t* ht, uint32_t h, ss_chmap_table_t** tp)
+{
+    ss_chmap_table_t* t = cht_load(&ht->table);
+    _cht_help_migrate(ht, t);
+    for (;;) {
+        cht_bucket_t* b = t->buckets + cht_index(t, h);
+        _cht_lock(b);
+        if (b->e != CHT_MOVED) {
+            *tp = t;
+            return b;
+        }
+        _cht_unlock(b);
+        t = cht_load(&t->next);
+    }
+}
+
+void* cht_put(ss_chmap_t* ht, ss_chmap_entry_t* entry)
+{
+    uint32_t h = entry->hashcode;
+    void* key = SS_CHMAP_ENTRY_VALUE(ht, entry);
+    ss_chmap_table_t* t;
+    cht_bucket_t* b = _cht_lock_bucket(ht, h, &t);
+
+    for (ss_chmap_entry_t* e = b->e; e; e = e->next) {
+        if (h == e->hashcode && ht->compar(key, SS_CHMAP_ENTRY_VALUE(ht, e)) == 0) {
+            _cht_unlock(b);
+            return SS_CHMAP_ENTRY_VALUE(ht, e);
+        }
+    }
+    /* Lookups may still be at it, if it was deleted a while ago */
+    __atomic_store_n(&entry->next, b->e, __ATOMIC_RELAXED);
+    cht_store(&b->e, entry);
+    _cht_unlock(b);
+
+    unsigned int n = __atomic_add_fetch(&ht->n, 1, __ATOMIC_RELAXED);
+    if (n > (3*t->size >> 2) && t == cht_load(&ht->table)) /* Use the 0.75 factor */
+        _cht_start_resize(t);
+    return key;
+}
+
+void* cht_delete(ss_chmap_t* ht, ss_chmap_entry_t* entry)
+{
+    uint32_t h = entry->hashcode;
+    void* key = SS_CHMAP_ENTRY_VALUE(ht, entry);
+    ss_chmap_table_t* t;
+    cht_bucket_t* b = _cht_lock_bucket(ht, h, &t);
+
+    for (ss_chmap_entry_t** e = &b->e; *e; e = &(*e)->next) {
+        ss_chmap_entry_t* x = *e;
+        if (h == x->hashcode && ht->compar(key, SS_CHMAP_ENTRY_VALUE(ht, x)) == 0) {
+            /* x->next stays, for the lookups that are at x */
+            cht_store(e, x->next);
+            _cht_unlock(b);
+            __atomic_sub_fetch(&ht->n, 1, __ATOMIC_RELAXED);
+            return SS_CHMAP_ENTRY_VALUE(ht, x);
+        }
+    }
+    _cht_unlock(b);
+    return NULL;
+}
@@ -0,0 +1,90 @@
+#ifndef __SS_CHMAP_H__
+#define __SS_CHMAP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+    /*
+     * A concurrent version of the intrusive ss_hmap: any number of
+     * threads can look up, insert and delete at the same time.
+     *
+     * Writers lock just the bucket they change (a spinlock), and readers
+     * take no lock at all: they walk the chain and then check the
+     * bucket's sequence number, retrying if a writer changed it in the
+     * meantime (a "seqlock"). When the map grows, the buckets are moved
+     * to the new table a few at a time by the writers that come along,
+     * while lookups go on in both tables.
+     *
+     * An object that has been deleted may still be looked at by a
+     * concurrent lookup: it must not be freed (and its key must not
+     * change) until all the lookups that started before the delete are
+     * over. It can be inserted again, though.
+     */
+    typedef struct ss_chmap_entry {
+        struct ss_chmap_entry* next;
+        uint32_t hashcode;
+    } ss_chmap_entry_t;
+
+    typedef struct ss_chmap_table ss_chmap_table_t;
+
+    typedef struct ss_chmap {
+        ss_chmap_table_t* table; /* the oldest table still in use */
+        ss_chmap_table_t* retired; /* the tables that have been replaced */
+        unsigned int n;
+        int (*compar)(void* e1, void* e2);
+        size_t offset;
+    } ss_chmap_t;
+
+    /*
+     * Initializes the hashmap for about initial_size entries. `offset`
+     * is the offset of the ss_chmap_entry_t in the user's objects. Not
+     * thread safe
+     */
+    ss_chmap_t* cht_init(ss_chmap_t* h,
+            uint32_t initial_size,
+            int (*compar)(void* e1, void* e2),
+            size_t offset);
+
+    /*
+     * Finds the object with the same key as the one of entry (whose
+     * hashcode has to be set). Returns NULL if not found
+     */
+    void* cht_get(ss_chmap_t* ht, ss_chmap_entry_t* entry);
+
+    /*
+     * Finds the object with the given key and hash, see ht_find_hashed
+     * of ss_hmap.h
+     */
+    void* cht_find_hashed(ss_chmap_t* ht, uint32_t hash, const void* key,
+            bool (*eq)(const void* key, void* obj));
+
+    /*
+     * Inserts the object of entry in the hashmap and returns it. If an
+     * object with the same key exists already it returns that one
+     */
+    void* cht_put(ss_chmap_t* ht, ss_chmap_entry_t* entry);
+
+    /*
+     * Removes the object with the same key as the one of entry and
+     * returns it, or NULL if not found
+     */
+    void* cht_delete(ss_chmap_t* ht, ss_chmap_entry_t* entry);
+
+    unsigned int cht_size(ss_chmap_t* ht);
+
+    /*
+     * frees the memory used internally by the hash map. Not thread safe:
+     * no other operation may be in progress
+     */
+    void cht_clear(ss_chmap_t* ht);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -140,7 +140,7 @@ ss_hmap_t* ht_init(ss_hmap_t* h,
 {
     h->n = 0;
     h->size = _next_prime_for_expand(initial_size);
-    h->offset = 0;
+    h->offset = offset;
     h->compar = fn;
     h->table = calloc(h->size, sizeof(ss_hmap_bucket_t));
     if (h->table == NULL) {
@@ -215,6 +215,33 @@ void ht_delete(ss_hmap_t* ht, ss_hmap_entry_t* entry)
     }
 }
 
+void* ht_delete_hashed(ss_hmap_t* ht, uint32_t h, const void* key,
+        bool (*eq)(const void* key, void* obj))
+{
+    ss_hmap_bucket_t* b = ht_hash_to_bucket(ht, h);
+    for (ss_hmap_entry_t** e = &b->e; *e; e = &(*e)->next) {
+        ss_hmap_entry_t* t = *e;
+        if (h == t->hashcode && eq(key, SS_HMAP_ENTRY_VALUE(ht, t))) {
+            *e = t->next;
+            ht->n--;
+            return SS_HMAP_ENTRY_VALUE(ht, t);
+        }
+    }
+    return NULL;
+}
+
+void* ht_find_hashed(ss_hmap_t* ht, uint32_t h, const void* key,
+        bool (*eq)(const void* key, void* obj))
+{
+    ss_hmap_bucket_t* b = ht_hash_to_bucket(ht, h);
+    for (ss_hmap_entry_t* e = b->e; e; e = e->next) {
+        if (h == e->hashcode && eq(key, SS_HMAP_ENTRY_VALUE(ht, e))) {
+            return SS_HMAP_ENTRY_VALUE(ht,e);
+        }
+    }
+    return NULL;
+}
+
 void* ht_get(ss_hmap_t* ht, ss_hmap_entry_t* entry)
 {
     uint32_t h = entry->hashcode;
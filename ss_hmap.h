@@ -7,6 +7,7 @@ extern "C" {
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
     /* 
      * The Value associated with each key.
@@ -53,6 +54,22 @@ extern "C" {
      */
     void* ht_get(ss_hmap_t* ht, ss_hmap_entry_t* entry);
 
+    /*
+     * Finds the object with the given key and hash, without building
+     * an object to look for: `eq` is called with `key` and each stored
+     * object whose hashcode is `hash`, and returns true if they match.
+     * Returns NULL if not found
+     */
+    void* ht_find_hashed(ss_hmap_t* ht, uint32_t hash, const void* key,
+            bool (*eq)(const void* key, void* obj));
+
+    /*
+     * Same as ht_find_hashed, but also removes the object found from
+     * the hashmap. Returns the object removed, or NULL
+     */
+    void* ht_delete_hashed(ss_hmap_t* ht, uint32_t hash, const void* key,
+            bool (*eq)(const void* key, void* obj));
+
     /*
      * Inserts a new key in the hashmap and returns the 
      * inserted ss_value_t. If the key exists already
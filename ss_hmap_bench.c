@@ -0,0 +1,114 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "ss_hmap.h"
+#include "ss_ohmap.h"
+#include "hfn.h"
+
+/*
+ * Lookups in the chained intrusive ss_hmap against the open addressing
+ * ss_ohmap, with the objects allocated one by one
+ */
+
+struct item {
+    long count;
+    ss_hmap_entry_t link;
+    ss_ohmap_entry_t oe;
+    char name[48];
+};
+
+static int item_cmp(void* a, void* b)
+{
+    return strcmp(((struct item*) a)->name, ((struct item*) b)->name);
+}
+
+static bool item_eq(const void* key, void* obj)
+{
+    return strcmp(key, ((struct item*) obj)->name) == 0;
+}
+
+static void item_init(struct item* it, size_t i)
+{
+    sprintf(it->name, "item-%zu", i * 7919);
+    uint32_t h = fnv32_hash(it->name, strlen(it->name));
+    it->link.hashcode = h;
+    it->oe.hashcode = h;
+}
+
+#define elapsed_secs(start) ((double) (clock() - (start)) / CLOCKS_PER_SEC)
+
+int main(int argc, char* argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    struct item** items = malloc(n * sizeof *items);
+    for (size_t i = 0; i < n; ++i) {
+        items[i] = malloc(sizeof **items);
+        item_init(items[i], i);
+    }
+    /* The keys that were added, in another order, and as many that were not */
+    size_t nprobes = 2 * n;
+    struct item* probes = malloc(nprobes * sizeof *probes);
+    for (size_t i = 0; i < n; ++i)
+        item_init(probes + i, (i * 2654435761U) % n);
+    for (size_t i = n; i < nprobes; ++i)
+        item_init(probes + i, i);
+
+    ss_hmap_t ht;
+    ht_init(&ht, 701, item_cmp, offsetof(struct item, link));
+    ss_ohmap_t oht;
+    oht_init(&oht, 701, item_cmp, offsetof(struct item, oe));
+
+    clock_t start = clock();
+    for (size_t i = 0; i < n; ++i)
+        ht_put(&ht, &items[i]->link);
+    printf("ss_hmap:  put %6.2f M/s", n / elapsed_secs(start) / 1e6);
+    start = clock();
+    for (size_t i = 0; i < n; ++i)
+        ht_get(&ht, &probes[i].link);
+    printf(", hits %6.2f M/s", n / elapsed_secs(start) / 1e6);
+    start = clock();
+    for (size_t i = n; i < nprobes; ++i)
+        ht_get(&ht, &probes[i].link);
+    printf(", misses %6.2f M/s\n", n / elapsed_secs(start) / 1e6);
+    start = clock();
+    for (size_t i = 0; i < n; ++i)
+        ht_find_hashed(&ht, probes[i].link.hashcode, probes[i].name, item_eq);
+    printf("  find_hashed:       hits %6.2f M/s\n", n / elapsed_secs(start) / 1e6);
+
+    start = clock();
+    for (size_t i = 0; i < n; ++i)
+        oht_put(&oht, &items[i]->oe);
+    printf("ss_ohmap: put %6.2f M/s", n / elapsed_secs(start) / 1e6);
+    start = clock();
+    for (size_t i = 0; i < n; ++i)
+        oht_get(&oht, &probes[i].oe);
+    printf(", hits %6.2f M/s", n / elapsed_secs(start) / 1e6);
+    start = clock();
+    for (size_t i = n; i < nprobes; ++i)
+        oht_get(&oht, &probes[i].oe);
+    printf(", misses %6.2f M/s\n", n / elapsed_secs(start) / 1e6);
+    start = clock();
+    for (size_t i = 0; i < n; ++i)
+        oht_find_hashed(&oht, probes[i].oe.hashcode, probes[i].name, item_eq);
+    printf("  find_hashed:       hits %6.2f M/s\n", n / elapsed_secs(start) / 1e6);
+
+    /* Removing the keys without the objects at hand */
+    size_t removed = 0;
+    for (size_t i = 0; i < n; i += 2) {
+        removed += ht_delete_hashed(&ht, probes[i].link.hashcode, probes[i].name, item_eq) != NULL;
+        removed += oht_delete_hashed(&oht, probes[i].oe.hashcode, probes[i].name, item_eq) != NULL;
+    }
+    printf("removed %zu, left %u and %u\n", removed, ht.n, oht.n);
+
+    ht_clear(&ht);
+    oht_clear(&oht);
+    for (size_t i = 0; i < n; ++i)
+        free(items[i]);
+    free(items);
+    free(probes);
+}
@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "ss_mindex.h"
+
+#define MI_ENTRY(mi,obj) ((ss_mindex_entry_t*)((char*)(obj) + (mi)->offset))
+#define MI_VALUE(mi,e) ((void*)((char*)(e) - (mi)->offset))
+
+ss_mindex_t* mi_init(ss_mindex_t* mi,
+                     uint32_t initial_size,
+                     uint32_t (*hfn)(void* obj),
+                     int (*compar)(void* o1, void* o2),
+                     int (*order)(ss_avl_node* a, ss_avl_node* b),
+                     size_t offset,
+                     bool use_lru)
+{
+    if (!ht_init(&mi->hash, initial_size, compar,
+                offset + offsetof(ss_mindex_entry_t, hlink)))
+        return NULL;
+    ss_avl_init(&mi->tree, order);
+    list_init_head(&mi->lru);
+    mi->use_lru = use_lru;
+    mi->hfn = hfn;
+    mi->offset = offset;
+    return mi;
+}
+
+void mi_clear(ss_mindex_t* mi)
+{
+    ht_clear(&mi->hash);
+    ss_avl_init(&mi->tree, mi->tree.compar);
+    list_init_head(&mi->lru);
+}
+
+static void _mi_touch(ss_mindex_t* mi, ss_mindex_entry_t* e)
+{
+    if (mi->use_lru) {
+        list_del(&e->lru);
+        list_insert(&mi->lru, &e->lru);
+    }
+}
+
+void* mi_insert(ss_mindex_t* mi, ss_mindex_entry_t* entry)
+{
+    void* obj = MI_VALUE(mi, entry);
+    entry->hlink.hashcode = mi->hfn(obj);
+    void* found = ht_put(&mi->hash, &entry->hlink);
+    if (found != obj)
+        return found;
+
+    unsigned n = mi->tree.n;
+    ss_avl_insert(&mi->tree, &entry->tlink);
+    /* Equal for `order` but with a different key: see ss_mindex.h */
+    assert(mi->tree.n == n + 1);
+    (void) n;
+
+    list_init_head(&entry->lru);
+    if (mi->use_lru)
+        list_insert(&mi->lru, &entry->lru);
+    return obj;
+}
+
+static void _mi_unlink(ss_mindex_t* mi, ss_mindex_entry_t* e)
+{
+    ht_delete(&mi->hash, &e->hlink);
+    ss_avl_delete(&mi->tree, &e->tlink);
+    if (mi->use_lru)
+        list_del(&e->lru);
+}
+
+void* mi_delete(ss_mindex_t* mi, ss_mindex_entry_t* entry)
+{
+    entry->hlink.hashcode = mi->hfn(MI_VALUE(mi, entry));
+    void* found = ht_get(&mi->hash, &entry->hlink);
+    if (!found)
+        return NULL;
+    _mi_unlink(mi, MI_ENTRY(mi, found));
+    return found;
+}
+
+void* mi_replace(ss_mindex_t* mi, ss_mindex_entry_t* entry)
+{
+    void* old = mi_delete(mi, entry);
+    mi_insert(mi, entry);
+    return old;
+}
+
+void mi_update(ss_mindex_t* mi, ss_mindex_entry_t* entry,
+        void (*update)(void* obj, void* arg), void* arg)
+{
+    void* obj = MI_VALUE(mi, entry);
+    ss_avl_delete(&mi->tree, &entry->tlink);
+    update(obj, arg);
+    assert(mi->hfn(obj) == entry->hlink.hashcode);
+    ss_avl_insert(&mi->tree, &entry->tlink);
+    _mi_touch(mi, entry);
+}
+
+void* mi_find(ss_mindex_t* mi, ss_mindex_entry_t* entry)
+{
+    entry->hlink.hashcode = mi->hfn(MI_VALUE(mi, entry));
+    void* found = ht_get(&mi->hash, &entry->hlink);
+    if (found)
+        _mi_touch(mi, MI_ENTRY(mi, found));
+    return found;
+}
+
+void* mi_find_hashed(ss_mindex_t* mi, uint32_t hash, const void* key,
+        bool (*eq)(const void* key, void* obj))
+{
+    void* found = ht_find_hashed(&mi->hash, hash, key, eq);
+    if (found)
+        _mi_touch(mi, MI_ENTRY(mi, found));
+    return found;
+}
+
+/*
+ * In order traversal of the subtree, skipping the subtrees that are
+ * out of the range. Returns non zero if the action asked to stop
+ */
+static int _mi_range(ss_mindex_t* mi, ss_avl_node* node,
+        ss_avl_node* lo, ss_avl_node* hi,
+        int (*action)(void* obj, void* arg), void* arg)
+{
+    while (node) {
+        int clo = lo ? mi->tree.compar(node, lo) : 1;
+        int chi = hi ? mi->tree.compar(node, hi) : -1;
+        if (clo > 0 && _mi_range(mi, node->left, lo, hi, action, arg))
+            return 1;
+        if (clo >= 0 && chi <= 0) {
+            ss_mindex_entry_t* e = (ss_mindex_entry_t*)
+                ((char*) node - offsetof(ss_mindex_entry_t, tlink));
+            if (action(MI_VALUE(mi, e), arg))
+                return 1;
+        }
+        if (chi >= 0)
+            return 0;
+        /* Loop instead of recursing on the right */
+        node = node->right;
+    }
+    return 0;
+}
+
+void mi_range(ss_mindex_t* mi, ss_avl_node* lo, ss_avl_node* hi,
+        int (*action)(void* obj, void* arg), void* arg)
+{
+    _mi_range(mi, mi->tree.root, lo, hi, action, arg);
+}
+
+void* mi_lru_oldest(ss_mindex_t* mi)
+{
+    if (!mi->use_lru || list_empty(&mi->lru))
+        return NULL;
+    ss_mindex_entry_t* e = list_entry(mi->lru.prev, ss_mindex_entry_t, lru);
+    return MI_VALUE(mi, e);
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "ss_hmap.h"
+#include "ss_avl_tree.h"
+#include "list.h"
+
+    /*
+     * A container that keeps the same (intrusive) objects in an ss_hmap,
+     * for lookups by key, and in an ss_avl_tree, for ordered range scans,
+     * and optionally in a least recently used list. Each object embeds
+     * one ss_mindex_entry_t with the links of all the indexes, and the
+     * container keeps them consistent: an object is either in all of
+     * them or in none.
+     *
+     * Two objects of the container must never be equal for `order`: it
+     * should break ties with the key of the hashmap.
+     */
+    typedef struct ss_mindex_entry {
+        ss_hmap_entry_t hlink;
+        ss_avl_node tlink;
+        struct list lru;
+    } ss_mindex_entry_t;
+
+    typedef struct ss_mindex {
+        ss_hmap_t hash;
+        ss_avl_tree tree;
+        struct list lru; /* most recently used first */
+        bool use_lru;
+        uint32_t (*hfn)(void* obj);
+        size_t offset;
+    } ss_mindex_t;
+
+    /* The object of an ordered index node */
+    #define SS_MINDEX_TREE_VALUE(mi,node) ((void*)((char*)(node) \
+                - offsetof(ss_mindex_entry_t, tlink) - (mi)->offset))
+
+    /*
+     * Initializes the container. `hfn` returns the hash of the key of an
+     * object and `compar` compares the keys of two objects (0 if equal),
+     * `order` compares the ss_avl_node of two objects for the ordered
+     * index (see SS_MINDEX_TREE_VALUE) and `offset` is the offset of
+     * the ss_mindex_entry_t in the objects
+     */
+    ss_mindex_t* mi_init(ss_mindex_t* mi,
+            uint32_t initial_size,
+            uint32_t (*hfn)(void* obj),
+            int (*compar)(void* o1, void* o2),
+            int (*order)(ss_avl_node* a, ss_avl_node* b),
+            size_t offset,
+            bool use_lru);
+
+    /*
+     * Inserts the object of entry in all the indexes and returns it.
+     * If an object with the same key exists already it returns that
+     * one, and nothing changes
+     */
+    void* mi_insert(ss_mindex_t* mi, ss_mindex_entry_t* entry);
+
+    /*
+     * Inserts the object of entry in the place of the one with the same
+     * key, if any, which is returned (so that the caller can free it).
+     * Returns NULL if there was no such object
+     */
+    void* mi_replace(ss_mindex_t* mi, ss_mindex_entry_t* entry);
+
+    /*
+     * Removes the object with the same key as the one of entry from all
+     * the indexes and returns it, or NULL if not found
+     */
+    void* mi_delete(ss_mindex_t* mi, ss_mindex_entry_t* entry);
+
+    /*
+     * Calls `update` for an object of the container, so that it can
+     * change the fields that `order` looks at, and moves it to its new
+     * place in the ordered index. The key of the object must not change
+     */
+    void mi_update(ss_mindex_t* mi, ss_mindex_entry_t* entry,
+            void (*update)(void* obj, void* arg), void* arg);
+
+    /*
+     * Finds the object with the same key as the one of entry, or with
+     * the given key and hash (see ht_find_hashed). Returns NULL if not
+     * found. The object found becomes the most recently used
+     */
+    void* mi_find(ss_mindex_t* mi, ss_mindex_entry_t* entry);
+    void* mi_find_hashed(ss_mindex_t* mi, uint32_t hash, const void* key,
+            bool (*eq)(const void* key, void* obj));
+
+    /*
+     * Calls `action` for the objects from `lo` up to `hi` (inclusive)
+     * in order, where `lo` and `hi` are nodes of objects (not
+     * necessarily in the container) to compare with, or NULL for no
+     * bound. Stops if `action` returns non zero
+     */
+    void mi_range(ss_mindex_t* mi, ss_avl_node* lo, ss_avl_node* hi,
+            int (*action)(void* obj, void* arg), void* arg);
+
+    /*
+     * Returns the least recently used (inserted or found) object, or
+     * NULL if empty or if the container does not keep the LRU list
+     */
+    void* mi_lru_oldest(ss_mindex_t* mi);
+
+    #define mi_size(mi) ((mi)->hash.n)
+
+    /*
+     * frees the memory used internally by the container. The objects
+     * are not touched
+     */
+    void mi_clear(ss_mindex_t* mi);
+
+#ifdef __cplusplus
+}
+#endif
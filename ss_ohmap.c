@@ -0,0 +1,194 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "ss_ohmap.h"
+
+#define OHT_MIN_BITS 3
+#define HASH_SIZE(ht) ((ht)->size)
+
+/*
+ * Fibonacci hashing: the top bits of the hashcode times 2^32/phi, so
+ * that weak hash functions are spread over the whole table too
+ */
+#define oht_home(ht,h) ((uint32_t) ((h) * 2654435769U) >> (32 - (ht)->bits))
+#define oht_next(ht,i) (((i) + 1) & ((ht)->size - 1))
+
+#define SS_OHMAP_ENTRY_VALUE(ht,e) ((void*)((char*)(e) - (ht)->offset))
+
+static int _oht_alloc(ss_ohmap_t* ht, unsigned int bits)
+{
+    ss_ohmap_slot_t* table = calloc(1U << bits, sizeof *table);
+    if (!table) {
+        perror("oht_alloc");
+        return -1;
+    }
+    ht->table = table;
+    ht->bits = bits;
+    ht->size = 1U << bits;
+    return 0;
+}
+
+ss_ohmap_t* oht_init(ss_ohmap_t* h,
+                     uint32_t initial_size,
+                     int (*fn)(void* e1, void* e2),
+                     size_t offset)
+{
+    unsigned int bits = OHT_MIN_BITS;
+    while (bits < 31 && (1U << bits) < initial_size)
+        ++bits;
+    h->n = 0;
+    h->offset = offset;
+    h->compar = fn;
+    if (_oht_alloc(h, bits) < 0)
+        return NULL;
+    return h;
+}
+
+void oht_clear(ss_ohmap_t* ht)
+{
+    free(ht->table);
+    ht->table = NULL;
+    ht->size = 0;
+    ht->bits = 0;
+    ht->n = 0;
+}
+
+float oht_load_factor(ss_ohmap_t* h)
+{
+    return h->n*1.0/HASH_SIZE(h);
+}
+
+/*
+ * Returns the slot of the entry with the same key, or of the empty
+ * slot that ends its probe sequence
+ */
+static ss_ohmap_slot_t* _oht_find(ss_ohmap_t* ht, ss_ohmap_entry_t* entry)
+{
+    uint32_t h = entry->hashcode;
+    void* key = SS_OHMAP_ENTRY_VALUE(ht, entry);
+    uint32_t i = oht_home(ht, h);
+    for (;; i = oht_next(ht, i)) {
+        ss_ohmap_slot_t* s = ht->table + i;
+        if (s->e == NULL)
+            return s;
+        if (s->hashcode == h && ht->compar(key, SS_OHMAP_ENTRY_VALUE(ht, s->e)) == 0)
+            return s;
+    }
+}
+
+static ss_ohmap_slot_t* _oht_find_hashed(ss_ohmap_t* ht, uint32_t h, const void* key,
+        bool (*eq)(const void* key, void* obj))
+{
+    uint32_t i = oht_home(ht, h);
+    for (;; i = oht_next(ht, i)) {
+        ss_ohmap_slot_t* s = ht->table + i;
+        if (s->e == NULL)
+            return s;
+        if (s->hashcode == h && eq(key, SS_OHMAP_ENTRY_VALUE(ht, s->e)))
+            return s;
+    }
+}
+
+static int _oht_rehash(ss_ohmap_t* ht)
+{
+    ss_ohmap_t hnew = *ht;
+    if (_oht_alloc(&hnew, ht->bits + 1) < 0)
+        return -1;
+    for (uint32_t i = 0; i < HASH_SIZE(ht); ++i) {
+        ss_ohmap_slot_t* s = ht->table + i;
+        if (s->e == NULL)
+            continue;
+        /* All keys are distinct: just find an empty slot */
+        uint32_t j = oht_home(&hnew, s->hashcode);
+        while (hnew.table[j].e)
+            j = oht_next(&hnew, j);
+        hnew.table[j] = *s;
+    }
+    free(ht->table);
+    ht->table = hnew.table;
+    ht->size = hnew.size;
+    ht->bits = hnew.bits;
+    return 0;
+}
+
+static void _oht_remove_slot(ss_ohmap_t* ht, ss_ohmap_slot_t* s)
+{
+    /*
+     * Backward shift deletion: move back the entries that follow, up
+     * to the next empty slot, if the hole is in their probe sequence.
+     * No tombstones are needed
+     */
+    uint32_t i = s - ht->table;
+    uint32_t j = i;
+    for (;;) {
+        j = oht_next(ht, j);
+        ss_ohmap_slot_t* t = ht->table + j;
+        if (t->e == NULL)
+            break;
+        uint32_t home = oht_home(ht, t->hashcode);
+        /* Is home cyclically in (i, j] ? Then it must stay */
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+            continue;
+        ht->table[i] = *t;
+        i = j;
+    }
+    ht->table[i].e = NULL;
+    ht->table[i].hashcode = 0;
+    ht->n--;
+}
+
+void oht_delete(ss_ohmap_t* ht, ss_ohmap_entry_t* entry)
+{
+    ss_ohmap_slot_t* s = _oht_find(ht, entry);
+    if (s->e)
+        _oht_remove_slot(ht, s);
+}
+
+void* oht_delete_hashed(ss_ohmap_t* ht, uint32_t hash, const void* key,
+        bool (*eq)(const void* key, void* obj))
+{
+    ss_ohmap_slot_t* s = _oht_find_hashed(ht, hash, key, eq);
+    if (s->e == NULL)
+        return NULL;
+    void* obj = SS_OHMAP_ENTRY_VALUE(ht, s->e);
+    _oht_remove_slot(ht, s);
+    return obj;
+}
+
+void* oht_find_hashed(ss_ohmap_t* ht, uint32_t hash, const void* key,
+        bool (*eq)(const void* key, void* obj))
+{
+    ss_ohmap_slot_t* s = _oht_find_hashed(ht, hash, key, eq);
+    return s->e ? SS_OHMAP_ENTRY_VALUE(ht, s->e) : NULL;
+}
+
+void* oht_get(ss_ohmap_t* ht, ss_ohmap_entry_t* entry)
+{
+    ss_ohmap_slot_t* s = _oht_find(ht, entry);
+    return s->e ? SS_OHMAP_ENTRY_VALUE(ht, s->e) : NULL;
+}
+
+bool oht_contains(ss_ohmap_t* ht, ss_ohmap_entry_t* entry)
+{
+    return _oht_find(ht, entry)->e != NULL;
+}
+
+void* oht_put(ss_ohmap_t* ht, ss_ohmap_entry_t* entry)
+{
+    ss_ohmap_slot_t* s = _oht_find(ht, entry);
+    if (s->e)
+        return SS_OHMAP_ENTRY_VALUE(ht, s->e);
+
+    if (ht->n + 1 > (3*ht->size >> 2)) { /* Use the 0.75 factor */
+        if (_oht_rehash(ht) < 0)
+            return NULL;
+        s = _oht_find(ht, entry);
+    }
+    s->hashcode = entry->hashcode;
+    s->e = entry;
+    ht->n++;
+    return SS_OHMAP_ENTRY_VALUE(ht, entry);
+}
@@ -0,0 +1,95 @@
+#ifndef __SS_OHMAP_H__
+#define __SS_OHMAP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+    /*
+     * An intrusive hashmap like ss_hmap, but with open addressing:
+     * the table is a flat array of (hashcode, entry) pairs searched by
+     * linear probing, so a lookup compares hashcodes in contiguous
+     * memory and calls `compar` only when the full hashcode matches.
+     * The user objects need only embed the hashcode.
+     */
+    typedef struct ss_ohmap_entry {
+        uint32_t hashcode;
+    } ss_ohmap_entry_t;
+
+    typedef struct ss_ohmap_slot {
+        uint32_t hashcode;
+        ss_ohmap_entry_t* e; /* NULL if the slot is empty */
+    } ss_ohmap_slot_t;
+
+    typedef struct ss_ohmap  {
+        ss_ohmap_slot_t* table;
+        uint32_t size; /* number of slots, a power of 2 */
+        unsigned int bits; /* log2(size) */
+        unsigned int n; /* current number of elements (entries) */
+        int (*compar)(void* e1, void* e2);
+        size_t offset;
+    } ss_ohmap_t;
+
+    /*
+     * Initializes the hashmap for about initial_size entries. `offset`
+     * is the offset of the ss_ohmap_entry_t in the user's objects
+     */
+    ss_ohmap_t* oht_init(ss_ohmap_t* h,
+            uint32_t initial_size,
+            int (*compar)(void* e1, void* e2),
+            size_t offset);
+
+    /*
+     * Returns the current "load factor" of the hashmap
+     */
+    float oht_load_factor(ss_ohmap_t* h);
+
+    void oht_delete(ss_ohmap_t* ht, ss_ohmap_entry_t* entry);
+
+    /*
+     * Finds the object with the same key as the one of entry.
+     * Returns NULL if not found
+     */
+    void* oht_get(ss_ohmap_t* ht, ss_ohmap_entry_t* entry);
+
+    /*
+     * Finds the object with the given key and hash, see ht_find_hashed
+     * of ss_hmap.h
+     */
+    void* oht_find_hashed(ss_ohmap_t* ht, uint32_t hash, const void* key,
+            bool (*eq)(const void* key, void* obj));
+
+    /*
+     * Finds and removes the object with the given key and hash.
+     * Returns the object removed, or NULL
+     */
+    void* oht_delete_hashed(ss_ohmap_t* ht, uint32_t hash, const void* key,
+            bool (*eq)(const void* key, void* obj));
+
+    /*
+     * Inserts the object of entry in the hashmap and returns it. If an
+     * object with the same key exists already it returns that one.
+     * Returns NULL if memory runs out
+     */
+    void* oht_put(ss_ohmap_t* ht, ss_ohmap_entry_t* entry);
+
+    /*
+     * Checks if the given key is contained in the hashmap
+     */
+    bool oht_contains(ss_ohmap_t* ht, ss_ohmap_entry_t* entry);
+
+    /*
+     * frees the memory used internally by the hash map. The caller
+     * is responsible for freeing the pointer to the map itself.
+     */
+    void oht_clear(ss_ohmap_t* ht);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,112 @@
+#define _DEFAULT_SOURCE /* clock_gettime, syscall */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "lch_hmap.h"
+#include "pgalloc.h"
+#include "hfn.h"
+
+/*
+ * Lookups of keys that are not in a big map, so that (most of the
+ * time) only a random bucket is read, with the buckets on 4 KB pages,
+ * on transparent huge pages, and on 2 MB huge pages of the reserved
+ * pool. The data TLB misses are counted with perf_event_open, where
+ * the kernel allows it (see /proc/sys/kernel/perf_event_paranoid)
+ */
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* The counter of dTLB load misses of this thread, or -1 */
+static int tlb_counter_open(void)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static long long tlb_counter_read(int fd)
+{
+    long long count = -1;
+    if (fd < 0 || read(fd, &count, sizeof count) != sizeof count)
+        return -1;
+    return count;
+}
+
+static void run(const char* what, const pg_policy_t* policy, uint32_t n, char (*probes)[32])
+{
+    lch_hmap_t* ht = ht_create_ex(n, fnv32_hash, policy);
+    if (!ht)
+        return;
+    char key[32];
+    /* A few keys, so that the buckets of the probes are mostly empty */
+    for (uint32_t i = 0; i < n / 64; ++i) {
+        int len = sprintf(key, "key:%u", i);
+        ht_put_hashed(ht, key, len, fnv32_hash(key, len));
+    }
+
+    int fd = tlb_counter_open();
+    long long before = tlb_counter_read(fd);
+    double start = now_ns();
+    long found = 0;
+    for (uint32_t i = 0; i < n; ++i)
+        found += ht_contains(ht, probes[i]);
+    double ns = (now_ns() - start) / n;
+    long long after = tlb_counter_read(fd);
+    if (fd >= 0)
+        close(fd);
+
+    printf("%-20s %6.1f ns/lookup", what, ns);
+    if (before >= 0 && after >= 0)
+        printf(", %.3f dTLB misses/lookup", (double) (after - before) / n);
+    else
+        printf(", dTLB misses not available");
+    printf(" (%ld found, %u buckets)\n", found, ht_stats(ht).capacity);
+    ht_destroy(ht, NULL);
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 8000000;
+    char (*probes)[32] = malloc((size_t) n * sizeof *probes);
+    if (!probes) {
+        perror("tlb_bench");
+        return 1;
+    }
+    srand(42);
+    for (uint32_t i = 0; i < n; ++i)
+        sprintf(probes[i], "probe:%d", rand());
+
+    pg_policy_t small = {PG_PAGES_DEFAULT, PG_NUMA_DEFAULT, 0};
+    pg_policy_t thp = {PG_PAGES_THP, PG_NUMA_DEFAULT, 0};
+    pg_policy_t huge = {PG_PAGES_HUGE_2MB, PG_NUMA_DEFAULT, 0};
+    run("4 KB pages", &small, n, probes);
+    run("transparent huge", &thp, n, probes);
+    run("2 MB huge pages", &huge, n, probes);
+    free(probes);
+}
@@ -0,0 +1,96 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "lch_hmap.h"
+#include "hfn.h"
+
+/*
+ * A cache of sessions with a time to live of 1 to TTL_MAX ticks, where
+ * a tick adds NEW_PER_TICK sessions and then expires the old ones: by
+ * traversing the whole map for the expired keys (with the deadline in
+ * the value) and deleting them, and by ht_expire
+ */
+
+#define SESSIONS 1000000
+#define TTL_MAX 600
+#define NEW_PER_TICK (SESSIONS / TTL_MAX)
+#define TICKS 100
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+struct expired {
+    uint64_t now;
+    char (*keys)[32];
+    size_t n;
+};
+
+static int collect_expired(lch_key_t key, lch_value_t val, void* arg)
+{
+    struct expired* x = arg;
+    if ((uint64_t) val.l <= x->now)
+        strcpy(x->keys[x->n++], key);
+    return 0;
+}
+
+static void add_sessions(lch_hmap_t* ht, bool expiry, uint64_t tick, long* id, long n)
+{
+    char key[32];
+    for (long i = 0; i < n; ++i, ++*id) {
+        int len = sprintf(key, "session:%ld", *id);
+        uint64_t deadline = tick + 1 + rand() % TTL_MAX;
+        ht_put(ht, key)->l = deadline;
+        if (expiry)
+            ht_set_deadline(ht, key, len, deadline);
+    }
+}
+
+static void run(bool expiry)
+{
+    lch_hmap_t* ht = ht_create(701, fnv32_hash);
+    if (expiry)
+        ht_enable_expiry(ht, NULL);
+    struct expired x = { 0, malloc(SESSIONS * sizeof *x.keys), 0 };
+    long id = 0;
+    srand(42);
+    add_sessions(ht, expiry, 0, &id, SESSIONS);
+
+    double ms = 0;
+    size_t removed = 0;
+    for (uint64_t tick = 1; tick <= TICKS; ++tick) {
+        add_sessions(ht, expiry, tick, &id, NEW_PER_TICK);
+        double start = now_ms();
+        if (expiry)
+            removed += ht_expire(ht, tick, SIZE_MAX);
+        else {
+            x.now = tick;
+            x.n = 0;
+            ht_traverse(ht, collect_expired, &x);
+            for (size_t i = 0; i < x.n; ++i)
+                ht_delete(ht, x.keys[i]);
+            removed += x.n;
+        }
+        ms += now_ms() - start;
+    }
+    printf("%-22s %8.3f ms/tick, %zu expired, %u sessions left\n",
+            expiry ? "ht_expire" : "ht_traverse + delete", ms / TICKS,
+            removed, ht_stats(ht).nbr_elems);
+    free(x.keys);
+    ht_destroy(ht, NULL);
+}
+
+int main(void)
+{
+    run(false);
+    run(true);
+}
@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include "lch_hmap.h"
+#include "hset.h"
+#include "hfn.h"
+#include "u64_hmap.h"
+
+/*
+ * Counting 64 bit IDs with the u64 map and set, against the old way of
+ * printing them in strings for lch_hmap and hset
+ */
+
+static uint64_t splitmix64(uint64_t* x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+#define elapsed_ms(start) (1000.0 * (clock() - (start)) / CLOCKS_PER_SEC)
+
+int main(int argc, char* argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000;
+    size_t distinct = n / 4;
+    uint64_t* ids = malloc(n * sizeof *ids);
+    uint64_t seed = 42;
+    for (size_t i = 0; i < n; ++i) {
+        /* every ID appears 4 times on average */
+        uint64_t x = splitmix64(&seed) % distinct;
+        ids[i] = fmix64(x + 1);
+    }
+    char buf[32];
+    clock_t start;
+
+    start = clock();
+    u64_hmap_t* m = u64ht_create(0);
+    for (size_t i = 0; i < n; ++i)
+        u64ht_put(m, ids[i])->l++;
+    double put_ms = elapsed_ms(start);
+    start = clock();
+    long found = 0;
+    for (size_t i = 0; i < n; ++i)
+        found += u64ht_get(m, ids[i]) != NULL;
+    double get_ms = elapsed_ms(start);
+    u64_hmap_stats_t st = u64ht_stats(m);
+    printf("u64 map:    put %8.2f ms get %8.2f ms (%u keys, max probe %u, %ld found)\n",
+            put_ms, get_ms, st.nbr_elems, st.max_probe, found);
+    u64ht_destroy(m, NULL);
+
+    start = clock();
+    lch_hmap_t* ht = ht_create(701, fnv32_hash);
+    for (size_t i = 0; i < n; ++i) {
+        sprintf(buf, "%" PRIu64, ids[i]);
+        ht_put(ht, buf)->l++;
+    }
+    put_ms = elapsed_ms(start);
+    start = clock();
+    found = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sprintf(buf, "%" PRIu64, ids[i]);
+        found += ht_get(ht, buf) != NULL;
+    }
+    get_ms = elapsed_ms(start);
+    printf("string map: put %8.2f ms get %8.2f ms (%u keys, %ld found)\n",
+            put_ms, get_ms, ht_stats(ht).nbr_elems, found);
+    ht_destroy(ht, NULL);
+
+    start = clock();
+    u64_hset_t* s = u64hs_create(0);
+    for (size_t i = 0; i < n; ++i)
+        u64hs_add(s, ids[i]);
+    double add_ms = elapsed_ms(start);
+    start = clock();
+    found = 0;
+    for (size_t i = 0; i < n; ++i)
+        found += u64hs_contains(s, ids[i]);
+    double contains_ms = elapsed_ms(start);
+    printf("u64 set:    add %8.2f ms contains %8.2f ms (%zu keys, %ld found)\n",
+            add_ms, contains_ms, u64hs_size(s), found);
+    u64hs_destroy(s);
+
+    start = clock();
+    hset_t* hs = hs_create(0);
+    for (size_t i = 0; i < n; ++i) {
+        sprintf(buf, "%" PRIu64, ids[i]);
+        hs_add(hs, buf);
+    }
+    add_ms = elapsed_ms(start);
+    start = clock();
+    found = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sprintf(buf, "%" PRIu64, ids[i]);
+        found += hs_contains(hs, buf);
+    }
+    contains_ms = elapsed_ms(start);
+    printf("string set: add %8.2f ms contains %8.2f ms (%zu keys, %ld found)\n",
+            add_ms, contains_ms, hs_size(hs), found);
+    hs_destroy(hs);
+
+    free(ids);
+}
@@ -0,0 +1,333 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "u64_hmap.h"
+#include "hfn.h"
+
+#define U64_EMPTY 0ULL
+#define U64_MIN_BITS 3U
+#define U64_MAX_BITS 31U
+
+#define U64_SIZE(ht) (1U << (ht)->bits)
+/* The top bits of the mixed key give the home slot */
+#define u64_home(ht,k) ((uint32_t) (fmix64(k) >> (64 - (ht)->bits)))
+
+static uint32_t _u64_bits_for(uint32_t n)
+{
+    uint32_t bits = U64_MIN_BITS;
+    while ((1U << bits) < n && bits < U64_MAX_BITS)
+        ++bits;
+    return bits;
+}
+
+/*
+ * Can the key at slot j, whose home slot is k, move back to the
+ * free slot i? Only if i is not before k in its probe sequence
+ */
+#define u64_can_shift(i,j,k,mask) ((((j) - (k)) & (mask)) >= (((j) - (i)) & (mask)))
+
+
+/**********************************************************
+ *  The map
+ *********************************************************/
+
+typedef struct {
+    uint64_t key;
+    lch_value_t val;
+} u64_hmap_entry_t;
+
+struct u64_hmap {
+    u64_hmap_entry_t* table;
+    uint32_t bits; /* the table has 1 << bits slots */
+    uint32_t n; /* entries in the table, so not counting the key 0 */
+    unsigned int max_probe;
+    bool has_zero;
+    lch_value_t zero_val; /* the value of key 0, if has_zero */
+};
+
+u64_hmap_t* u64ht_create(uint32_t initial_size)
+{
+    u64_hmap_t* ht = calloc(1U, sizeof *ht);
+    if (!ht) {
+        perror("u64ht_create");
+        return NULL;
+    }
+    ht->bits = _u64_bits_for(initial_size);
+    ht->table = calloc(U64_SIZE(ht), sizeof *ht->table);
+    if (!ht->table) {
+        perror("u64ht_create");
+        free(ht);
+        return NULL;
+    }
+    return ht;
+}
+
+void u64ht_destroy(u64_hmap_t* ht, void (*destroy_val_fn) (lch_value_t))
+{
+    if (destroy_val_fn) {
+        for (u64_hmap_entry_t* e = ht->table; e != ht->table + U64_SIZE(ht); ++e) {
+            if (e->key != U64_EMPTY)
+                destroy_val_fn(e->val);
+        }
+        if (ht->has_zero)
+            destroy_val_fn(ht->zero_val);
+    }
+    free(ht->table);
+    free(ht);
+}
+
+u64_hmap_stats_t u64ht_stats(u64_hmap_t* ht)
+{
+    u64_hmap_stats_t t = {
+        .nbr_elems = ht->n + ht->has_zero,
+        .capacity = U64_SIZE(ht),
+        .max_probe = ht->max_probe
+    };
+    return t;
+}
+
+static int _u64ht_rehash(u64_hmap_t* ht)
+{
+    if (ht->bits == U64_MAX_BITS)
+        return -1;
+    uint32_t bits = ht->bits + 1;
+    uint32_t mask = (1U << bits) - 1;
+    u64_hmap_entry_t* table = calloc(1U << bits, sizeof *table);
+    if (!table) {
+        perror("_u64ht_rehash");
+        return -1;
+    }
+    u64_hmap_entry_t* old = ht->table;
+    uint32_t old_size = U64_SIZE(ht);
+    ht->table = table;
+    ht->bits = bits;
+    ht->max_probe = 0;
+    for (u64_hmap_entry_t* e = old; e != old + old_size; ++e) {
+        if (e->key == U64_EMPTY)
+            continue;
+        unsigned int probe = 0;
+        uint32_t i;
+        for (i = u64_home(ht, e->key); table[i].key != U64_EMPTY; i = (i + 1) & mask)
+            ++probe;
+        table[i] = *e;
+        if (probe > ht->max_probe)
+            ht->max_probe = probe;
+    }
+    free(old);
+    return 0;
+}
+
+lch_value_t* u64ht_get(u64_hmap_t* ht, uint64_t key)
+{
+    if (key == U64_EMPTY)
+        return ht->has_zero ? &ht->zero_val : NULL;
+    uint32_t mask = U64_SIZE(ht) - 1;
+    for (uint32_t i = u64_home(ht, key); ; i = (i + 1) & mask) {
+        u64_hmap_entry_t* e = ht->table + i;
+        if (e->key == key)
+            return &e->val;
+        if (e->key == U64_EMPTY)
+            return NULL;
+    }
+}
+
+bool u64ht_contains(u64_hmap_t* ht, uint64_t key)
+{
+    return u64ht_get(ht, key) != NULL;
+}
+
+lch_value_t* u64ht_put(u64_hmap_t* ht, uint64_t key)
+{
+    if (key == U64_EMPTY) {
+        ht->has_zero = true;
+        return &ht->zero_val;
+    }
+    uint32_t mask = U64_SIZE(ht) - 1;
+    uint32_t i;
+    for (i = u64_home(ht, key); ht->table[i].key != U64_EMPTY; i = (i + 1) & mask) {
+        if (ht->table[i].key == key)
+            return &ht->table[i].val;
+    }
+
+    if (ht->n + 1 > (3*U64_SIZE(ht) >> 2)) { /* Use the 0.75 factor */
+        if (_u64ht_rehash(ht) < 0)
+            return NULL;
+        mask = U64_SIZE(ht) - 1;
+    }
+    unsigned int probe = 0;
+    for (i = u64_home(ht, key); ht->table[i].key != U64_EMPTY; i = (i + 1) & mask)
+        ++probe;
+    if (probe > ht->max_probe)
+        ht->max_probe = probe;
+    ht->table[i].key = key;
+    ht->n++;
+    return &ht->table[i].val;
+}
+
+void u64ht_delete(u64_hmap_t* ht, uint64_t key)
+{
+    if (key == U64_EMPTY) {
+        ht->has_zero = false;
+        ht->zero_val.l = 0;
+        return;
+    }
+    uint32_t mask = U64_SIZE(ht) - 1;
+    uint32_t i;
+    for (i = u64_home(ht, key); ht->table[i].key != key; i = (i + 1) & mask) {
+        if (ht->table[i].key == U64_EMPTY)
+            return;
+    }
+    /*
+     * Backward shift deletion: move back the following keys of the
+     * cluster that may take the freed slot, so no tombstones are needed
+     */
+    for (uint32_t j = (i + 1) & mask; ht->table[j].key != U64_EMPTY; j = (j + 1) & mask) {
+        uint32_t k = u64_home(ht, ht->table[j].key);
+        if (u64_can_shift(i, j, k, mask)) {
+            ht->table[i] = ht->table[j];
+            i = j;
+        }
+    }
+    memset(ht->table + i, 0, sizeof ht->table[i]);
+    ht->n--;
+}
+
+void u64ht_traverse(u64_hmap_t* ht,
+        int (*action) (uint64_t, lch_value_t, void*), void* arg)
+{
+    if (ht->has_zero && action(U64_EMPTY, ht->zero_val, arg) < 0)
+        return;
+    for (u64_hmap_entry_t* e = ht->table; e != ht->table + U64_SIZE(ht); ++e) {
+        if (e->key != U64_EMPTY && action(e->key, e->val, arg) < 0)
+            return;
+    }
+}
+
+
+/**********************************************************
+ *  The set
+ *********************************************************/
+
+struct u64_hset {
+    uint64_t* table;
+    uint32_t bits;
+    uint32_t n; /* not counting the key 0 */
+    bool has_zero;
+};
+
+u64_hset_t* u64hs_create(uint32_t initialCapasity)
+{
+    u64_hset_t* h = calloc(1U, sizeof *h);
+    if (!h) {
+        perror("u64hs_create");
+        return NULL;
+    }
+    h->bits = _u64_bits_for(initialCapasity);
+    h->table = calloc(U64_SIZE(h), sizeof *h->table);
+    if (!h->table) {
+        perror("u64hs_create");
+        free(h);
+        return NULL;
+    }
+    return h;
+}
+
+void u64hs_destroy(u64_hset_t* h)
+{
+    free(h->table);
+    free(h);
+}
+
+size_t u64hs_size(u64_hset_t* h)
+{
+    return h->n + h->has_zero;
+}
+
+static int _u64hs_rehash(u64_hset_t* h)
+{
+    if (h->bits == U64_MAX_BITS)
+        return -1;
+    uint32_t bits = h->bits + 1;
+    uint32_t mask = (1U << bits) - 1;
+    uint64_t* table = calloc(1U << bits, sizeof *table);
+    if (!table) {
+        perror("_u64hs_rehash");
+        return -1;
+    }
+    uint64_t* old = h->table;
+    uint32_t old_size = U64_SIZE(h);
+    h->table = table;
+    h->bits = bits;
+    for (uint64_t* k = old; k != old + old_size; ++k) {
+        if (*k == U64_EMPTY)
+            continue;
+        uint32_t i;
+        for (i = u64_home(h, *k); table[i] != U64_EMPTY; i = (i + 1) & mask);
+        table[i] = *k;
+    }
+    free(old);
+    return 0;
+}
+
+bool u64hs_contains(u64_hset_t* h, uint64_t key)
+{
+    if (key == U64_EMPTY)
+        return h->has_zero;
+    uint32_t mask = U64_SIZE(h) - 1;
+    for (uint32_t i = u64_home(h, key); ; i = (i + 1) & mask) {
+        if (h->table[i] == key)
+            return true;
+        if (h->table[i] == U64_EMPTY)
+            return false;
+    }
+}
+
+bool u64hs_add(u64_hset_t* h, uint64_t key)
+{
+    if (key == U64_EMPTY) {
+        bool added = !h->has_zero;
+        h->has_zero = true;
+        return added;
+    }
+    uint32_t mask = U64_SIZE(h) - 1;
+    uint32_t i;
+    for (i = u64_home(h, key); h->table[i] != U64_EMPTY; i = (i + 1) & mask) {
+        if (h->table[i] == key)
+            return false;
+    }
+    if (h->n + 1 > (3*U64_SIZE(h) >> 2)) { /* Use the 0.75 factor */
+        if (_u64hs_rehash(h) < 0)
+            return false;
+        mask = U64_SIZE(h) - 1;
+        for (i = u64_home(h, key); h->table[i] != U64_EMPTY; i = (i + 1) & mask);
+    }
+    h->table[i] = key;
+    h->n++;
+    return true;
+}
+
+void u64hs_remove(u64_hset_t* h, uint64_t key)
+{
+    if (key == U64_EMPTY) {
+        h->has_zero = false;
+        return;
+    }
+    uint32_t mask = U64_SIZE(h) - 1;
+    uint32_t i;
+    for (i = u64_home(h, key); h->table[i] != key; i = (i + 1) & mask) {
+        if (h->table[i] == U64_EMPTY)
+            return;
+    }
+    for (uint32_t j = (i + 1) & mask; h->table[j] != U64_EMPTY; j = (j + 1) & mask) {
+        uint32_t k = u64_home(h, h->table[j]);
+        if (u64_can_shift(i, j, k, mask)) {
+            h->table[i] = h->table[j];
+            i = j;
+        }
+    }
+    h->table[i] = U64_EMPTY;
+    h->n--;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "lch_hmap.h"
+
+    /*
+     * Hash map and set for 64 bit integer keys.
+     *
+     * They use open addressing (linear probing) over packed arrays of
+     * keys (and values), with the key 0 marking the empty slots; the key
+     * 0 itself is kept aside, so all keys can be used. The slot of a key
+     * is given by mixing its bits with fmix64 of hfn.h.
+     *
+     * Unlike lch_hmap, the values move when the table grows, so the
+     * pointers returned by u64ht_put and u64ht_get are valid only until
+     * the next insertion or deletion.
+     */
+    typedef struct u64_hmap u64_hmap_t;
+
+    typedef struct {
+        unsigned int nbr_elems;
+        unsigned int capacity;
+        unsigned int max_probe; /* the longest probe sequence */
+    } u64_hmap_stats_t;
+
+    u64_hmap_t* u64ht_create(uint32_t initial_size);
+
+    lch_value_t* u64ht_get(u64_hmap_t* ht, uint64_t key);
+
+    /*
+     * Inserts a new key in the hashmap and returns its lch_value_t,
+     * initially zero. If the key exists already it returns the existing
+     * value
+     */
+    lch_value_t* u64ht_put(u64_hmap_t* ht, uint64_t key);
+    bool u64ht_contains(u64_hmap_t* ht, uint64_t key);
+    void u64ht_delete(u64_hmap_t* ht, uint64_t key);
+    u64_hmap_stats_t u64ht_stats(u64_hmap_t* ht);
+
+    void u64ht_traverse(u64_hmap_t* ht,
+            int (*action) (uint64_t, lch_value_t, void*), void* arg);
+
+    /*
+     * Destroys/deallocates the hashmap. If destroy_val_fn is not NULL
+     * it is called for each lch_value_t in the hashmap
+     */
+    void u64ht_destroy(u64_hmap_t* ht, void (*destroy_val_fn) (lch_value_t));
+
+
+    typedef struct u64_hset u64_hset_t;
+
+    u64_hset_t* u64hs_create(uint32_t initialCapasity);
+    /*
+     * Adds the key in the set, returning true if it was not there
+     * already
+     */
+    bool u64hs_add(u64_hset_t* h, uint64_t key);
+    bool u64hs_contains(u64_hset_t* h, uint64_t key);
+    void u64hs_remove(u64_hset_t* h, uint64_t key);
+    size_t u64hs_size(u64_hset_t* h);
+    void u64hs_destroy(u64_hset_t* h);
+
+#ifdef __cplusplus
+}
+#endif
@@ -11,37 +11,70 @@
 typedef struct vec {
     size_t size;
     size_t length;
+    size_t elem_size; /* sizeof(vec_entry), or see vec_create_sized */
+    pg_policy_t policy;
     vec_entry arr[];
 } Vec;
 
 
 #define _to_vec(_ptr_) ((Vec *)((void *)(_ptr_) - offsetof(Vec, arr)))
 
-static Vec* _vec_resize(Vec* v, size_t newSize)
+#define _vec_bytes(_n_, _elem_size_) (sizeof(Vec) + (_n_) * (_elem_size_))
+#define _vec_elem(_v_, _i_) ((char*) (_v_)->arr + (_i_) * (_v_)->elem_size)
+
+static Vec* _vec_resize(Vec* v, size_t elem_size, size_t newSize, const pg_policy_t* policy)
 {
-    size_t entry_size = sizeof(v->arr[0]);
-    if ((SIZE_MAX - sizeof(Vec)) / entry_size < newSize) {
+    if ((SIZE_MAX - sizeof(Vec)) / elem_size < newSize) {
         errno = ENOMEM;
         return NULL;
     }
-    Vec* t = realloc(v, sizeof(Vec) + newSize * entry_size);
+    pg_policy_t pol = *policy; /* it may be in v */
+    size_t old_bytes = v ? _vec_bytes(v->size, elem_size) : 0;
+    Vec* t = pg_realloc(v, old_bytes, _vec_bytes(newSize, elem_size), &pol);
     if (!t) {
         perror("_vec_resize");
-        free(v);
+        pg_free(v, old_bytes, &pol);
         return NULL;
     }
     /* fprintf(stderr, "Reallocating to size=%zu and &v=%p\n", newSize, t); */
     v = t;
     v->size = newSize;
+    v->elem_size = elem_size;
+    v->policy = pol;
     return v;
 }
 
-vec_entry* vec_create(size_t initialSize)
+/* Makes room for one more element */
+static Vec* _vec_grow(Vec* v)
+{
+    if (v->size < v->length + 1) {
+        size_t sz = (v->size * 3) >> 1;
+        v = _vec_resize(v, v->elem_size, sz, &v->policy);
+    }
+    return v;
+}
+
+/* Gives back memory, once a third at most is used */
+static Vec* _vec_shrink(Vec* v)
+{
+    if (3 * v->length < v->size) {
+        size_t sz = v->size >> 1;
+        v = _vec_resize(v, v->elem_size, sz, &v->policy);
+    }
+    return v;
+}
+
+void* vec_create_sized_ex(size_t elem_size, size_t initialSize, const pg_policy_t* policy)
 {
     const size_t DEFAULT_INIT_SIZE = 10;
+    const pg_policy_t default_policy = {0};
     size_t initial = initialSize > DEFAULT_INIT_SIZE ? initialSize : DEFAULT_INIT_SIZE;
     Vec* v = NULL;
-    v = _vec_resize(v, initial);
+    if (elem_size == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    v = _vec_resize(v, elem_size, initial, policy ? policy : &default_policy);
     if (!v) {
         return NULL;
     }
@@ -49,6 +82,21 @@ vec_entry* vec_create(size_t initialSize)
     return v->arr;
 }
 
+void* vec_create_sized(size_t elem_size, size_t initialSize)
+{
+    return vec_create_sized_ex(elem_size, initialSize, NULL);
+}
+
+vec_entry* vec_create_ex(size_t initialSize, const pg_policy_t* policy)
+{
+    return vec_create_sized_ex(sizeof(vec_entry), initialSize, policy);
+}
+
+vec_entry* vec_create(size_t initialSize)
+{
+    return vec_create_ex(initialSize, NULL);
+}
+
 
 void vec_free(vec_entry** a, void (*dtor)(vec_entry))
 {
@@ -60,27 +108,50 @@ void vec_free(vec_entry** a, void (*dtor)(vec_entry))
             for(size_t i=0; i < v->length; ++i)
                 dtor(v->arr[i]);
         }
-        free(v);
+        pg_policy_t policy = v->policy;
+        pg_free(v, _vec_bytes(v->size, v->elem_size), &policy);
+    }
+}
+
+void vec_free_sized(void* pa, void (*dtor)(void*))
+{
+    void** a = pa;
+    if (*a) {
+        Vec* v = _to_vec(*a);
+        *a = NULL;
+        if (dtor) {
+            for(size_t i=0; i < v->length; ++i)
+                dtor(_vec_elem(v, i));
+        }
+        pg_policy_t policy = v->policy;
+        pg_free(v, _vec_bytes(v->size, v->elem_size), &policy);
     }
 }
 
-size_t vec_size(vec_entry* a)
+size_t vec_size(const void* a)
 {
     Vec* v = _to_vec(a);
     return v->size;
 }
 
-size_t vec_length(vec_entry* a)
+size_t vec_length(const void* a)
 {
     Vec* v = _to_vec(a);
     return v->length;
 }
 
-vec_entry* vec_resize(vec_entry** a, size_t newSize)
+size_t vec_elem_size(const void* a)
 {
+    Vec* v = _to_vec(a);
+    return v->elem_size;
+}
+
+void* vec_resize_sized(void* pa, size_t newSize)
+{
+    void** a = pa;
     Vec* v = _to_vec(*a);
     if (v->size != newSize) {
-        v = _vec_resize(v, newSize);
+        v = _vec_resize(v, v->elem_size, newSize, &v->policy);
         if (!v)
             return NULL;
         *a = v->arr;
@@ -88,36 +159,50 @@ vec_entry* vec_resize(vec_entry** a, size_t newSize)
     return *a;
 }
 
+vec_entry* vec_resize(vec_entry** a, size_t newSize)
+{
+    return vec_resize_sized(a, newSize);
+}
+
 vec_entry* vec_append(vec_entry** a, vec_entry elem)
 {
-    Vec* v = _to_vec(*a);
-    size_t l = v->length;
-    if (v->size < l+1) {
-        size_t sz = (v->size * 3) >> 1;
-        v = _vec_resize(v, sz);
-        if (!v)
-            return NULL;
-    }
+    Vec* v = _vec_grow(_to_vec(*a));
+    if (!v)
+        return NULL;
     v->arr[ v->length++ ] = elem;
     *a = v->arr;
     return v->arr;
 }
 
+void* vec_append_sized(void* pa, const void* elem)
+{
+    void** a = pa;
+    Vec* v = _vec_grow(_to_vec(*a));
+    if (!v)
+        return NULL;
+    memcpy(_vec_elem(v, v->length++), elem, v->elem_size);
+    *a = v->arr;
+    return v->arr;
+}
+
 
 vec_entry* vec_insert(vec_entry** a, size_t pos, vec_entry elem)
 {
+    return vec_insert_sized(a, pos, &elem);
+}
+
+void* vec_insert_sized(void* pa, size_t pos, const void* elem)
+{
+    void** a = pa;
     Vec* v = _to_vec(*a);
     assert(pos <= v->length);
-    if (v->size < v->length + 1) {
-        size_t sz = (v->size * 3) >> 1;
-        v = _vec_resize(v, sz);
-        if (!v)
-            return NULL;
-    }
+    v = _vec_grow(v);
+    if (!v)
+        return NULL;
     if (pos < v->length) {
-        memmove(v->arr + pos + 1, v->arr+pos, (v->length - pos)*sizeof *v->arr);
+        memmove(_vec_elem(v, pos + 1), _vec_elem(v, pos), (v->length - pos) * v->elem_size);
     }
-    v->arr[pos] = elem;
+    memcpy(_vec_elem(v, pos), elem, v->elem_size);
     v->length++;
     *a = v->arr;
     return v->arr;
@@ -125,19 +210,22 @@ vec_entry* vec_insert(vec_entry** a, size_t pos, vec_entry elem)
 
 vec_entry* vec_remove(vec_entry** a, size_t pos)
 {
+    return vec_remove_sized(a, pos);
+}
+
+void* vec_remove_sized(void* pa, size_t pos)
+{
+    void** a = pa;
     Vec* v = _to_vec(*a);
     assert(pos < v->length);
     if (pos < v->length - 1) {
-        memmove(v->arr + pos, v->arr+pos+1, (v->length - pos - 1)*sizeof *v->arr);
+        memmove(_vec_elem(v, pos), _vec_elem(v, pos + 1), (v->length - pos - 1) * v->elem_size);
     }
     v->length--;
-    if (3 * v->length < v->size) {
-        size_t sz = v->size >> 1;
-        v = _vec_resize(v, sz);
-        if (!v)
-            return NULL;
-        *a = v->arr;
-    }
+    v = _vec_shrink(v);
+    if (!v)
+        return NULL;
+    *a = v->arr;
     return v->arr;
 }
 
@@ -2,6 +2,8 @@
 
 #include <stddef.h>
 
+#include "pgalloc.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -15,15 +17,46 @@ extern "C" {
     } vec_entry;
 
     vec_entry* vec_create(size_t initialSize);
+    /*
+     * Same as vec_create, but the array is allocated with the given
+     * policy (see pgalloc.h), and so is it when it grows
+     */
+    vec_entry* vec_create_ex(size_t initialSize, const pg_policy_t* policy);
     void vec_free(vec_entry** a, void (*dtor_fn)(vec_entry));
-    size_t vec_size(vec_entry* a);
-    size_t vec_length(vec_entry* a);
+    /* These work on the vectors of vec_create_sized too */
+    size_t vec_size(const void* a);
+    size_t vec_length(const void* a);
 
     vec_entry* vec_resize(vec_entry** a, size_t newSize);
     vec_entry* vec_append(vec_entry** a, vec_entry elem);
     vec_entry* vec_insert(vec_entry** a, size_t pos, vec_entry elem);
     vec_entry* vec_remove(vec_entry** a, size_t pos);
 
+    /*
+     * A vector of elements of elem_size bytes each (e.g. ints, or
+     * structs), stored contiguously, with the same header before the
+     * array as for vec_entry elements: the array is returned, to be used
+     * as the caller's type, aligned as a vec_entry. E.g.
+     *
+     *     struct point* pts = vec_create_of(struct point, 100);
+     *     vec_append_sized(&pts, &(struct point){1, 2});
+     *
+     * The _sized functions take the address of the caller's pointer
+     * (pa), which they update if the array moves, and the address of
+     * the element to copy in. dtor_fn gets the address of each element
+     */
+    void* vec_create_sized(size_t elem_size, size_t initialSize);
+    void* vec_create_sized_ex(size_t elem_size, size_t initialSize,
+            const pg_policy_t* policy);
+#define vec_create_of(type, initialSize) ((type*) vec_create_sized(sizeof(type), (initialSize)))
+    void vec_free_sized(void* pa, void (*dtor_fn)(void*));
+    size_t vec_elem_size(const void* a);
+
+    void* vec_resize_sized(void* pa, size_t newSize);
+    void* vec_append_sized(void* pa, const void* elem);
+    void* vec_insert_sized(void* pa, size_t pos, const void* elem);
+    void* vec_remove_sized(void* pa, size_t pos);
+
 #ifdef __cplusplus
 }
 #endif
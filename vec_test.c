@@ -1,6 +1,10 @@
 #include <stdio.h>
 #include "vec.h"
 
+struct point {
+    int x, y, z;
+};
+
 int main()
 {
     size_t i;
@@ -27,5 +31,29 @@ int main()
         printf("array[%zu]=%ld\n", i, v[i].l);
 
     vec_free(&v, NULL);
+
+    int* ints = vec_create_sized(sizeof(int), 0);
+    for (i=0; i<max; ++i) {
+        int k = i;
+        vec_append_sized(&ints, &k);
+    }
+    vec_remove_sized(&ints, 0);
+    vec_insert_sized(&ints, 1, &(int){-1});
+    printf("int array size=%zu and len=%zu, elem size=%zu\n",
+            vec_size(ints), vec_length(ints), vec_elem_size(ints));
+    for (i = 0; i<vec_length(ints); ++i)
+        printf("ints[%zu]=%d\n", i, ints[i]);
+    vec_free_sized(&ints, NULL);
+
+    struct point* pts = vec_create_of(struct point, 0);
+    for (i=0; i<max; ++i)
+        vec_append_sized(&pts, &(struct point){i, 2*i, 3*i});
+    for (i=0; i<=2*max/3; ++i)
+        vec_remove_sized(&pts, 1);
+    printf("point array size=%zu and len=%zu, elem size=%zu\n",
+            vec_size(pts), vec_length(pts), vec_elem_size(pts));
+    for (i = 0; i<vec_length(pts); ++i)
+        printf("pts[%zu]={%d, %d, %d}\n", i, pts[i].x, pts[i].y, pts[i].z);
+    vec_free_sized(&pts, NULL);
 }
 